@@ -0,0 +1,359 @@
+local ffi = require("ffi")
+
+-- A triangle mesh in flat ffi arrays instead of a table per triangle,
+-- adjacency and vertex.
+--
+-- Vertices and triangles are numbered from 1 like the tables they replace,
+-- slot 0 is never used. Corner j (1-3) of triangle t is the half edge
+-- t*3+j-1, which indexes
+--   tv  - The vertex in the corner
+--   adj - The half edge on the other side of the edge opposite the corner,
+--         NONE if the edge is on the hull
+--   fixed - 1 if that edge is constrained. Both half edges of an edge agree
+-- Triangle t has the flag bits flags[t]. DEAD is set while it's on the free
+-- list, the other bits are for the algorithms to mark triangles with and
+-- have to be cleared again when they're done.
+-- Vertex v sits at x[v], y[v] and vt[v] is a half edge of some triangle with v
+-- in the corner.
+--
+-- free_tri puts a triangle on a free list that stays with the mesh,
+-- add_tri takes triangles from it before it makes the mesh bigger.
+--
+-- The arrays are replaced when they grow, so don't hold on to them across a
+-- call to add_vert or add_tri.
+--
+-- Point location goes through a uniform grid over the vertices, every cell
+-- holds the last vertex added in it. vt keeps the vertices pointing at a live
+-- triangle through splits and flips, so a vertex is always a good place to
+-- start walking from and the grid never has to know about triangles.
+local lib = {}
+
+lib.NONE = -1
+
+-- Bits in flags
+lib.DEAD = 1
+
+local INITIAL_VERTS = 64
+local INITIAL_TRIS = 128
+-- About this many vertices per grid cell when the grid is built. It's built
+-- again once there are GRID_REBUILD times as many
+local GRID_FILL = 2
+local GRID_REBUILD = 8
+
+local function grow(old, ctype, newcap)
+	local new = ffi.new(ctype, newcap)
+	if old ~= nil then
+		ffi.copy(new, old, ffi.sizeof(old))
+	end
+	return new
+end
+
+local function reserve_verts(face, n)
+	if n < face.vcap then
+		return
+	end
+	local cap = face.vcap
+	while cap <= n do
+		cap = cap * 2
+	end
+	face.x = grow(face.x, "double[?]", cap)
+	face.y = grow(face.y, "double[?]", cap)
+	face.vt = grow(face.vt, "int32_t[?]", cap)
+	face.vcap = cap
+end
+
+local function reserve_tris(face, n)
+	if n < face.tcap then
+		return
+	end
+	local cap = face.tcap
+	while cap <= n do
+		cap = cap * 2
+	end
+	face.tv = grow(face.tv, "int32_t[?]", cap*3)
+	face.adj = grow(face.adj, "int32_t[?]", cap*3)
+	face.fixed = grow(face.fixed, "uint8_t[?]", cap*3)
+	face.flags = grow(face.flags, "uint8_t[?]", cap)
+	face.tcap = cap
+end
+
+function lib.new(vcap, tcap)
+	local face = {
+		nv = 0,
+		nt = 0,
+		vcap = 1,
+		tcap = 1,
+		free = {},
+		nfree = 0,
+	}
+	reserve_verts(face, vcap or INITIAL_VERTS)
+	reserve_tris(face, tcap or INITIAL_TRIS)
+	return face
+end
+
+local function grid_cell(grid, x, y)
+	local cx = math.floor((x - grid.minx) * grid.sx)
+	local cy = math.floor((y - grid.miny) * grid.sy)
+	-- Anything outside the bounds goes in the cells on the border
+	cx = math.max(0, math.min(grid.w-1, cx))
+	cy = math.max(0, math.min(grid.h-1, cy))
+	return cx, cy
+end
+
+local function grid_insert(grid, face, v)
+	local cx, cy = grid_cell(grid, face.x[v], face.y[v])
+	grid.cells[cy*grid.w + cx] = v
+end
+
+-- The vertex in a cell if it's in a triangle yet
+local function grid_probe(grid, vt, cx, cy)
+	if cx < 0 or cx >= grid.w or cy < 0 or cy >= grid.h then
+		return nil
+	end
+	local v = grid.cells[cy*grid.w + cx]
+	if v ~= 0 and vt[v] ~= lib.NONE then
+		return v
+	end
+	return nil
+end
+
+local function grid_build(face)
+	local minx, miny, maxx, maxy = face.minx, face.miny, face.maxx, face.maxy
+	if minx == nil then
+		minx, miny = math.huge, math.huge
+		maxx, maxy = -math.huge, -math.huge
+		local x, y = face.x, face.y
+		for v = 1,face.nv do
+			minx = math.min(minx, x[v])
+			miny = math.min(miny, y[v])
+			maxx = math.max(maxx, x[v])
+			maxy = math.max(maxy, y[v])
+		end
+	end
+	local dx = math.max(maxx - minx, 1e-9)
+	local dy = math.max(maxy - miny, 1e-9)
+
+	-- Square cells, as many as it takes to get GRID_FILL vertices in each
+	local ncells = math.max(1, math.ceil(face.nv / GRID_FILL))
+	local side = math.sqrt(dx*dy / ncells)
+	local w = math.max(1, math.min(ncells, math.ceil(dx / side)))
+	local h = math.max(1, math.min(ncells, math.ceil(dy / side)))
+
+	local grid = {
+		minx = minx,
+		miny = miny,
+		sx = w / dx,
+		sy = h / dy,
+		w = w,
+		h = h,
+		-- The vertex count the grid was sized for
+		size = face.nv,
+		cells = ffi.new("int32_t[?]", w*h),
+	}
+	for v = 1,face.nv do
+		grid_insert(grid, face, v)
+	end
+	face.grid = grid
+	return grid
+end
+
+function lib.add_vert(face, x, y)
+	local v = face.nv + 1
+	reserve_verts(face, v)
+	face.nv = v
+	face.x[v] = x
+	face.y[v] = y
+	face.vt[v] = lib.NONE
+	if face.grid ~= nil then
+		grid_insert(face.grid, face, v)
+	end
+	return v
+end
+
+-- The area the points to locate are in. The grid only covers this, so the
+-- super triangle corners don't leave most of its cells empty. Without it the
+-- grid covers all the vertices
+function lib.set_bounds(face, minx, miny, maxx, maxy)
+	face.minx, face.miny, face.maxx, face.maxy = minx, miny, maxx, maxy
+	face.grid = nil
+end
+
+-- A vertex close to x, y that is in a triangle, nil if there is none
+function lib.near_vert(face, x, y)
+	local grid = face.grid
+	if grid == nil or face.nv > grid.size * GRID_REBUILD then
+		grid = grid_build(face)
+	end
+	local vt = face.vt
+	local cx, cy = grid_cell(grid, x, y)
+	local v = grid_probe(grid, vt, cx, cy)
+	if v ~= nil then
+		return v
+	end
+	-- Look in rings of cells around it until one has a vertex
+	for r = 1,math.max(grid.w, grid.h) do
+		for i = -r,r do
+			v = grid_probe(grid, vt, cx+i, cy-r)
+				or grid_probe(grid, vt, cx+i, cy+r)
+				or grid_probe(grid, vt, cx-r, cy+i)
+				or grid_probe(grid, vt, cx+r, cy+i)
+			if v ~= nil then
+				return v
+			end
+		end
+	end
+	return nil
+end
+
+-- A new triangle with the given corners and no neighbours, in the slot of the
+-- last one freed if there is one
+function lib.add_tri(face, a, b, c)
+	local t
+	if face.nfree > 0 then
+		t = face.free[face.nfree]
+		face.nfree = face.nfree - 1
+	else
+		t = face.nt + 1
+		reserve_tris(face, t)
+		face.nt = t
+	end
+	local h = t*3
+	local tv, adj, fixed = face.tv, face.adj, face.fixed
+	tv[h], tv[h+1], tv[h+2] = a or 0, b or 0, c or 0
+	adj[h], adj[h+1], adj[h+2] = lib.NONE, lib.NONE, lib.NONE
+	fixed[h], fixed[h+1], fixed[h+2] = 0, 0, 0
+	face.flags[t] = 0
+	return t
+end
+
+-- Put triangle t on the free list. Nothing may point at it anymore, but it
+-- keeps its corners and neighbours until add_tri hands it out again
+function lib.free_tri(face, t)
+	face.flags[t] = lib.DEAD
+	face.nfree = face.nfree + 1
+	face.free[face.nfree] = t
+end
+
+function lib.half(tri, vert)
+	return tri*3 + vert-1
+end
+
+-- The triangle and corner of a half edge
+function lib.corner(h)
+	local tri = math.floor(h/3)
+	return tri, h - tri*3 + 1
+end
+
+-- Make the half edges h1 and h2 each others opposite, and constrained if
+-- fixed is 1. h2 may be NONE
+function lib.link(face, h1, h2, fixed)
+	face.adj[h1] = h2
+	face.fixed[h1] = fixed
+	if h2 ~= lib.NONE then
+		face.adj[h2] = h1
+		face.fixed[h2] = fixed
+	end
+end
+
+-- Constrain the edge of half edge h, on both sides
+function lib.set_fixed(face, h)
+	face.fixed[h] = 1
+	local o = face.adj[h]
+	if o ~= lib.NONE then
+		face.fixed[o] = 1
+	end
+end
+
+-- All the constrained edges as {a, b} vertex pairs, for drawing and checks
+function lib.fixed_edges(face)
+	local edges = {}
+	local tv, adj, fixed = face.tv, face.adj, face.fixed
+	for h = 3,face.nt*3+2 do
+		if fixed[h] ~= 0 and (adj[h] == lib.NONE or h < adj[h])
+			and bit.band(face.flags[math.floor(h/3)], lib.DEAD) == 0 then
+			-- The edge runs between the other two corners
+			local base = math.floor(h/3)*3
+			edges[#edges+1] = {
+				tv[base + (h-base+2)%3],
+				tv[base + (h-base+1)%3],
+			}
+		end
+	end
+	return edges
+end
+
+-- Append the mesh to the flat list out, for sending it somewhere only plain
+-- numbers can go, like a love.thread channel
+function lib.pack(face, out)
+	table.insert(out, face.nv)
+	for v = 1,face.nv do
+		table.insert(out, face.x[v])
+		table.insert(out, face.y[v])
+		table.insert(out, face.vt[v])
+	end
+	table.insert(out, face.nt)
+	for h = 3,face.nt*3+2 do
+		table.insert(out, face.tv[h])
+		table.insert(out, face.adj[h])
+		table.insert(out, face.fixed[h])
+	end
+	return out
+end
+
+-- The mesh that pack put in the list at i, and the index after it
+function lib.unpack(list, i)
+	local nv = list[i]
+	i = i + 1
+	local face = lib.new(nv, list[i + nv*3])
+	for v = 1,nv do
+		lib.add_vert(face, list[i], list[i+1])
+		face.vt[v] = list[i+2]
+		i = i + 3
+	end
+	local nt = list[i]
+	i = i + 1
+	for t = 1,nt do
+		lib.add_tri(face)
+	end
+	local tv, adj, fixed = face.tv, face.adj, face.fixed
+	for h = 3,nt*3+2 do
+		tv[h], adj[h], fixed[h] = list[i], list[i+1], list[i+2]
+		i = i + 3
+	end
+	return face, i
+end
+
+-- Build a mesh from the old table layout, v, t, adj and inv_t. t may have
+-- holes and adj may leave out the hull edges.
+function lib.from_tables(tbl)
+	local face = lib.new(#tbl.v, nil)
+	for _, v in ipairs(tbl.v) do
+		lib.add_vert(face, v[1], v[2])
+	end
+	local nt = 0
+	for t in pairs(tbl.t) do
+		nt = math.max(nt, t)
+	end
+	for t = 1, nt do
+		local tri = tbl.t[t]
+		if tri ~= nil then
+			lib.add_tri(face, tri[1], tri[2], tri[3])
+		else
+			lib.add_tri(face)
+		end
+	end
+	for t, adj in pairs(tbl.adj) do
+		for j = 1, 3 do
+			local o = adj[j]
+			if o ~= nil and o[1] ~= nil then
+				face.adj[lib.half(t, j)] = lib.half(o[1], o[2])
+			end
+		end
+	end
+	for v, inv in ipairs(tbl.inv_t) do
+		face.vt[v] = lib.half(inv[1], inv[2])
+	end
+	return face
+end
+
+return lib
@@ -0,0 +1,70 @@
+local ffi = require("ffi")
+
+-- Orientation and incircle tests that get the sign right for any input, from
+-- src/predicates.c. make builds it into predicates.so next to this file.
+--
+-- Without it they fall back to the plain float determinants, which get
+-- confused by points that are on or very close to a line or a circle.
+local lib = {}
+
+ffi.cdef[[
+double predicates_orient2d(double ax, double ay, double bx, double by, double cx, double cy);
+double predicates_incircle(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy);
+]]
+
+local function load_kernel()
+	local dirs = {}
+	if love ~= nil and love.filesystem ~= nil and love.filesystem.getSource ~= nil then
+		table.insert(dirs, love.filesystem.getSource())
+	end
+	local source = debug.getinfo(1, "S").source
+	table.insert(dirs, source:match("^@(.*)/[^/]*$") or ".")
+
+	for _, dir in ipairs(dirs) do
+		local ok, kernel = pcall(ffi.load, dir .. "/predicates.so")
+		if ok then
+			return kernel
+		end
+	end
+	print("predicates.so is missing, the triangulation isn't robust. Build it with make")
+	return nil
+end
+
+-- The functions below point into the library, it has to stay referenced so
+-- it isn't unloaded
+lib.kernel = load_kernel()
+
+if lib.kernel ~= nil then
+	local kernel = lib.kernel
+	-- Positive if a, b, c are counterclockwise, negative if clockwise and 0
+	-- if they are on a line
+	lib.orient2d = kernel.predicates_orient2d
+	-- Positive if d is inside the circle through the counterclockwise a, b,
+	-- c, 0 if it's on it. The sign flips if a, b, c are clockwise
+	lib.incircle = kernel.predicates_incircle
+else
+	function lib.orient2d(ax, ay, bx, by, cx, cy)
+		return (ax - cx) * (by - cy) - (ay - cy) * (bx - cx)
+	end
+
+	function lib.incircle(ax, ay, bx, by, cx, cy, dx, dy)
+		local adx = ax - dx
+		local ady = ay - dy
+		local bdx = bx - dx
+		local bdy = by - dy
+		local cdx = cx - dx
+		local cdy = cy - dy
+
+		local bcdet = bdx * cdy - bdy * cdx
+		local cadet = cdx * ady - cdy * adx
+		local abdet = adx * bdy - ady * bdx
+
+		local alift = adx * adx + ady * ady
+		local blift = bdx * bdx + bdy * bdy
+		local clift = cdx * cdx + cdy * cdy
+
+		return alift * bcdet + blift * cadet + clift * abdet
+	end
+end
+
+return lib
@@ -0,0 +1,356 @@
+local predicates = require("predicates")
+
+-- Douglas-Peucker simplification of the ways rings are made of, that keeps
+-- their topology. Every way is simplified once, so the rings that share it
+-- share the simplified way too. That only holds within one call, how a way is
+-- simplified depends on the other ways passed along with it. Ways that are
+-- drawn together have to be simplified together.
+--
+-- A stretch of a way is only replaced by a shortcut when the shortcut doesn't
+-- touch any other segment, of any way, and no other point is in the area
+-- between the stretch and the shortcut. Otherwise the stretch is split as if
+-- it was too far from the shortcut. That way no rings cross, nothing ends up
+-- on the other side of a line and rings don't collapse. Points that are in
+-- more than one place, like where ways meet, always stay.
+local lib = {}
+
+-- About this many points per grid cell
+local GRID_FILL = 4
+
+-- Squared distance from p to the segment a b
+local function seg_dist2(px, py, ax, ay, bx, by)
+	local dx, dy = bx - ax, by - ay
+	local len2 = dx*dx + dy*dy
+	local t = 0
+	if len2 > 0 then
+		t = math.max(0, math.min(1, ((px - ax)*dx + (py - ay)*dy) / len2))
+	end
+	local ex, ey = ax + t*dx - px, ay + t*dy - py
+	return ex*ex + ey*ey
+end
+
+-- If p, on the line through a and b, is on the segment a b
+local function on_seg(px, py, ax, ay, bx, by)
+	return px >= math.min(ax, bx) and px <= math.max(ax, bx)
+		and py >= math.min(ay, by) and py <= math.max(ay, by)
+end
+
+local function sign(x)
+	if x > 0 then
+		return 1
+	elseif x < 0 then
+		return -1
+	end
+	return 0
+end
+
+-- If the segments a b and c d have any point in common
+local function seg_touch(ax, ay, bx, by, cx, cy, dx, dy)
+	local o1 = sign(predicates.orient2d(ax, ay, bx, by, cx, cy))
+	local o2 = sign(predicates.orient2d(ax, ay, bx, by, dx, dy))
+	local o3 = sign(predicates.orient2d(cx, cy, dx, dy, ax, ay))
+	local o4 = sign(predicates.orient2d(cx, cy, dx, dy, bx, by))
+	if o1*o2 < 0 and o3*o4 < 0 then
+		return true
+	end
+	return (o1 == 0 and on_seg(cx, cy, ax, ay, bx, by))
+		or (o2 == 0 and on_seg(dx, dy, ax, ay, bx, by))
+		or (o3 == 0 and on_seg(ax, ay, cx, cy, dx, dy))
+		or (o4 == 0 and on_seg(bx, by, cx, cy, dx, dy))
+end
+
+local function new_grid(minx, miny, maxx, maxy, n)
+	local dx = math.max(maxx - minx, 1e-9)
+	local dy = math.max(maxy - miny, 1e-9)
+	local ncells = math.max(1, math.ceil(n / GRID_FILL))
+	local side = math.sqrt(dx*dy / ncells)
+	local w = math.max(1, math.min(ncells, math.ceil(dx / side)))
+	local h = math.max(1, math.min(ncells, math.ceil(dy / side)))
+	return {
+		minx = minx,
+		miny = miny,
+		sx = w / dx,
+		sy = h / dy,
+		w = w,
+		h = h,
+		-- Lists of segments and points, by cell
+		segs = {},
+		pts = {},
+	}
+end
+
+-- The cells covering a box, clamped to the grid
+local function grid_range(grid, minx, miny, maxx, maxy)
+	local cx1 = math.max(0, math.min(grid.w-1, math.floor((minx - grid.minx) * grid.sx)))
+	local cy1 = math.max(0, math.min(grid.h-1, math.floor((miny - grid.miny) * grid.sy)))
+	local cx2 = math.max(0, math.min(grid.w-1, math.floor((maxx - grid.minx) * grid.sx)))
+	local cy2 = math.max(0, math.min(grid.h-1, math.floor((maxy - grid.miny) * grid.sy)))
+	return cx1, cy1, cx2, cy2
+end
+
+local function grid_add(cells, grid, id, minx, miny, maxx, maxy)
+	local cx1, cy1, cx2, cy2 = grid_range(grid, minx, miny, maxx, maxy)
+	for cy = cy1,cy2 do
+		for cx = cx1,cx2 do
+			local key = cy*grid.w + cx
+			local cell = cells[key]
+			if cell == nil then
+				cell = {}
+				cells[key] = cell
+			end
+			cell[#cell+1] = id
+		end
+	end
+end
+
+-- Simplify lines, a table of lists of point ids, so no point is further than
+-- tolerance from the simplified line. points[id] is the {x, y} of a point.
+-- Returns a table with the same keys as lines, keep[key][i] is true if
+-- lines[key][i] stays.
+function lib.lines(lines, points, tolerance)
+	local keys = {}
+	for key in pairs(lines) do
+		keys[#keys+1] = key
+	end
+	table.sort(keys)
+
+	-- Every point once, pinned if it's used more than once or ends a line
+	local vx, vy = {}, {}
+	local vindex = {}
+	local nv = 0
+	local uses = {}
+	local minx, miny = math.huge, math.huge
+	local maxx, maxy = -math.huge, -math.huge
+	for _, key in ipairs(keys) do
+		for _, id in ipairs(lines[key]) do
+			local v = vindex[id]
+			if v == nil then
+				nv = nv + 1
+				v = nv
+				vindex[id] = v
+				local p = points[id]
+				vx[v], vy[v] = p[1], p[2]
+				uses[v] = 0
+				minx, miny = math.min(minx, p[1]), math.min(miny, p[2])
+				maxx, maxy = math.max(maxx, p[1]), math.max(maxy, p[2])
+			end
+			uses[v] = uses[v] + 1
+		end
+	end
+
+	-- All the segments there are now. Segment s runs from sa[s] to sb[s],
+	-- segment base[line]+i is the one from point i to i+1 of the line
+	local sa, sb = {}, {}
+	local alive = {}
+	local base = {}
+	local ns = 0
+	local valive = {}
+	local grid = new_grid(minx, miny, maxx, maxy, nv)
+
+	local function add_seg(a, b)
+		ns = ns + 1
+		sa[ns], sb[ns] = a, b
+		alive[ns] = true
+		grid_add(grid.segs, grid, ns,
+			math.min(vx[a], vx[b]), math.min(vy[a], vy[b]),
+			math.max(vx[a], vx[b]), math.max(vy[a], vy[b]))
+	end
+
+	for v = 1,nv do
+		valive[v] = true
+		grid_add(grid.pts, grid, v, vx[v], vy[v], vx[v], vy[v])
+	end
+	for li, key in ipairs(keys) do
+		local line = lines[key]
+		base[li] = ns
+		for i = 1,#line-1 do
+			add_seg(vindex[line[i]], vindex[line[i+1]])
+		end
+	end
+
+	-- Stamps the points of the stretch being checked
+	local stretch = {}
+	local stamp = 0
+
+	-- If the shortcut from point i to j of the line can replace the points
+	-- between them. The stretch lies in the box given
+	local function can_shortcut(li, line, i, j, bminx, bminy, bmaxx, bmaxy)
+		local a, b = vindex[line[i]], vindex[line[j]]
+		if a == b then
+			return false
+		end
+		local ax, ay, bx, by = vx[a], vy[a], vx[b], vy[b]
+
+		stamp = stamp + 1
+		for k = i,j do
+			stretch[vindex[line[k]]] = stamp
+		end
+
+		-- No segment may touch the shortcut, except where they meet at its
+		-- ends without overlapping it
+		local first, last = base[li] + i, base[li] + j - 1
+		local cx1, cy1, cx2, cy2 = grid_range(grid,
+			math.min(ax, bx), math.min(ay, by), math.max(ax, bx), math.max(ay, by))
+		for cy = cy1,cy2 do
+			for cx = cx1,cx2 do
+				for _, s in ipairs(grid.segs[cy*grid.w + cx] or {}) do
+					if alive[s] and (s < first or s > last) then
+						local c, d = sa[s], sb[s]
+						local shared, other = nil, nil
+						if c == a or c == b then
+							shared, other = c, d
+						elseif d == a or d == b then
+							shared, other = d, c
+						end
+						if shared ~= nil then
+							local far = shared == a and b or a
+							if other == far then
+								return false
+							end
+							local sx, sy = vx[shared], vy[shared]
+							if predicates.orient2d(sx, sy, vx[far], vy[far], vx[other], vy[other]) == 0
+								and (vx[far] - sx)*(vx[other] - sx) + (vy[far] - sy)*(vy[other] - sy) > 0 then
+								return false
+							end
+						elseif seg_touch(ax, ay, bx, by, vx[c], vy[c], vx[d], vy[d]) then
+							return false
+						end
+					end
+				end
+			end
+		end
+
+		-- No other point may be in the area between the stretch and the
+		-- shortcut
+		cx1, cy1, cx2, cy2 = grid_range(grid, bminx, bminy, bmaxx, bmaxy)
+		for cy = cy1,cy2 do
+			for cx = cx1,cx2 do
+				for _, v in ipairs(grid.pts[cy*grid.w + cx] or {}) do
+					if valive[v] and stretch[v] ~= stamp then
+						local px, py = vx[v], vy[v]
+						local inside = false
+						for k = i,j do
+							local p = vindex[line[k]]
+							local q = vindex[line[k == j and i or k+1]]
+							if (vy[p] > py) ~= (vy[q] > py) then
+								local x = vx[p] + (py - vy[p]) / (vy[q] - vy[p]) * (vx[q] - vx[p])
+								if px < x then
+									inside = not inside
+								end
+							end
+						end
+						if inside then
+							return false
+						end
+					end
+				end
+			end
+		end
+		return true
+	end
+
+	local tol2 = tolerance * tolerance
+	local keep = {}
+	for li, key in ipairs(keys) do
+		local line = lines[key]
+		local n = #line
+		local kept = {}
+		keep[key] = kept
+
+		-- Start with the stretches between the pinned points
+		local stack = {}
+		local last = 1
+		kept[1] = true
+		for i = 2,n do
+			kept[i] = false
+			if i == n or uses[vindex[line[i]]] > 1 then
+				kept[i] = true
+				stack[#stack+1] = {last, i}
+				last = i
+			end
+		end
+
+		while #stack > 0 do
+			local i, j = unpack(table.remove(stack))
+			if j > i + 1 then
+				local a, b = vindex[line[i]], vindex[line[j]]
+				local ax, ay, bx, by = vx[a], vy[a], vx[b], vy[b]
+				local far, fard = nil, -1
+				local bminx, bminy = math.min(ax, bx), math.min(ay, by)
+				local bmaxx, bmaxy = math.max(ax, bx), math.max(ay, by)
+				for k = i+1,j-1 do
+					local v = vindex[line[k]]
+					local d = seg_dist2(vx[v], vy[v], ax, ay, bx, by)
+					if d > fard then
+						far, fard = k, d
+					end
+					bminx, bminy = math.min(bminx, vx[v]), math.min(bminy, vy[v])
+					bmaxx, bmaxy = math.max(bmaxx, vx[v]), math.max(bmaxy, vy[v])
+				end
+
+				if fard <= tol2 and can_shortcut(li, line, i, j, bminx, bminy, bmaxx, bmaxy) then
+					for s = base[li]+i,base[li]+j-1 do
+						alive[s] = false
+					end
+					for k = i+1,j-1 do
+						valive[vindex[line[k]]] = false
+					end
+					add_seg(a, b)
+				else
+					kept[far] = true
+					stack[#stack+1] = {far, j}
+					stack[#stack+1] = {i, far}
+				end
+			end
+		end
+	end
+
+	return keep
+end
+
+-- lines simplified for every tolerance in tolerances, from the smallest up.
+-- Every level is simplified from the points the one before it kept, so a
+-- level only has points the finer levels have too and the coarse ones are
+-- quick to make. The errors add up, a level can be off by the sum of the
+-- tolerances up to it. Returns a keep table like lines does per tolerance
+function lib.levels(lines, points, tolerances)
+	local levels = {}
+	local current = lines
+	-- index[key][i] is where current[key][i] is in lines[key]
+	local index = {}
+	for key, line in pairs(lines) do
+		local idx = {}
+		for i = 1,#line do
+			idx[i] = i
+		end
+		index[key] = idx
+	end
+
+	for l, tolerance in ipairs(tolerances) do
+		local keep = lib.lines(current, points, tolerance)
+		local level = {}
+		local nextlines, nextindex = {}, {}
+		for key, line in pairs(lines) do
+			local kept = {}
+			for i = 1,#line do
+				kept[i] = false
+			end
+			local sub, subidx = {}, {}
+			local idx = index[key]
+			for i, k in ipairs(keep[key]) do
+				if k then
+					kept[idx[i]] = true
+					sub[#sub+1] = current[key][i]
+					subidx[#subidx+1] = idx[i]
+				end
+			end
+			level[key] = kept
+			nextlines[key], nextindex[key] = sub, subidx
+		end
+		levels[l] = level
+		current, index = nextlines, nextindex
+	end
+	return levels
+end
+
+return lib
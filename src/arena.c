@@ -0,0 +1,80 @@
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+struct arenaChunk {
+	struct arenaChunk *next;
+	size_t size;
+	size_t used;
+	_Alignas(ARENA_ALIGN) uint8_t data[];
+};
+
+void arena_init(struct arena *arena) {
+	*arena = (struct arena){ 0 };
+}
+
+void arena_kill(struct arena *arena) {
+	struct arenaChunk *chunk = arena->first;
+	while(chunk != NULL) {
+		struct arenaChunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	*arena = (struct arena){ 0 };
+}
+
+// Put a chunk that fits size after the current one and make it current
+static void nextChunk(struct arena *arena, size_t size) {
+	struct arenaChunk *cur = arena->cur;
+	if(cur != NULL) {
+		// The tail of the chunk is lost until the next reset
+		arena->used += cur->size - cur->used;
+	}
+
+	// The chunks after the current one are free since the last reset
+	struct arenaChunk *next = cur != NULL ? cur->next : arena->first;
+	if(next != NULL && next->size >= size) {
+		next->used = 0;
+		arena->cur = next;
+		return;
+	}
+
+	size_t chunkSize = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+	struct arenaChunk *chunk = malloc(sizeof(struct arenaChunk) + chunkSize);
+	if(chunk == NULL) abort();
+	chunk->size = chunkSize;
+	chunk->used = 0;
+	chunk->next = next;
+	if(cur != NULL) {
+		cur->next = chunk;
+	} else {
+		arena->first = chunk;
+	}
+	arena->cur = chunk;
+	arena->reserved += chunkSize;
+}
+
+void* arena_alloc(struct arena *arena, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	// Zero sized allocations still get their own address
+	if(size == 0) size = ARENA_ALIGN;
+
+	struct arenaChunk *cur = arena->cur;
+	if(cur == NULL || cur->size - cur->used < size) {
+		nextChunk(arena, size);
+		cur = arena->cur;
+	}
+
+	void *ptr = cur->data + cur->used;
+	cur->used += size;
+	arena->used += size;
+	if(arena->used > arena->peak) arena->peak = arena->used;
+	return ptr;
+}
+
+void arena_reset(struct arena *arena) {
+	arena->cur = arena->first;
+	if(arena->cur != NULL) arena->cur->used = 0;
+	arena->used = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+// A growable bump allocator for the scratch memory of a single query.
+// Everything allocated is released at once by arena_reset, which keeps the
+// chunks around. After the first few queries the arena has grown to the size
+// of the largest one, and allocating from it never reaches malloc again.
+#define ARENA_CHUNK_SIZE (1024*1024)
+// Every allocation is aligned to this
+#define ARENA_ALIGN 16
+
+struct arenaChunk;
+
+struct arena {
+	struct arenaChunk *first;
+	struct arenaChunk *cur;
+	// Bytes handed out since the last reset, including the chunk tails that
+	// were skipped
+	size_t used;
+	// The most used has been since the arena was created
+	size_t peak;
+	// Sum of the sizes of all the chunks
+	size_t reserved;
+};
+
+void arena_init(struct arena *arena);
+void arena_kill(struct arena *arena);
+
+// Never returns NULL, aborts when out of memory
+void* arena_alloc(struct arena *arena, size_t size);
+// Release everything allocated from the arena. O(1), the chunks are kept
+// for the next query.
+void arena_reset(struct arena *arena);
@@ -0,0 +1,82 @@
+#include "blob.h"
+
+#include "metrics.h"
+#include "pbf.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+struct slice decodeblob(struct libdeflate_decompressor* decompressor, void *buf, size_t size, size_t dsize) {
+	TRACE_BEGIN("decodeblob");
+	dsize = dsize == 0 ? DEFAULT_DECOMPRESS_BUFFER_SIZE : dsize;
+	metrics_add(COUNTER_BLOBS_DECODED, 1);
+
+	struct pbfcursor data = {
+		.cursor = buf,
+		.end = buf + size,
+	};
+
+	while(data.cursor < buf + size){
+		uint64_t key = readVarInt(&data);
+		switch(KEY_PART(key)) {
+			case 1: {
+				// Raw
+				struct sizestr str = readString(&data);
+				TRACE_END("decodeblob");
+				return (struct slice){
+					.root = buf,
+					.data = str.str,
+					.size = str.len,
+				};
+				break;
+			}
+			case 3: {
+				// zlib_data
+				struct sizestr str = readString(&data);
+				void* decompbuf = malloc(dsize);
+				if(decompbuf == NULL) abort();
+				size_t decompsize;
+				int rc = libdeflate_zlib_decompress(decompressor, str.str, str.len, decompbuf, dsize, &decompsize);
+				if(rc == 0) {
+					metrics_add(COUNTER_BYTES_INFLATED, decompsize);
+					free(buf);
+					TRACE_END("decodeblob");
+					return (struct slice){
+						.root = decompbuf,
+						.data = decompbuf,
+						.size = decompsize,
+					};
+				}
+				break;
+			}
+			default:
+				skip(&data, TYPE_PART(key));
+				break;
+		}
+	}
+
+	abort();
+}
+
+struct slice extractblob(int pbf, struct libdeflate_decompressor* decompressor, size_t offset, size_t size, size_t dsize) {
+	TRACE_BEGIN("extractblob");
+	void *buf = malloc(size);
+	if(buf == NULL) {
+		abort();
+	}
+
+	size_t done = 0;
+	while(done < size) {
+		ssize_t r = pread(pbf, buf + done, size - done, offset + done);
+		if(r <= 0) {
+			abort();
+		}
+		done += r;
+	}
+	metrics_add(COUNTER_BYTES_READ, size);
+
+	struct slice blob = decodeblob(decompressor, buf, size, dsize);
+	TRACE_END("extractblob");
+	return blob;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libdeflate.h>
+
+// A block of the pbf as recorded in the blocks file
+struct blockData {
+	off_t block;
+	size_t blockSize;
+
+	size_t blockSizeD;
+
+	int32_t granularity;
+	int64_t latOff;
+	int64_t lonOff;
+};
+
+struct slice {
+	void* root;
+	void* data;
+	size_t size;
+};
+#define DEFAULT_DECOMPRESS_BUFFER_SIZE (16*1024*1024)
+
+// Unwrap the blob in buf, taking ownership of buf
+struct slice decodeblob(struct libdeflate_decompressor* decompressor, void *buf, size_t size, size_t dsize);
+// Read the blob at offset in the pbf and unwrap it. Reads with pread, so
+// threads can share the fd.
+struct slice extractblob(int pbf, struct libdeflate_decompressor* decompressor, size_t offset, size_t size, size_t dsize);
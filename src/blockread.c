@@ -0,0 +1,347 @@
+#include "blockread.h"
+
+#include "metrics.h"
+#include "trace.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// There's no liburing here, so the ring is set up by hand
+struct uring {
+	int fd;
+	unsigned entries;
+
+	void *sqRing;
+	size_t sqRingSize;
+	unsigned *sqTail;
+	unsigned *sqMask;
+	unsigned *sqArray;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+
+	void *cqRing;
+	size_t cqRingSize;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned *cqMask;
+	struct io_uring_cqe *cqes;
+};
+
+struct blockReader {
+	int fd;
+	struct blockRead *reads;
+	size_t cnt;
+	// Reads returned to the caller
+	size_t returned;
+
+	bool useUring;
+	struct uring ring;
+	// Reads handed to the ring
+	size_t submitted;
+	// Reads in the submission queue the kernel hasn't taken yet
+	unsigned unsubmitted;
+
+	// The pread pool. Workers take the next read from nextRead, and
+	// queue the index in completed when it's done. They wait for the next
+	// batch in between, until stop is set.
+	pthread_t threads[BLOCKREAD_THREADS];
+	size_t threadCnt;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool stop;
+	size_t nextRead;
+	size_t *completed;
+	size_t completedCap;
+	size_t completedCnt;
+	size_t completedTaken;
+};
+
+static void readFully(int fd, void *buf, size_t size, off_t offset) {
+	size_t done = 0;
+	while(done < size) {
+		ssize_t r = pread(fd, buf + done, size - done, offset + done);
+		if(r <= 0) {
+			printf("Fatal: Could not read block at %ld\n", offset);
+			abort();
+		}
+		done += r;
+	}
+}
+
+static void *allocRead(struct blockRead *read) {
+	read->buf = malloc(read->size);
+	if(read->buf == NULL) abort();
+	metrics_add(COUNTER_BYTES_READ, read->size);
+	return read->buf;
+}
+
+static bool uring_init(struct uring *ring, unsigned entries) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if(ring->fd < 0) return false;
+	ring->entries = params.sq_entries;
+
+	ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP) {
+		if(ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+		ring->cqRingSize = ring->sqRingSize;
+	}
+
+	ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if(ring->sqRing == MAP_FAILED) {
+		close(ring->fd);
+		return false;
+	}
+	if(params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cqRing = ring->sqRing;
+	} else {
+		ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if(ring->cqRing == MAP_FAILED) {
+			munmap(ring->sqRing, ring->sqRingSize);
+			close(ring->fd);
+			return false;
+		}
+	}
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED) {
+		if(ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+		munmap(ring->sqRing, ring->sqRingSize);
+		close(ring->fd);
+		return false;
+	}
+
+	ring->sqTail = ring->sqRing + params.sq_off.tail;
+	ring->sqMask = ring->sqRing + params.sq_off.ring_mask;
+	ring->sqArray = ring->sqRing + params.sq_off.array;
+	ring->cqHead = ring->cqRing + params.cq_off.head;
+	ring->cqTail = ring->cqRing + params.cq_off.tail;
+	ring->cqMask = ring->cqRing + params.cq_off.ring_mask;
+	ring->cqes = ring->cqRing + params.cq_off.cqes;
+	return true;
+}
+
+static void uring_free(struct uring *ring) {
+	munmap(ring->sqes, ring->sqesSize);
+	if(ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+	munmap(ring->sqRing, ring->sqRingSize);
+	close(ring->fd);
+}
+
+static int uring_enter(struct uring *ring, unsigned submit, unsigned wait) {
+	return syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Hand the queued reads to the kernel, and wait for a completion if wait is
+// set. The kernel can take fewer reads than queued, the rest stay in the
+// submission queue and are handed over again on the next call.
+static void uring_push(struct blockReader *reader, unsigned wait) {
+	int res = uring_enter(&reader->ring, reader->unsubmitted, wait);
+	if(res < 0) {
+		// Out of resources for now, the next call tries again
+		if(errno == EAGAIN || errno == EBUSY || errno == EINTR) return;
+		printf("Fatal: Could not submit block reads\n");
+		abort();
+	}
+	reader->unsubmitted -= res;
+}
+
+// Queue reads until the ring is full, and hand them to the kernel
+static void uring_submit(struct blockReader *reader) {
+	unsigned queued = 0;
+	unsigned tail = *reader->ring.sqTail;
+	while(reader->submitted < reader->cnt && reader->submitted - reader->returned < reader->ring.entries) {
+		size_t i = reader->submitted++;
+		struct blockRead *read = &reader->reads[i];
+		unsigned slot = tail & *reader->ring.sqMask;
+		struct io_uring_sqe *sqe = &reader->ring.sqes[slot];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = reader->fd;
+		sqe->addr = (uint64_t)allocRead(read);
+		sqe->len = read->size;
+		sqe->off = read->offset;
+		sqe->user_data = i;
+		reader->ring.sqArray[slot] = slot;
+		tail++;
+		queued++;
+	}
+	if(queued == 0 && reader->unsubmitted == 0) return;
+
+	__atomic_store_n(reader->ring.sqTail, tail, __ATOMIC_RELEASE);
+	reader->unsubmitted += queued;
+	uring_push(reader, 0);
+}
+
+static size_t uring_next(struct blockReader *reader) {
+	uring_submit(reader);
+
+	unsigned head = *reader->ring.cqHead;
+	while(head == __atomic_load_n(reader->ring.cqTail, __ATOMIC_ACQUIRE)) {
+		uring_push(reader, 1);
+	}
+	struct io_uring_cqe *cqe = &reader->ring.cqes[head & *reader->ring.cqMask];
+	size_t i = cqe->user_data;
+	int res = cqe->res;
+	__atomic_store_n(reader->ring.cqHead, head + 1, __ATOMIC_RELEASE);
+
+	struct blockRead *read = &reader->reads[i];
+	if(res < 0) {
+		// Kernels before 5.6 don't know IORING_OP_READ
+		res = 0;
+	}
+	if((size_t)res < read->size) {
+		// Short reads are finished the slow way
+		readFully(reader->fd, read->buf + res, read->size - res, read->offset + res);
+	}
+	return i;
+}
+
+static void *poolWorker(void *arg) {
+	struct blockReader *reader = arg;
+	while(true) {
+		pthread_mutex_lock(&reader->lock);
+		size_t i = reader->nextRead;
+		// Wait for a batch, and don't run further ahead of the caller
+		// than the ring would
+		while(!reader->stop && (i >= reader->cnt || i - reader->completedTaken >= BLOCKREAD_DEPTH)) {
+			pthread_cond_wait(&reader->cond, &reader->lock);
+			i = reader->nextRead;
+		}
+		if(reader->stop) {
+			pthread_mutex_unlock(&reader->lock);
+			return NULL;
+		}
+		reader->nextRead++;
+		pthread_mutex_unlock(&reader->lock);
+
+		TRACE_BEGIN("pread");
+		struct blockRead *read = &reader->reads[i];
+		readFully(reader->fd, allocRead(read), read->size, read->offset);
+		TRACE_END("pread");
+
+		pthread_mutex_lock(&reader->lock);
+		reader->completed[reader->completedCnt++] = i;
+		pthread_cond_broadcast(&reader->cond);
+		pthread_mutex_unlock(&reader->lock);
+	}
+}
+
+static size_t pool_next(struct blockReader *reader) {
+	pthread_mutex_lock(&reader->lock);
+	while(reader->completedTaken == reader->completedCnt) {
+		pthread_cond_wait(&reader->cond, &reader->lock);
+	}
+	size_t i = reader->completed[reader->completedTaken++];
+	// A slot opened up for the workers
+	pthread_cond_broadcast(&reader->cond);
+	pthread_mutex_unlock(&reader->lock);
+	return i;
+}
+
+struct blockReader *blockreader_create(int fd) {
+	struct blockReader *reader = calloc(1, sizeof(struct blockReader));
+	if(reader == NULL) abort();
+	reader->fd = fd;
+
+	const char *noUring = getenv(BLOCKREAD_NO_URING_ENV);
+	if(noUring == NULL || noUring[0] == '\0') {
+		reader->useUring = uring_init(&reader->ring, BLOCKREAD_DEPTH);
+	}
+	if(reader->useUring) {
+		return reader;
+	}
+
+	pthread_mutex_init(&reader->lock, NULL);
+	pthread_cond_init(&reader->cond, NULL);
+	for(size_t t = 0; t < BLOCKREAD_THREADS; t++) {
+		if(pthread_create(&reader->threads[reader->threadCnt], NULL, poolWorker, reader) == 0) {
+			reader->threadCnt++;
+		}
+	}
+	if(reader->threadCnt == 0) {
+		printf("Fatal: Could not start any read threads\n");
+		abort();
+	}
+	return reader;
+}
+
+void blockreader_start(struct blockReader *reader, struct blockRead *reads, size_t cnt) {
+	assert(reader->returned == reader->cnt);
+
+	if(reader->useUring) {
+		reader->reads = reads;
+		reader->cnt = cnt;
+		reader->returned = 0;
+		reader->submitted = 0;
+		uring_submit(reader);
+		return;
+	}
+
+	pthread_mutex_lock(&reader->lock);
+	if(cnt > reader->completedCap) {
+		free(reader->completed);
+		reader->completed = malloc(sizeof(size_t) * cnt);
+		if(reader->completed == NULL) abort();
+		reader->completedCap = cnt;
+	}
+	reader->reads = reads;
+	reader->cnt = cnt;
+	reader->returned = 0;
+	reader->nextRead = 0;
+	reader->completedCnt = 0;
+	reader->completedTaken = 0;
+	pthread_cond_broadcast(&reader->cond);
+	pthread_mutex_unlock(&reader->lock);
+}
+
+size_t blockreader_next(struct blockReader *reader) {
+	if(reader->returned == reader->cnt) return BLOCKREAD_DONE;
+
+	size_t i = reader->useUring ? uring_next(reader) : pool_next(reader);
+	reader->returned++;
+	return i;
+}
+
+bool blockreader_uses_uring(const struct blockReader *reader) {
+	return reader->useUring;
+}
+
+void blockreader_finish(struct blockReader *reader) {
+	size_t i;
+	while((i = blockreader_next(reader)) != BLOCKREAD_DONE) {
+		free(reader->reads[i].buf);
+		reader->reads[i].buf = NULL;
+	}
+}
+
+void blockreader_free(struct blockReader *reader) {
+	blockreader_finish(reader);
+
+	if(reader->useUring) {
+		uring_free(&reader->ring);
+	} else {
+		pthread_mutex_lock(&reader->lock);
+		reader->stop = true;
+		pthread_cond_broadcast(&reader->cond);
+		pthread_mutex_unlock(&reader->lock);
+		for(size_t t = 0; t < reader->threadCnt; t++) {
+			pthread_join(reader->threads[t], NULL);
+		}
+		pthread_mutex_destroy(&reader->lock);
+		pthread_cond_destroy(&reader->cond);
+		free(reader->completed);
+	}
+	free(reader);
+}
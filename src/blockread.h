@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Reads batches of blocks from a file asynchronously. Every read of a batch is
+// queued at once, and the caller gets the blocks back in whatever order they
+// complete. Reads go through io_uring when the kernel lets us, and through a
+// pool of threads doing pread otherwise (or when BLOCKREAD_NO_URING_ENV is
+// set). The ring or the threads are set up once per reader, so a reader
+// should live as long as whatever runs the batches.
+#define BLOCKREAD_NO_URING_ENV "INDEX_NO_URING"
+// Reads in flight at once
+#define BLOCKREAD_DEPTH 64
+#define BLOCKREAD_THREADS 8
+
+struct blockRead {
+	off_t offset;
+	size_t size;
+	// Allocated by the reader, owned by the caller once the read is returned
+	void *buf;
+};
+
+struct blockReader;
+
+struct blockReader *blockreader_create(int fd);
+// Start reading a batch. The previous batch must have been finished.
+void blockreader_start(struct blockReader *reader, struct blockRead *reads, size_t cnt);
+// Wait for the next completed read and return its index into reads, or
+// BLOCKREAD_DONE once every read of the batch has been returned.
+size_t blockreader_next(struct blockReader *reader);
+// Wait for the reads of the batch the caller didn't take, and drop them
+void blockreader_finish(struct blockReader *reader);
+void blockreader_free(struct blockReader *reader);
+// If the reads go through io_uring rather than the thread pool
+bool blockreader_uses_uring(const struct blockReader *reader);
+
+#define BLOCKREAD_DONE ((size_t)-1)
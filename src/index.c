@@ -0,0 +1,728 @@
+#define _GNU_SOURCE
+#include "index.h"
+
+#include "arena.h"
+#include "blob.h"
+#include "blockread.h"
+#include "log.h"
+#include "metrics.h"
+#include "pbf.h"
+#include "ptr.h"
+#include "reorder.h"
+#include "search.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <float.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct mappedFile {
+	void *loc;
+	size_t size;
+};
+
+// The id, ptr and segment files of one kind of entity
+struct entityIndex {
+	struct mappedFile idFile;
+	struct mappedFile ptrFile;
+	struct mappedFile segFile;
+
+	uint64_t *ids;
+	size_t cnt;
+	struct ptrArray ptrs;
+	struct idIndex index;
+};
+
+struct index {
+	struct mappedFile blocksFile;
+	struct blockData *blockData;
+	size_t blockCnt;
+
+	struct entityIndex nodes;
+	struct entityIndex ways;
+	struct entityIndex rels;
+
+	int pbf;
+};
+
+struct queryCtx {
+	const struct index *index;
+	struct libdeflate_decompressor *decompressor;
+	struct blockReader *reader;
+	struct arena scratch;
+};
+
+static int openIndexFile(const char *dir, const char *name, struct mappedFile *file) {
+	char path[PATH_MAX];
+	if(snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+		return -1;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	void *loc = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// The mapping keeps the file open
+	close(fd);
+	if(loc == MAP_FAILED) {
+		return -1;
+	}
+
+	file->loc = loc;
+	file->size = st.st_size;
+	return 0;
+}
+
+static void closeIndexFile(struct mappedFile *file) {
+	if(file->loc != NULL) munmap(file->loc, file->size);
+	file->loc = NULL;
+}
+
+static bool openEntityIndex(const char *dir, const char *kind, struct entityIndex *entity) {
+	char name[32];
+
+	snprintf(name, sizeof(name), "%s.id", kind);
+	if(openIndexFile(dir, name, &entity->idFile) != 0) {
+		LOG_ERROR(LOGCAT_LOOKUP, "Could not open %s/%s\n", dir, name);
+		return false;
+	}
+	entity->ids = entity->idFile.loc;
+	entity->cnt = entity->idFile.size / sizeof(uint64_t);
+	if(entity->cnt * sizeof(uint64_t) != entity->idFile.size) {
+		LOG_ERROR(LOGCAT_LOOKUP, "%s/%s isn't a list of ids\n", dir, name);
+		return false;
+	}
+
+	snprintf(name, sizeof(name), "%s.ptr", kind);
+	if(openIndexFile(dir, name, &entity->ptrFile) != 0) {
+		LOG_ERROR(LOGCAT_LOOKUP, "Could not open %s/%s\n", dir, name);
+		return false;
+	}
+	if(!ptrarray_fromFile(&entity->ptrs, entity->ptrFile.loc, entity->ptrFile.size, entity->cnt)) {
+		LOG_ERROR(LOGCAT_LOOKUP, "%s/%s doesn't match %s.id\n", dir, name, kind);
+		return false;
+	}
+
+	// The segment table is optional, build leaves it out when the ids are
+	// sparse
+	snprintf(name, sizeof(name), "%s.seg", kind);
+	if(openIndexFile(dir, name, &entity->segFile) != 0) {
+		entity->segFile = (struct mappedFile){ 0 };
+	}
+	if(!idindex_init(&entity->index, entity->ids, entity->cnt, entity->segFile.loc, entity->segFile.size)) {
+		LOG_ERROR(LOGCAT_LOOKUP, "%s/%s doesn't match the ids\n", dir, name);
+		return false;
+	}
+
+	return true;
+}
+
+static void closeEntityIndex(struct entityIndex *entity) {
+	closeIndexFile(&entity->idFile);
+	closeIndexFile(&entity->ptrFile);
+	closeIndexFile(&entity->segFile);
+}
+
+struct index *index_open(const char *dir, const char *pbfPath) {
+	struct index *index = calloc(1, sizeof(struct index));
+	if(index == NULL) abort();
+	index->pbf = -1;
+
+	if(openIndexFile(dir, "blocks", &index->blocksFile) != 0) {
+		LOG_ERROR(LOGCAT_LOOKUP, "Could not open %s/blocks\n", dir);
+		index_close(index);
+		return NULL;
+	}
+	index->blockData = index->blocksFile.loc;
+	index->blockCnt = index->blocksFile.size / sizeof(struct blockData);
+	if(index->blockCnt * sizeof(struct blockData) != index->blocksFile.size) {
+		LOG_ERROR(LOGCAT_LOOKUP, "%s/blocks isn't a list of blocks\n", dir);
+		index_close(index);
+		return NULL;
+	}
+
+	if(!openEntityIndex(dir, "node", &index->nodes)
+			|| !openEntityIndex(dir, "way", &index->ways)
+			|| !openEntityIndex(dir, "rel", &index->rels)) {
+		index_close(index);
+		return NULL;
+	}
+	LOG_INFO(LOGCAT_LOOKUP, "Found: %lu nodes %lu ways %lu relations\n", index->nodes.cnt, index->ways.cnt, index->rels.cnt);
+
+	index->pbf = open(pbfPath, O_RDONLY);
+	if(index->pbf == -1) {
+		LOG_ERROR(LOGCAT_LOOKUP, "Could not open %s\n", pbfPath);
+		index_close(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+void index_close(struct index *index) {
+	closeIndexFile(&index->blocksFile);
+	closeEntityIndex(&index->nodes);
+	closeEntityIndex(&index->ways);
+	closeEntityIndex(&index->rels);
+	if(index->pbf != -1) close(index->pbf);
+	free(index);
+}
+
+struct queryCtx *query_ctx_create(const struct index *index) {
+	struct queryCtx *ctx = malloc(sizeof(struct queryCtx));
+	if(ctx == NULL) abort();
+	ctx->index = index;
+	ctx->decompressor = libdeflate_alloc_decompressor();
+	if(ctx->decompressor == NULL) abort();
+	ctx->reader = blockreader_create(index->pbf);
+	arena_init(&ctx->scratch);
+	return ctx;
+}
+
+void query_ctx_free(struct queryCtx *ctx) {
+	metrics_add(COUNTER_SCRATCH_PEAK, ctx->scratch.peak);
+	arena_kill(&ctx->scratch);
+	blockreader_free(ctx->reader);
+	libdeflate_free_decompressor(ctx->decompressor);
+	free(ctx);
+}
+
+struct ptrCmpData {
+	uint64_t *pos;
+	struct ptrArray ptrs;
+};
+
+static int ptrcmp(const uint64_t* ai, const uint64_t* bi, const struct ptrCmpData *userdata) {
+	if(!userdata->ptrs.wide) {
+		// Packed ptrs sort like the numbers they are
+		const uint64_t *packed = userdata->ptrs.data;
+		uint64_t av = packed[userdata->pos[*ai]];
+		uint64_t bv = packed[userdata->pos[*bi]];
+		return av < bv ? -1 : av > bv ? 1 : 0;
+	}
+
+	struct pbfPtr *a = &((struct pbfPtr*)userdata->ptrs.data)[userdata->pos[*ai]];
+	struct pbfPtr *b = &((struct pbfPtr*)userdata->ptrs.data)[userdata->pos[*bi]];
+
+	if(a->blockid < b->blockid) {
+		return -1;
+	} else if(a->blockid > b->blockid) {
+		return 1;
+	}
+
+	if(a->offset < b->offset) {
+		return -1;
+	} else if(a->offset > b->offset) {
+		return 1;
+	}
+
+	if(a->num < b->num) {
+		return -1;
+	} else if(a->num > b->num) {
+		return 1;
+	}
+
+	return 0;
+}
+
+// A run of ptrs, out of a list sorted by ptr, that all point into the same
+// block
+struct blockRun {
+	uint64_t blockid;
+	size_t begin;
+	size_t end;
+};
+
+// Split the ptrs at pos (sorted by ptr) into runs per block, with a read for
+// the block of every run.
+static size_t blockRuns(const struct ptrArray *ptrs, const size_t *pos, size_t cnt, const struct blockData *blockData, struct arena *scratch, struct blockRun **runsPtr, struct blockRead **readsPtr) {
+	struct blockRun *runs = arena_alloc(scratch, sizeof(struct blockRun) * cnt);
+	struct blockRead *reads = arena_alloc(scratch, sizeof(struct blockRead) * cnt);
+
+	size_t runCnt = 0;
+	for(size_t i = 0; i < cnt; i++) {
+		uint64_t blockid = ptrarray_get(ptrs, pos[i]).blockid;
+		if(runCnt > 0 && runs[runCnt-1].blockid == blockid) {
+			// Served from a block we decompress anyway
+			runs[runCnt-1].end = i + 1;
+			metrics_add(COUNTER_CACHE_HITS, 1);
+			continue;
+		}
+		runs[runCnt] = (struct blockRun){
+			.blockid = blockid,
+			.begin = i,
+			.end = i + 1,
+		};
+		reads[runCnt] = (struct blockRead){
+			.offset = blockData[blockid].block,
+			.size = blockData[blockid].blockSize,
+		};
+		runCnt++;
+	}
+
+	*runsPtr = runs;
+	*readsPtr = reads;
+	return runCnt;
+}
+
+// Drop the ids lookupIds didn't find in the entity index, along with their
+// pos. Returns how many are left.
+static size_t dropMissing(uint64_t *ids, size_t *pos, size_t cnt, const struct entityIndex *entity) {
+	size_t kept = 0;
+	for(size_t i = 0; i < cnt; i++) {
+		if(pos[i] < entity->cnt && entity->ids[pos[i]] == ids[i]) {
+			ids[kept] = ids[i];
+			pos[kept] = pos[i];
+			kept++;
+		}
+	}
+	return kept;
+}
+
+static void expandMemids(struct queryCtx *ctx, struct pbfPtr *relPtr, uint64_t **memidsPtr, size_t *memidsCnt) {
+	struct arena *scratch = &ctx->scratch;
+	struct blockData block = ctx->index->blockData[relPtr->blockid];
+	struct slice blob = extractblob(ctx->index->pbf, ctx->decompressor, block.block, block.blockSize, block.blockSizeD);
+	assert(relPtr->offset < blob.size);
+	struct pbfcursor data = {
+		.cursor = blob.data + relPtr->offset,
+		.end = blob.data + blob.size,
+	};
+
+	size_t memberCnt = 0;
+
+	uint64_t data_len = readVarInt(&data);
+	void* data_end = data.cursor + data_len;
+	while(data.cursor < data_end) {
+		uint64_t key = readVarInt(&data);
+		switch(KEY_PART(key)) {
+			case 10: {
+				// types
+				uint64_t data_len = readVarInt(&data);
+				void* data_end = data.cursor + data_len;
+				while(data.cursor < data_end) {
+					readVarInt(&data);
+					memberCnt++;
+				}
+				assert(data.cursor == data_end);
+				break;
+			}
+			default:
+				skip(&data, TYPE_PART(key));
+				break;
+		}
+	}
+	assert(data.cursor == data_end);
+	LOG_DEBUG(LOGCAT_LOOKUP, "Relation contains %lu members\n", memberCnt);
+
+	// Reset the cursor
+	data.cursor = blob.data + relPtr->offset;
+
+	uint8_t *types = arena_alloc(scratch, sizeof(uint8_t) * memberCnt);
+	size_t waysCnt = 0;
+	{
+		size_t typesi = 0;
+
+		uint64_t data_len = readVarInt(&data);
+		void* data_end = data.cursor + data_len;
+		while(data.cursor < data_end) {
+			uint64_t key = readVarInt(&data);
+			switch(KEY_PART(key)) {
+				case 10: {
+					// types
+					uint64_t data_len = readVarInt(&data);
+					void* data_end = data.cursor + data_len;
+					while(data.cursor < data_end) {
+						types[typesi] = readVarInt(&data);
+						// @SPEED Maybe this should be vectorized and a post
+						// proc
+						waysCnt += types[typesi] == 1 ? 1 : 0;
+						typesi++;
+					}
+					break;
+				}
+				default:
+					skip(&data, TYPE_PART(key));
+					break;
+			}
+		}
+	}
+	LOG_DEBUG(LOGCAT_LOOKUP, " of those %lu are ways\n", waysCnt);
+
+	// Reset the cursor
+	data.cursor = blob.data + relPtr->offset;
+
+	uint64_t *memids = arena_alloc(scratch, sizeof(uint64_t) * waysCnt);
+	{
+		size_t writei = 0;
+		size_t memi = 0;
+
+		uint64_t data_len = readVarInt(&data);
+		void* data_end = data.cursor + data_len;
+		while(data.cursor < data_end) {
+			uint64_t key = readVarInt(&data);
+			switch(KEY_PART(key)) {
+				case 9: {
+					// memids
+					uint64_t data_len = readVarInt(&data);
+					void* data_end = data.cursor + data_len;
+					uint64_t last = 0;
+					while(data.cursor < data_end) {
+						int64_t value = readVarZig(&data);
+						last += value;
+						if(types[memi] == 1) { // Way
+							memids[writei++] = last;
+						}
+						memi++;
+					}
+					break;
+				}
+				default:
+					skip(&data, TYPE_PART(key));
+					break;
+			}
+		}
+	}
+
+	*memidsCnt = waysCnt;
+	*memidsPtr = memids;
+
+	free(blob.root);
+}
+
+bool query_relation(struct queryCtx *ctx, uint64_t relid, FILE *out) {
+	const struct index *index = ctx->index;
+	struct arena *scratch = &ctx->scratch;
+	const struct blockData *blockData = index->blockData;
+	uint64_t *nodeIds = index->nodes.ids;
+	struct ptrArray nodePtrs = index->nodes.ptrs;
+	struct ptrArray wayPtrs = index->ways.ptrs;
+
+	metrics_begin(PHASE_RELATION_RESOLVE);
+	size_t item = idindex_find(&index->rels.index, relid);
+	if(item >= index->rels.cnt || index->rels.ids[item] != relid) {
+		metrics_end(PHASE_RELATION_RESOLVE);
+		return false;
+	}
+	LOG_DEBUG(LOGCAT_LOOKUP, "Found: Relation %lu at %lu\n", relid, item);
+
+	uint64_t *members;
+	size_t memberCnt;
+	struct pbfPtr relPtr = ptrarray_get(&index->rels.ptrs, item);
+	expandMemids(ctx, &relPtr, &members, &memberCnt);
+
+	size_t *memberPos = arena_alloc(scratch, sizeof(size_t) * memberCnt);
+	lookupIds(members, memberCnt, &index->ways.index, memberPos);
+	// Extracts cut relations off at the border, some of their ways aren't
+	// in the pbf at all
+	size_t foundCnt = dropMissing(members, memberPos, memberCnt, &index->ways);
+	if(foundCnt != memberCnt) {
+		LOG_DEBUG(LOGCAT_LOOKUP, "%lu member ways aren't in the index\n", memberCnt - foundCnt);
+		memberCnt = foundCnt;
+	}
+	metrics_end(PHASE_RELATION_RESOLVE);
+
+	// Array of pointers to the array of nodeids. One array per member
+	uint64_t **refs = arena_alloc(scratch, sizeof(uint64_t*) * memberCnt);
+	// The number of nodes per member way
+	size_t *refCnt = arena_alloc(scratch, sizeof(size_t) * memberCnt);
+	// Expand the ways to find all the nodes
+	metrics_begin(PHASE_WAY_EXPAND);
+	{
+		// Sort the members by their ptr, so every block is read once. The
+		// blocks are expanded in whatever order the reads complete.
+		uint64_t *wayOrder = arena_alloc(scratch, sizeof(uint64_t) * memberCnt);
+		size_t *wayPos = arena_alloc(scratch, sizeof(size_t) * memberCnt);
+		for(size_t i = 0; i < memberCnt; i++) {
+			wayOrder[i] = i;
+		}
+		qsort_r(wayOrder, memberCnt, sizeof(uint64_t), (__compar_d_fn_t)ptrcmp, &(struct ptrCmpData){
+			.pos = memberPos,
+			.ptrs = wayPtrs,
+		});
+		for(size_t k = 0; k < memberCnt; k++) {
+			wayPos[k] = memberPos[wayOrder[k]];
+		}
+
+		struct blockRun *runs;
+		struct blockRead *reads;
+		size_t runCnt = blockRuns(&wayPtrs, wayPos, memberCnt, blockData, scratch, &runs, &reads);
+		blockreader_start(ctx->reader, reads, runCnt);
+		size_t run;
+		while((run = blockreader_next(ctx->reader)) != BLOCKREAD_DONE) {
+			struct slice blob = decodeblob(ctx->decompressor, reads[run].buf, reads[run].size, blockData[runs[run].blockid].blockSizeD);
+			for(size_t k = runs[run].begin; k < runs[run].end; k++) {
+				size_t i = wayOrder[k];
+				struct pbfPtr wayPtr = ptrarray_get(&wayPtrs, wayPos[k]);
+				assert(wayPtr.offset < blob.size);
+
+				struct pbfcursor data = {
+					.cursor = blob.data + wayPtr.offset,
+					.end = blob.data + blob.size,
+				};
+
+				// Count the number of refs
+				{
+					refCnt[i] = 0;
+
+					uint64_t data_len = readVarInt(&data);
+					void* data_end = data.cursor + data_len;
+					while(data.cursor < data_end) {
+						uint64_t key = readVarInt(&data);
+						switch(KEY_PART(key)) {
+							case 8: {
+								// refs
+								uint64_t data_len = readVarInt(&data);
+								void* data_end = data.cursor + data_len;
+								while(data.cursor < data_end) {
+									readVarInt(&data);
+									refCnt[i]++;
+								}
+								assert(data.cursor == data_end);
+								break;
+							}
+							default:
+								skip(&data, TYPE_PART(key));
+								break;
+						}
+					}
+					assert(data.cursor == data_end);
+					LOG_TRACE(LOGCAT_LOOKUP, "Way contains %lu nodes\n", refCnt[i]);
+				}
+
+				// Reset the cursor
+				data.cursor = blob.data + wayPtr.offset;
+
+				refs[i] = arena_alloc(scratch, sizeof(uint64_t) * refCnt[i]);
+				{
+					size_t memi = 0;
+
+					uint64_t data_len = readVarInt(&data);
+					void* data_end = data.cursor + data_len;
+					uint64_t last = 0;
+					while(data.cursor < data_end) {
+						uint64_t key = readVarInt(&data);
+						switch(KEY_PART(key)) {
+							case 8: {
+								// refs
+								uint64_t data_len = readVarInt(&data);
+								void* data_end = data.cursor + data_len;
+								while(data.cursor < data_end) {
+									int64_t value = readVarZig(&data);
+									last += value;
+									refs[i][memi++] = last;
+								}
+								break;
+							}
+							default:
+								skip(&data, TYPE_PART(key));
+								break;
+						}
+					}
+				}
+			}
+			free(blob.root);
+		}
+		blockreader_finish(ctx->reader);
+	}
+	metrics_end(PHASE_WAY_EXPAND);
+
+	// Find internal node ids
+	metrics_begin(PHASE_NODE_GATHER);
+	size_t totalNodeCnt = 0;
+	for(size_t i = 0; i < memberCnt; i++) {
+		totalNodeCnt += refCnt[i];
+	}
+
+	// Flatten the result into one array
+	size_t *nodePos = arena_alloc(scratch, sizeof(size_t) * totalNodeCnt);
+	size_t *nodePosCursor = nodePos;
+	for(size_t i = 0; i < memberCnt; i++) {
+		LOG_TRACE(LOGCAT_LOOKUP, "way[%lu] %lu\n", i, members[i]);
+		lookupIds(refs[i], refCnt[i], &index->nodes.index, nodePosCursor);
+		size_t foundCnt = dropMissing(refs[i], nodePosCursor, refCnt[i], &index->nodes);
+		if(foundCnt != refCnt[i]) {
+			LOG_DEBUG(LOGCAT_LOOKUP, "%lu nodes of way %lu aren't in the index\n", refCnt[i] - foundCnt, members[i]);
+			totalNodeCnt -= refCnt[i] - foundCnt;
+			refCnt[i] = foundCnt;
+		}
+		nodePosCursor += refCnt[i];
+	}
+
+	uint64_t *toIndex;
+	{
+		LOG_DEBUG(LOGCAT_LOOKUP, "Sorting the selected nodes\n");
+		uint64_t *fromIndex = arena_alloc(scratch, sizeof(uint64_t) * totalNodeCnt);
+		for(size_t i = 0; i < totalNodeCnt; i++) {
+			fromIndex[i] = i;
+		}
+		qsort_r(fromIndex, totalNodeCnt, sizeof(uint64_t), (__compar_d_fn_t)ptrcmp, &(struct ptrCmpData){
+			.pos = nodePos,
+			.ptrs = nodePtrs,
+		});
+
+		{
+			size_t *sortedPos = arena_alloc(scratch, sizeof(size_t) * totalNodeCnt);
+			permuteArrays(fromIndex, totalNodeCnt, &(struct permuteArray){
+				.src = nodePos,
+				.dst = sortedPos,
+				.elemSize = sizeof(size_t),
+			}, 1, 1);
+			nodePos = sortedPos;
+		}
+
+		// Remove duplicates
+		uint64_t *dupes = NULL;
+		size_t skip = 0;
+		if(totalNodeCnt > 0) {
+			// @MEMORY This is waaaay oversized
+			dupes = arena_alloc(scratch, sizeof(uint64_t) * totalNodeCnt);
+			uint64_t last = nodePos[0];
+			for(size_t i = 1; i < totalNodeCnt; i++) {
+				if(nodePos[i] != last) {
+					nodePos[i - skip] = nodePos[i];
+				} else {
+					dupes[skip] = i;
+					skip++;
+				}
+				last = nodePos[i];
+			}
+			LOG_DEBUG(LOGCAT_LOOKUP, "%lu duplicates removed\n", skip);
+		}
+
+		toIndex = arena_alloc(scratch, sizeof(uint64_t) * totalNodeCnt);
+		convertFromIntoTo(fromIndex, toIndex, totalNodeCnt, dupes, skip);
+	}
+
+	// Lookup the node attributes that we need
+	int64_t *lat = arena_alloc(scratch, sizeof(int64_t) * totalNodeCnt);
+	int64_t *lon = arena_alloc(scratch, sizeof(int64_t) * totalNodeCnt);
+	{
+		// The nodes are sorted by their ptr, so every block is read once.
+		// The blocks are gathered from in whatever order the reads
+		// complete.
+		struct blockRun *runs;
+		struct blockRead *reads;
+		size_t runCnt = blockRuns(&nodePtrs, nodePos, totalNodeCnt, blockData, scratch, &runs, &reads);
+		blockreader_start(ctx->reader, reads, runCnt);
+		size_t run;
+		while((run = blockreader_next(ctx->reader)) != BLOCKREAD_DONE) {
+			struct slice blob = decodeblob(ctx->decompressor, reads[run].buf, reads[run].size, blockData[runs[run].blockid].blockSizeD);
+			for(size_t i = runs[run].begin; i < runs[run].end; i++) {
+				struct pbfPtr nodePtr = ptrarray_get(&nodePtrs, nodePos[i]);
+
+				struct pbfcursor data = {
+					.cursor = blob.data + nodePtr.offset,
+					.end = blob.data + blob.size,
+				};
+
+				{
+					uint64_t data_len = readVarInt(&data);
+					void* data_end = data.cursor + data_len;
+					while(data.cursor < data_end) {
+						uint64_t key = readVarInt(&data);
+						switch(KEY_PART(key)) {
+							case 1: {
+								// id
+								uint64_t data_len = readVarInt(&data);
+								void* data_end = data.cursor + data_len;
+								uint64_t last = 0;
+								for(size_t j = 0; j < nodePtr.num; j++) {
+									int64_t value = readVarZig(&data);
+									last += value;
+								}
+								int64_t value = readVarZig(&data);
+								last += value;
+								assert(nodeIds[nodePos[i]] == last);
+								data.cursor = data_end;
+								break;
+							}
+							case 8: {
+								// lat
+								uint64_t data_len = readVarInt(&data);
+								void* data_end = data.cursor + data_len;
+								int64_t last = 0;
+								for(size_t j = 0; j < nodePtr.num; j++) {
+									int64_t value = readVarZig(&data);
+									last += value;
+								}
+								int64_t value = readVarZig(&data);
+								last += value;
+								lat[i] = last;
+								data.cursor = data_end;
+								break;
+							}
+							case 9: {
+								// lon
+								uint64_t data_len = readVarInt(&data);
+								void* data_end = data.cursor + data_len;
+								int64_t last = 0;
+								for(size_t j = 0; j < nodePtr.num; j++) {
+									int64_t value = readVarZig(&data);
+									last += value;
+								}
+								int64_t value = readVarZig(&data);
+								last += value;
+								lon[i] = last;
+								data.cursor = data_end;
+								break;
+							}
+							default:
+								skip(&data, TYPE_PART(key));
+								break;
+						}
+					}
+					assert(data.cursor == data_end);
+				}
+			}
+			free(blob.root);
+		}
+		blockreader_finish(ctx->reader);
+	}
+	metrics_end(PHASE_NODE_GATHER);
+
+	metrics_begin(PHASE_OUTPUT);
+	fprintf(out, "begin nodes\n");
+	for(size_t i = 0; i < totalNodeCnt; i++) {
+		const struct blockData *block = blockData + ptrarray_get(&nodePtrs, nodePos[i]).blockid;
+
+		double latCorrected = .000000001 * (block->latOff + (block->granularity * lat[i]));
+		double lonCorrected = .000000001 * (block->lonOff + (block->granularity * lon[i]));
+		fprintf(out, "node iid %lu\n", i);
+		fprintf(out, "node id %lu\n", nodeIds[nodePos[i]]);
+		fprintf(out, "node pos %.*f %.*f\n", DBL_DIG, latCorrected, DBL_DIG, lonCorrected);
+	}
+
+	fprintf(out, "begin ways\n");
+	{
+		uint64_t id = 0;
+		for(size_t i = 0; i < memberCnt; i++) {
+			fprintf(out, "way\n");
+			for(size_t j = 0; j < refCnt[i]; j++) {
+				fprintf(out, "mem %ld\n", toIndex[id++]);
+			}
+		}
+	}
+
+	fprintf(out, "begin relations\n");
+	fprintf(out, "relation\n");
+	for(size_t i = 0; i < memberCnt; i++) {
+		fprintf(out, "mem %ld\n", i);
+	}
+	fflush(out);
+	metrics_end(PHASE_OUTPUT);
+
+	arena_reset(scratch);
+	return true;
+}
+
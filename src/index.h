@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Queries against an index made by build. The index is opened once and
+// shared, it's only read after index_open. Every thread running queries
+// needs a context of its own, which holds the decompressor and the scratch
+// memory that are reused from one query to the next.
+struct index;
+struct queryCtx;
+
+// Open the index files in dir, made from the pbf at pbfPath. Returns NULL when
+// something is missing or doesn't match, the reason is written to stderr.
+struct index *index_open(const char *dir, const char *pbfPath);
+void index_close(struct index *index);
+
+struct queryCtx *query_ctx_create(const struct index *index);
+// Also adds the most scratch memory the context used to the metrics
+void query_ctx_free(struct queryCtx *ctx);
+
+// Write the nodes and member ways of the relation to out. Returns false if
+// the relation isn't in the index.
+bool query_relation(struct queryCtx *ctx, uint64_t relid, FILE *out);
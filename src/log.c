@@ -0,0 +1,143 @@
+#include "log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_BUFFER_SIZE 8192
+
+static const char *categoryNames[LOGCAT_CNT] = {
+	[LOGCAT_BUILD] = "build",
+	[LOGCAT_LOOKUP] = "lookup",
+	[LOGCAT_SEARCH] = "search",
+	[LOGCAT_RING] = "ring",
+};
+
+uint32_t logCategories = (1u << LOGCAT_CNT) - 1;
+
+// Like the trace buffers, every thread only writes to its own. They are on a
+// global list so whatever is left in them can be written when the process
+// exits.
+struct logBuffer {
+	struct logBuffer *next;
+	size_t len;
+	char data[LOG_BUFFER_SIZE];
+};
+
+static struct logBuffer *buffers;
+static _Thread_local struct logBuffer *localBuffer;
+static bool flushRegistered;
+
+static void writeAll(const char *data, size_t len) {
+	while(len > 0) {
+		ssize_t r = write(STDERR_FILENO, data, len);
+		// There is nowhere left to report to
+		if(r <= 0) return;
+		data += r;
+		len -= r;
+	}
+}
+
+static void flushBuffer(struct logBuffer *buffer) {
+	writeAll(buffer->data, buffer->len);
+	buffer->len = 0;
+}
+
+static void log_flushAll() {
+	struct logBuffer *buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+	while(buffer != NULL) {
+		flushBuffer(buffer);
+		buffer = buffer->next;
+	}
+}
+
+static struct logBuffer *log_buffer() {
+	if(localBuffer != NULL) return localBuffer;
+
+	struct logBuffer *buffer = malloc(sizeof(struct logBuffer));
+	if(buffer == NULL) abort();
+	buffer->len = 0;
+
+	buffer->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&buffers, &buffer->next, buffer, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	// The first thread to log makes sure the buffers are written at exit
+	if(!__atomic_exchange_n(&flushRegistered, true, __ATOMIC_RELAXED)) {
+		atexit(log_flushAll);
+	}
+
+	localBuffer = buffer;
+	return buffer;
+}
+
+void log_init() {
+	const char *spec = getenv(LOG_ENV);
+	if(spec == NULL) return;
+
+	uint32_t mask = 0;
+	while(*spec != '\0') {
+		size_t len = strcspn(spec, ",");
+		if(len == 3 && memcmp(spec, "all", 3) == 0) {
+			mask = (1u << LOGCAT_CNT) - 1;
+		}
+		for(size_t i = 0; i < LOGCAT_CNT; i++) {
+			if(strlen(categoryNames[i]) == len && memcmp(spec, categoryNames[i], len) == 0) {
+				mask |= 1u << i;
+			}
+		}
+		spec += len;
+		if(*spec == ',') spec++;
+	}
+	__atomic_store_n(&logCategories, mask, __ATOMIC_RELAXED);
+}
+
+void log_enable(enum logCategory cat, bool enable) {
+	if(enable) {
+		__atomic_fetch_or(&logCategories, 1u << cat, __ATOMIC_RELAXED);
+	} else {
+		__atomic_fetch_and(&logCategories, ~(1u << cat), __ATOMIC_RELAXED);
+	}
+}
+
+void log_write(int level, enum logCategory cat, const char *format, ...) {
+	struct logBuffer *buffer = log_buffer();
+
+	va_list list;
+	va_start(list, format);
+	size_t room = LOG_BUFFER_SIZE - buffer->len;
+	int len = vsnprintf(buffer->data + buffer->len, room, format, list);
+	va_end(list);
+	if(len < 0) return;
+
+	if((size_t)len >= room) {
+		// Didn't fit, make room and try again
+		flushBuffer(buffer);
+		va_start(list, format);
+		len = vsnprintf(buffer->data, LOG_BUFFER_SIZE, format, list);
+		va_end(list);
+		if(len < 0) return;
+
+		if(len >= LOG_BUFFER_SIZE) {
+			// Longer than the whole buffer, write it out by itself
+			char *line = malloc(len + 1);
+			if(line == NULL) abort();
+			va_start(list, format);
+			vsnprintf(line, len + 1, format, list);
+			va_end(list);
+			writeAll(line, len);
+			free(line);
+			return;
+		}
+	}
+	buffer->len += len;
+
+	if(level <= LOG_LEVEL_INFO) {
+		flushBuffer(buffer);
+	}
+}
+
+void log_flush() {
+	if(localBuffer != NULL) flushBuffer(localBuffer);
+}
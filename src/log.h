@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Diagnostics on stderr. Every message has a level and a category. Levels
+// above LOG_LEVEL are compiled out entirely, the arguments aren't even
+// evaluated. The default keeps info and up, build with LOG_LEVEL=DEBUG or
+// LOG_LEVEL=TRACE (make LOG_LEVEL=TRACE) for the per block and per member
+// output.
+//
+// Categories are switched on at runtime with LOG_ENV, a comma separated list
+// of category names, "all" or "none". Everything is on when it's unset.
+#define LOG_ENV "INDEX_LOG"
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_TRACE 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+enum logCategory {
+	LOGCAT_BUILD,
+	LOGCAT_LOOKUP,
+	LOGCAT_SEARCH,
+	LOGCAT_RING,
+
+	LOGCAT_CNT,
+};
+
+// Read LOG_ENV
+void log_init();
+void log_enable(enum logCategory cat, bool enable);
+
+// Messages are formatted into a buffer per thread and written out in whole
+// lines, so threads never wait on each other. Info and up is written right
+// away, the rest when the buffer fills up, on log_flush or when the process
+// exits.
+void log_write(int level, enum logCategory cat, const char *format, ...) __attribute__((format(printf, 3, 4)));
+void log_flush();
+
+extern uint32_t logCategories;
+
+#define LOG(level, cat, ...) do { \
+	if((level) <= LOG_LEVEL && (__atomic_load_n(&logCategories, __ATOMIC_RELAXED) & (1u << (cat)))) \
+		log_write((level), (cat), __VA_ARGS__); \
+} while(0)
+
+#define LOG_ERROR(cat, ...) LOG(LOG_LEVEL_ERROR, cat, __VA_ARGS__)
+#define LOG_WARN(cat, ...) LOG(LOG_LEVEL_WARN, cat, __VA_ARGS__)
+#define LOG_INFO(cat, ...) LOG(LOG_LEVEL_INFO, cat, __VA_ARGS__)
+#define LOG_DEBUG(cat, ...) LOG(LOG_LEVEL_DEBUG, cat, __VA_ARGS__)
+#define LOG_TRACE(cat, ...) LOG(LOG_LEVEL_TRACE, cat, __VA_ARGS__)
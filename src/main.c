@@ -2,7 +2,6 @@
 #include <arpa/inet.h>
 #include <sys/mman.h>
 #include <assert.h>
-#include <float.h>
 #include <sys/stat.h>
 #include <stdio.h>
 #include <fcntl.h>
@@ -15,25 +14,21 @@
 
 #include <libdeflate.h>
 
-#include "vector.h"
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include "pbf.h"
+#include "search.h"
+#include "tvec.h"
 #include "reorder.h"
-
-void eprintf(const char *format, ...) {
-	va_list list;
-	va_start(list, format);
-	vfprintf(stderr, format, list);
-	va_end(list);
-}
-
-struct pbfPtr {
-	uint64_t blockid;
-	size_t offset;
-	int num;
-};
+#include "ptr.h"
+#include "blob.h"
+#include "index.h"
 
 struct mappedIndex {
 	int fd;
 	void * loc;
+	size_t size;
 };
 
 int mkIndexFile(const char *filename, uint64_t elemSize, uint64_t elemCnt, struct mappedIndex *index) {
@@ -42,129 +37,20 @@ int mkIndexFile(const char *filename, uint64_t elemSize, uint64_t elemCnt, struc
 	index->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, mode);
 	if (index->fd == -1)
 		return -1;
-	ftruncate(index->fd, sze);
-
-	index->loc = mmap(NULL, sze, PROT_READ | PROT_WRITE, MAP_SHARED, index->fd, 0);
-	if(index->loc == MAP_FAILED) {
-		return -1;
-	}
-
-	return 0;
-}
-
-int openIndexFile(const char *filename, size_t *indexSze, void **indexLoc) {
-	int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
-	int file = open(filename, O_RDONLY, mode);
-	if (file == -1)
-		return -1;
-
-	struct stat st;
-	if(fstat(file, &st) != 0) {
-		close(file);
+	if(ftruncate(index->fd, sze) != 0) {
+		close(index->fd);
 		return -1;
 	}
-	*indexSze = st.st_size;
+	index->size = sze;
 
-	*indexLoc = mmap(NULL, *indexSze, PROT_READ, MAP_SHARED, file, 0);
-	if(*indexLoc == MAP_FAILED) {
+	index->loc = mmap(NULL, sze, PROT_READ | PROT_WRITE, MAP_SHARED, index->fd, 0);
+	if(index->loc == MAP_FAILED) {
 		return -1;
 	}
 
 	return 0;
 }
 
-struct pbfcursor {
-	void* cursor;
-#ifndef NDEBUG
-	void* end;
-#endif
-};
-
-uint32_t readInt32(struct pbfcursor *data) {
-	assert(data->cursor + 4 <= data->end);
-
-	int32_t value = 0;
-	value |= *(uint8_t*)(data->cursor+0) >> 24;
-	value |= *(uint8_t*)(data->cursor+1) >> 16;
-	value |= *(uint8_t*)(data->cursor+2) >>  8;
-	value |= *(uint8_t*)(data->cursor+3) >>  0;
-
-	data->cursor += 4;
-	return value;
-}
-
-uint64_t readVarInt(struct pbfcursor* data) {
-	uint64_t value = 0;
-
-	uint8_t byte;
-	uint8_t i = 0;
-	do {
-		assert(data->cursor + 1 <= data->end);
-
-		byte = *(uint8_t*)data->cursor;
-
-		value |= (uint64_t)(byte & 0x7F) << i;
-
-		data->cursor++;
-		i += 7;
-	} while(byte & 0x80);
-
-	return value;
-}
-
-int64_t readVarZig(struct pbfcursor* data) {
-	uint64_t value = readVarInt(data);
-	value = (value >> 1) ^ -(value & 1);
-	return value;
-}
-
-struct sizestr {
-	char* str;
-	uint64_t len;
-};
-
-struct sizestr readString(struct pbfcursor* data) {
-	uint64_t len = readVarInt(data);
-	assert(data->cursor + len <= data->end);
-	char* str = data->cursor;
-	data->cursor += len;
-
-	return (struct sizestr){
-		.str = str,
-		.len = len,
-	};
-}
-
-void skip(struct pbfcursor *data, uint64_t type) {
-	switch(type) {
-		case 0:
-			readVarInt(data); //Discard it
-			break;
-		case 1:
-			assert(data->cursor + 8 <= data->end);
-			data->cursor += 8;
-			break;
-		case 2: {
-			uint64_t len = readVarInt(data);
-			assert(data->cursor + len <= data->end);
-			data->cursor += len;
-			break;
-		}
-		case 3: case 4:
-			abort();
-			break;
-		case 5:
-			assert(data->cursor + 4 <= data->end);
-			data->cursor += 4;
-			break;
-		default:
-			abort();
-	}
-}
-
-#define KEY_PART(x) (x >> 3)
-#define TYPE_PART(x) (x & 3)
-
 enum blockType {
 	BLOCK_HEADER,
 	BLOCK_DATA,
@@ -184,7 +70,9 @@ struct blobEntry {
 	size_t size;
 };
 
-void buildIndex(FILE *pbf, Vector *index) {
+TVEC(blobEntryVec, struct blobEntry, 0)
+
+void buildIndex(FILE *pbf, struct blobEntryVec *index) {
 	while(true) {
 		size_t r;
 		uint32_t headerSize;
@@ -208,6 +96,7 @@ void buildIndex(FILE *pbf, Vector *index) {
 		if(r != headerSize) {
 			abort();
 		}
+		metrics_add(COUNTER_BYTES_READ, 4 + headerSize);
 
 		struct pbfcursor headData = {
 			.cursor = buf,
@@ -233,76 +122,11 @@ void buildIndex(FILE *pbf, Vector *index) {
 		}
 
 		entry.offset = ftell(pbf);
-		vector_putBack(index, &entry);
+		blobEntryVec_push(index, entry);
 		fseek(pbf, entry.size, SEEK_CUR);
 	}
 }
 
-struct slice {
-	void* root;
-	void* data;
-	size_t size;
-};
-#define DEFAULT_DECOMPRESS_BUFFER_SIZE (16*1024*1024)
-
-struct slice extractblob(FILE *pbf, struct libdeflate_decompressor* decompressor, size_t offset, size_t size, size_t dsize) {
-	dsize = dsize == 0 ? DEFAULT_DECOMPRESS_BUFFER_SIZE : dsize;
-	void *buf = malloc(size);
-	if(buf == NULL) {
-		abort();
-	}
-
-	fseek(pbf, offset, SEEK_SET);
-
-	size_t r = fread(buf, 1, size, pbf);
-	if(r != size) {
-		abort();
-	}
-
-	struct pbfcursor data = {
-		.cursor = buf,
-		.end = buf + size,
-	};
-
-	while(data.cursor < buf + size){
-		uint64_t key = readVarInt(&data);
-		switch(KEY_PART(key)) {
-			case 1: {
-				// Raw
-				struct sizestr str = readString(&data);
-				return (struct slice){
-					.root = buf,
-					.data = str.str,
-					.size = str.len,
-				};
-				break;
-			}
-			case 3: {
-				// zlib_data
-				struct sizestr str = readString(&data);
-				void* decompbuf = malloc(dsize);
-				if(decompbuf == NULL) abort();
-				size_t decompsize;
-				int rc = libdeflate_zlib_decompress(decompressor, str.str, str.len, decompbuf, dsize, &decompsize);
-				if(rc == 0) {
-					free(buf);
-					return (struct slice){
-						.root = decompbuf,
-						.data = decompbuf,
-						.size = decompsize,
-					};
-				}
-				break;
-			}
-			default:
-				skip(&data, TYPE_PART(key));
-				break;
-		}
-	}
-
-	abort();
-}
-
 int indexcmp(const uint64_t* a, const uint64_t* b, const uint64_t* userdata) {
 	if (userdata[*a] < userdata[*b]) {
 		return -1;
@@ -313,48 +137,157 @@ int indexcmp(const uint64_t* a, const uint64_t* b, const uint64_t* userdata) {
 	}
 }
 
-struct ptrCmpData {
-	uint64_t *pos;
-	struct pbfPtr *ptrs;
+// A tag the relation filter matches on. A NULL val matches any value for the
+// key.
+struct tagPredicate {
+	const char *key;
+	const char *val;
 };
 
-int ptrcmp(const uint64_t* ai, const uint64_t* bi, const struct ptrCmpData *userdata) {
-	struct pbfPtr *a = &userdata->ptrs[userdata->pos[*ai]];
-	struct pbfPtr *b = &userdata->ptrs[userdata->pos[*bi]];
+struct relFilter {
+	const struct tagPredicate *preds;
+	size_t cnt;
+};
 
-	if(a->blockid < b->blockid) {
-		return -1;
-	} else if(a->blockid > b->blockid) {
-		return 1;
-	}
+// The relations we ever look up
+static const struct tagPredicate defaultPreds[] = {
+	{ "type", "multipolygon" },
+	{ "type", "boundary" },
+};
 
-	if(a->offset < b->offset) {
-		return -1;
-	} else if(a->offset > b->offset) {
-		return 1;
-	}
+enum entityKind {
+	KIND_NODE = 1 << 0,
+	KIND_WAY  = 1 << 1,
+	KIND_REL  = 1 << 2,
+};
 
-	if(a->num < b->num) {
-		return -1;
-	} else if(a->num > b->num) {
-		return 1;
+// Predicate strings resolved to string table indices for the current block.
+// PRED_ANY is used for a NULL val, PRED_ABSENT when the string isn't in the
+// block (so the predicate can't match anything in there).
+#define PRED_ANY -1
+#define PRED_ABSENT -2
+
+static bool strEq(struct sizestr str, const char *cstr) {
+	size_t len = strlen(cstr);
+	return str.len == len && memcmp(str.str, cstr, len) == 0;
+}
+
+static int uint64cmp(const void *a, const void *b) {
+	uint64_t av = *(const uint64_t*)a;
+	uint64_t bv = *(const uint64_t*)b;
+	return av < bv ? -1 : av > bv ? 1 : 0;
+}
+
+// Sort the ids and squash duplicates. Returns the new count
+static size_t sortUnique(uint64_t *ids, size_t cnt) {
+	if(cnt == 0) return 0;
+	qsort(ids, cnt, sizeof(uint64_t), uint64cmp);
+
+	size_t out = 1;
+	for(size_t i = 1; i < cnt; i++) {
+		if(ids[i] != ids[out-1]) {
+			ids[out++] = ids[i];
+		}
 	}
+	return out;
+}
 
-	return 0;
+static bool containsId(const uint64_t *ids, size_t cnt, uint64_t needle) {
+	size_t low = 0;
+	size_t high = cnt;
+	while(low < high) {
+		size_t pivot = low + (high - low) / 2;
+		if(ids[pivot] < needle) {
+			low = pivot + 1;
+		} else {
+			high = pivot;
+		}
+	}
+	return low < cnt && ids[low] == needle;
 }
 
-struct blockData {
-	off_t block;
-	size_t blockSize;
+// Write the segment table for the sorted ids, or remove the file if they are
+// too sparse for one
+static void writeSegments(const char *segFile, const uint64_t *ids, size_t cnt) {
+	metrics_begin(PHASE_SEGMENTS);
+	size_t size = idsegments_size(ids, cnt);
+	if(size == 0) {
+		unlink(segFile);
+		metrics_end(PHASE_SEGMENTS);
+		return;
+	}
 
-	size_t blockSizeD;
+	struct mappedIndex segments;
+	if(mkIndexFile(segFile, size, 1, &segments) != 0) {
+		printf("Fatal: Could not create index file\n");
+		abort();
+	}
+	idsegments_build(ids, cnt, segments.loc);
+	munmap(segments.loc, segments.size);
+	close(segments.fd);
+	LOG_INFO(LOGCAT_BUILD, "%s: %lu bytes for %lu ids\n", segFile, size, cnt);
+	metrics_end(PHASE_SEGMENTS);
+}
 
-	int32_t granularity;
-	int64_t latOff;
-	int64_t lonOff;
-};
+// Sort the ids, and the ptrs along with them. Both are permuted in place in
+// their files, so the build doesn't need room for a second copy of them.
+static void sortIndex(struct mappedIndex *ids, struct mappedIndex *ptrs, const struct ptrArray *ptrArray, const char *segFile, size_t cnt) {
+	if(cnt == 0) {
+		unlink(segFile);
+		// Nothing to sort, and nothing to map
+		metrics_begin(PHASE_TRUNCATE);
+		if(ftruncate(ids->fd, 0) != 0 || ftruncate(ptrs->fd, 0) != 0) {
+			printf("Fatal: Could not truncate the index files\n");
+			abort();
+		}
+		close(ids->fd);
+		close(ptrs->fd);
+		munmap(ids->loc, ids->size);
+		munmap(ptrs->loc, ptrs->size);
+		metrics_end(PHASE_TRUNCATE);
+		return;
+	}
+
+	uint64_t *fromIndex = malloc(cnt * sizeof(uint64_t));
+	if(fromIndex == NULL) abort();
+	for(size_t i = 0; i < cnt; i++) {
+		fromIndex[i] = i;
+	}
+	metrics_begin(PHASE_SORT);
+	qsort_r(fromIndex, cnt, sizeof(uint64_t), (__compar_d_fn_t)indexcmp, ids->loc);
+	metrics_end(PHASE_SORT);
+
+	metrics_begin(PHASE_PERMUTE);
+	struct permuteArray arrays[] = {
+		{ .dst = ids->loc,  .elemSize = sizeof(uint64_t) },
+		{ .dst = ptrs->loc, .elemSize = ptrarray_elemSize(ptrArray) },
+	};
+	permuteArraysInPlace(fromIndex, cnt, arrays, sizeof(arrays)/sizeof(struct permuteArray));
+	metrics_end(PHASE_PERMUTE);
+	free(fromIndex);
+
+	writeSegments(segFile, ids->loc, cnt);
+
+	// The files were made for the most entries there could be
+	metrics_begin(PHASE_TRUNCATE);
+	munmap(ids->loc, ids->size);
+	munmap(ptrs->loc, ptrs->size);
+	if(ftruncate(ids->fd, sizeof(uint64_t) * cnt) != 0
+			|| ftruncate(ptrs->fd, ptrarray_elemSize(ptrArray) * cnt) != 0) {
+		printf("Fatal: Could not truncate the index files\n");
+		abort();
+	}
+	close(ids->fd);
+	close(ptrs->fd);
+	metrics_end(PHASE_TRUNCATE);
+}
 
-void build() {
+// Build the index. With a NULL filter every node, way and relation is
+// indexed in a single pass. With a filter we instead only index the relations
+// matching it, and the ways and nodes they reach. Since the pbf stores nodes
+// before ways before relations that takes a pass per kind, but the later
+// passes only have to decompress the blocks that actually contain that kind.
+void build(const char *pbfPath, const struct relFilter *filter) {
 	uint64_t blocksCnt = 1024 * 1024;
 	struct mappedIndex blockDatas;
 	int err = mkIndexFile("blocks", sizeof(struct blockData), blocksCnt, &blockDatas);
@@ -379,7 +312,8 @@ void build() {
 		printf("Fatal: Could not create index file\n");
 		abort();
 	}
-	struct pbfPtr *nodePtrs = inodePtrs.loc;
+	// Mapped with room for the wide format, in case we have to fall back to it
+	struct ptrArray nodePtrs = { .data = inodePtrs.loc, .wide = false };
 
 	struct mappedIndex iwayIds;
 	err = mkIndexFile("way.id", sizeof(uint64_t), elemCnt, &iwayIds);
@@ -395,7 +329,8 @@ void build() {
 		printf("Fatal: Could not create index file\n");
 		abort();
 	}
-	struct pbfPtr *wayPtrs = iwayPtrs.loc;
+	// Mapped with room for the wide format, in case we have to fall back to it
+	struct ptrArray wayPtrs = { .data = iwayPtrs.loc, .wide = false };
 
 	struct mappedIndex irelIds;
 	err = mkIndexFile("rel.id", sizeof(uint64_t), elemCnt, &irelIds);
@@ -411,27 +346,88 @@ void build() {
 		printf("Fatal: Could not create index file\n");
 		abort();
 	}
-	struct pbfPtr *relPtrs = irelPtrs.loc;
+	// Mapped with room for the wide format, in case we have to fall back to it
+	struct ptrArray relPtrs = { .data = irelPtrs.loc, .wide = false };
 
 	uint64_t entryb = 0;
 	uint64_t entryi = 0;
 	uint64_t entryw = 0;
 	uint64_t entryr = 0;
 
-	FILE *pbf = fopen("denmark-latest.osm.pbf", "rb");
-	Vector index;
-	vector_init(&index, sizeof(struct blobEntry), 8);
+	FILE *pbf = fopen(pbfPath, "rb");
+	if(pbf == NULL) {
+		printf("Fatal: Could not open %s\n", pbfPath);
+		abort();
+	}
+	struct blobEntryVec index;
+	blobEntryVec_init(&index, NULL);
+	metrics_begin(PHASE_BLOB_INDEX);
 	buildIndex(pbf, &index);
+	metrics_end(PHASE_BLOB_INDEX);
 
 	struct libdeflate_decompressor* decompressor;
 	decompressor = libdeflate_alloc_decompressor();
 
-	{
-		size_t id;
-		struct blobEntry *it = vector_getFirst(&index, &id);
-		do {
+	// Which kinds each pass indexes
+	int passKinds[3];
+	size_t passCnt;
+	if(filter == NULL) {
+		passKinds[0] = KIND_NODE | KIND_WAY | KIND_REL;
+		passCnt = 1;
+	} else {
+		passKinds[0] = KIND_REL;
+		passKinds[1] = KIND_WAY;
+		passKinds[2] = KIND_NODE;
+		passCnt = 3;
+	}
+
+	// The kinds contained in each data block, recorded on the first pass so
+	// the following passes can skip the blocks without anything for them.
+	uint8_t *blockKinds = calloc(blocksCnt, sizeof(uint8_t));
+	if(blockKinds == NULL) abort();
+
+	// The ids reached by the matching relations (and their ways)
+	struct u64vec wantWays;
+	struct u64vec wantNodes;
+	u64vec_init(&wantWays, NULL);
+	u64vec_init(&wantNodes, NULL);
+
+	// Scratch for the relation and way fields we need to decide on
+	struct u64vec keys;
+	struct u64vec vals;
+	struct u64vec memids;
+	struct u64vec types;
+	u64vec_init(&keys, NULL);
+	u64vec_init(&vals, NULL);
+	u64vec_init(&memids, NULL);
+	u64vec_init(&types, NULL);
+
+	size_t predCnt = filter == NULL ? 0 : filter->cnt;
+	int64_t *predKey = malloc(sizeof(int64_t) * (predCnt+1));
+	int64_t *predVal = malloc(sizeof(int64_t) * (predCnt+1));
+	if(predKey == NULL || predVal == NULL) abort();
+
+	metrics_begin(PHASE_DECODE);
+	for(size_t pass = 0; pass < passCnt; pass++) {
+		int kinds = passKinds[pass];
+		uint64_t blocki = 0;
+
+		if(filter != NULL && kinds == KIND_WAY) {
+			wantWays.size = sortUnique(u64vec_data(&wantWays), wantWays.size);
+			LOG_INFO(LOGCAT_BUILD, "Filter: %lu relations reach %lu ways\n", entryr, wantWays.size);
+		} else if(filter != NULL && kinds == KIND_NODE) {
+			wantNodes.size = sortUnique(u64vec_data(&wantNodes), wantNodes.size);
+			LOG_INFO(LOGCAT_BUILD, "Filter: %lu ways reach %lu nodes\n", entryw, wantNodes.size);
+		}
+		const uint64_t *wayWant = u64vec_data(&wantWays);
+		const uint64_t *nodeWant = u64vec_data(&wantNodes);
+
+		for(size_t id = 0; id < index.size; id++) {
+			struct blobEntry *it = blobEntryVec_get(&index, id);
 			if(it->type == BLOCK_HEADER) {
-				struct slice blob = extractblob(pbf, decompressor, it->offset, it->size, 0);
+				if(pass != 0) continue;
+
+				struct slice blob = extractblob(fileno(pbf), decompressor, it->offset, it->size, 0);
 				struct pbfcursor data = {
 					.cursor = blob.data,
 					.end = blob.data + blob.size,
@@ -441,7 +437,7 @@ void build() {
 					switch(KEY_PART(key)) {
 						case 4: {
 							struct sizestr str = readString(&data);
-							eprintf("sValue is %.*s\n", (int)str.len, str.str);
+							LOG_DEBUG(LOGCAT_BUILD, "sValue is %.*s\n", (int)str.len, str.str);
 							break;
 						}
 						default:
@@ -451,50 +447,103 @@ void build() {
 				}
 				free(blob.root);
 			} else if(it->type == BLOCK_DATA) {
-				struct slice blob = extractblob(pbf, decompressor, it->offset, it->size, 0);
+				uint64_t blockid = blocki++;
+				if(pass != 0 && (blockKinds[blockid] & kinds) == 0) continue;
+
+				struct slice blob = extractblob(fileno(pbf), decompressor, it->offset, it->size, 0);
 				struct pbfcursor data = {
 					.cursor = blob.data,
 					.end = blob.data + blob.size,
 				};
 
-				if(entryb >= blocksCnt) {
+				if(blockid >= blocksCnt) {
 					printf("Out of block space\n");
 					abort();
 				}
 
-				blockData[entryb].block = it->offset;
-				blockData[entryb].blockSize = it->size;
-				blockData[entryb].blockSizeD = blob.size;
+				if(pass == 0) {
+					blockData[blockid].block = it->offset;
+					blockData[blockid].blockSize = it->size;
+					blockData[blockid].blockSizeD = blob.size;
+
+					blockData[blockid].granularity = 100;
+					blockData[blockid].latOff = 0;
+					blockData[blockid].lonOff = 0;
+				}
 
-				blockData[entryb].granularity = 100;
-				blockData[entryb].latOff = 0;
-				blockData[entryb].lonOff = 0;
+				for(size_t i = 0; i < predCnt; i++) {
+					predKey[i] = PRED_ABSENT;
+					predVal[i] = filter->preds[i].val == NULL ? PRED_ANY : PRED_ABSENT;
+				}
 
 				while(data.cursor < blob.data + blob.size) {
 					uint64_t key = readVarInt(&data);
 					switch(KEY_PART(key)) {
+						case 1: {
+							// stringtable
+							if(predCnt == 0 || (kinds & KIND_REL) == 0) {
+								skip(&data, TYPE_PART(key));
+								break;
+							}
+
+							uint64_t data_len = readVarInt(&data);
+							void* data_end = data.cursor + data_len;
+							int64_t stri = 0;
+							while(data.cursor < data_end) {
+								uint64_t key = readVarInt(&data);
+								switch(KEY_PART(key)) {
+									case 1: {
+										// s
+										struct sizestr str = readString(&data);
+										for(size_t i = 0; i < predCnt; i++) {
+											if(strEq(str, filter->preds[i].key))
+												predKey[i] = stri;
+											if(filter->preds[i].val != NULL && strEq(str, filter->preds[i].val))
+												predVal[i] = stri;
+										}
+										stri++;
+										break;
+									}
+									default:
+										skip(&data, TYPE_PART(key));
+										break;
+								}
+							}
+							assert(data.cursor == data_end);
+							break;
+						}
 						case 17: {
 							// granularity
-							blockData[entryb].granularity = readVarInt(&data);
-							eprintf("delta %d\n", blockData[entryb].granularity);
+							int32_t granularity = readVarInt(&data);
+							if(pass == 0) {
+								blockData[blockid].granularity = granularity;
+								LOG_DEBUG(LOGCAT_BUILD, "delta %d\n", blockData[blockid].granularity);
+							}
 							break;
 						}
 						case 19: {
 							// lat_offset
-							blockData[entryb].latOff = readVarInt(&data);
-							eprintf("latOff %ld\n", blockData[entryb].latOff);
+							int64_t latOff = readVarInt(&data);
+							if(pass == 0) {
+								blockData[blockid].latOff = latOff;
+								LOG_DEBUG(LOGCAT_BUILD, "latOff %ld\n", blockData[blockid].latOff);
+							}
 							break;
 						}
 						case 20: {
 							// lon_offset
-							blockData[entryb].lonOff = readVarInt(&data);
-							eprintf("lonOff %ld\n", blockData[entryb].lonOff);
+							int64_t lonOff = readVarInt(&data);
+							if(pass == 0) {
+								blockData[blockid].lonOff = lonOff;
+								LOG_DEBUG(LOGCAT_BUILD, "lonOff %ld\n", blockData[blockid].lonOff);
+							}
 							break;
 						}
 						case 2: {
 							// primitivegroup
 							uint64_t data_len = readVarInt(&data);
 							void* data_end = data.cursor + data_len;
+							TRACE_BEGIN("primitivegroup");
 							while(data.cursor < data_end) {
 								uint64_t key = readVarInt(&data);
 								switch(KEY_PART(key)) {
@@ -507,6 +556,12 @@ void build() {
 									}
 									case 2: {
 										// dense
+										blockKinds[blockid] |= KIND_NODE;
+										if((kinds & KIND_NODE) == 0) {
+											skip(&data, TYPE_PART(key));
+											break;
+										}
+
 										uint64_t nodeIndex = 0;
 										void* denseStart = data.cursor;
 
@@ -523,14 +578,20 @@ void build() {
 													while(data.cursor < data_end) {
 														int64_t value = readVarZig(&data);
 														last += value;
+														if(filter != NULL && !containsId(nodeWant, wantNodes.size, last)) {
+															nodeIndex++;
+															continue;
+														}
 														if(entryi >= elemCnt) {
 															printf("Out of index space\n");
 															abort();
 														}
 														nodeIds[entryi] = last;
-														nodePtrs[entryi].blockid = entryb;
-														nodePtrs[entryi].offset = denseStart - blob.data;
-														nodePtrs[entryi].num = nodeIndex;
+														ptrarray_set(&nodePtrs, entryi, entryi, (struct pbfPtr){
+															.blockid = blockid,
+															.offset = denseStart - blob.data,
+															.num = nodeIndex,
+														});
 														nodeIndex++;
 														entryi++;
 													}
@@ -546,14 +607,23 @@ void build() {
 									}
 									case 3: {
 										// ways
+										blockKinds[blockid] |= KIND_WAY;
+										if((kinds & KIND_WAY) == 0) {
+											skip(&data, TYPE_PART(key));
+											break;
+										}
 
 										if(entryw >= elemCnt) {
 											printf("Out of index space\n");
 											abort();
 										}
-										wayPtrs[entryw].blockid = entryb;
-										wayPtrs[entryw].offset = data.cursor - blob.data;
-										wayPtrs[entryw].num = 0;
+										ptrarray_set(&wayPtrs, entryw, entryw, (struct pbfPtr){
+											.blockid = blockid,
+											.offset = data.cursor - blob.data,
+											.num = 0,
+										});
+
+										u64vec_clear(&memids);
 
 										uint64_t data_len = readVarInt(&data);
 										void* data_end = data.cursor + data_len;
@@ -565,25 +635,59 @@ void build() {
 													wayIds[entryw] = readVarInt(&data);
 													break;
 												}
+												case 8: {
+													// refs
+													if(filter == NULL) {
+														skip(&data, TYPE_PART(key));
+														break;
+													}
+													uint64_t data_len = readVarInt(&data);
+													void* data_end = data.cursor + data_len;
+													uint64_t last = 0;
+													while(data.cursor < data_end) {
+														int64_t value = readVarZig(&data);
+														last += value;
+														u64vec_push(&memids, last);
+													}
+													break;
+												}
 												default:
 													skip(&data, TYPE_PART(key));
 													break;
 											}
 										}
 										assert(data.cursor == data_end);
+
+										if(filter != NULL) {
+											if(!containsId(wayWant, wantWays.size, wayIds[entryw]))
+												break;
+											u64vec_pushList(&wantNodes, u64vec_data(&memids), memids.size);
+										}
 										entryw++;
 										break;
 									}
 									case 4: {
 										// relations
+										blockKinds[blockid] |= KIND_REL;
+										if((kinds & KIND_REL) == 0) {
+											skip(&data, TYPE_PART(key));
+											break;
+										}
 
 										if(entryr >= elemCnt) {
 											printf("Out of index space\n");
 											abort();
 										}
-										relPtrs[entryr].blockid = entryb;
-										relPtrs[entryr].offset = data.cursor - blob.data;
-										relPtrs[entryr].num = 0;
+										ptrarray_set(&relPtrs, entryr, entryr, (struct pbfPtr){
+											.blockid = blockid,
+											.offset = data.cursor - blob.data,
+											.num = 0,
+										});
+
+										u64vec_clear(&keys);
+										u64vec_clear(&vals);
+										u64vec_clear(&memids);
+										u64vec_clear(&types);
 
 										uint64_t data_len = readVarInt(&data);
 										void* data_end = data.cursor + data_len;
@@ -595,12 +699,72 @@ void build() {
 													relIds[entryr] = readVarInt(&data);
 													break;
 												}
+												case 2: case 3: case 10: {
+													// keys, vals and types
+													if(filter == NULL) {
+														skip(&data, TYPE_PART(key));
+														break;
+													}
+													struct u64vec *dest = KEY_PART(key) == 2 ? &keys : KEY_PART(key) == 3 ? &vals : &types;
+													uint64_t data_len = readVarInt(&data);
+													void* data_end = data.cursor + data_len;
+													while(data.cursor < data_end) {
+														uint64_t value = readVarInt(&data);
+														u64vec_push(dest, value);
+													}
+													break;
+												}
+												case 9: {
+													// memids
+													if(filter == NULL) {
+														skip(&data, TYPE_PART(key));
+														break;
+													}
+													uint64_t data_len = readVarInt(&data);
+													void* data_end = data.cursor + data_len;
+													uint64_t last = 0;
+													while(data.cursor < data_end) {
+														int64_t value = readVarZig(&data);
+														last += value;
+														u64vec_push(&memids, last);
+													}
+													break;
+												}
 												default:
 													skip(&data, TYPE_PART(key));
 													break;
 											}
 										}
 										assert(data.cursor == data_end);
+
+										if(filter != NULL) {
+											assert(keys.size == vals.size);
+											assert(memids.size == types.size);
+											const uint64_t *k = u64vec_data(&keys);
+											const uint64_t *v = u64vec_data(&vals);
+
+											bool match = false;
+											for(size_t i = 0; i < keys.size && !match; i++) {
+												for(size_t j = 0; j < predCnt; j++) {
+													if(predKey[j] == (int64_t)k[i] && (predVal[j] == PRED_ANY || predVal[j] == (int64_t)v[i])) {
+														match = true;
+														break;
+													}
+												}
+											}
+											if(!match)
+												break;
+
+											const uint64_t *mem = u64vec_data(&memids);
+											const uint64_t *type = u64vec_data(&types);
+											for(size_t i = 0; i < memids.size; i++) {
+												if(type[i] == 0) { // Node
+													u64vec_push(&wantNodes, mem[i]);
+												} else if(type[i] == 1) { // Way
+													u64vec_push(&wantWays, mem[i]);
+												}
+											}
+										}
 										entryr++;
 										break;
 									}
@@ -610,6 +774,7 @@ void build() {
 								}
 							}
 							assert(data.cursor == data_end);
+							TRACE_END("primitivegroup");
 							break;
 						}
 						default:
@@ -618,607 +783,126 @@ void build() {
 					}
 				}
 				free(blob.root);
-				entryb++;
-			}
-
-		}while((it = vector_getNext(&index, &id)) != NULL);
-
-	}
-
-	vector_kill(&index);
-	eprintf("Found: %lu blocks %lu nodes %lu ways %lu relations\n", entryb, entryi, entryw, entryr);
-
-	ftruncate(blockDatas.fd, sizeof(struct blockData) * entryb);
-	close(blockDatas.fd);
-
-	eprintf("Sorting nodes\n");
-	{
-		uint64_t *fromIndex = malloc(entryi * sizeof(uint64_t));
-		for(size_t i = 0; i < entryi; i++) {
-			fromIndex[i] = i;
-		}
-		qsort_r(fromIndex, entryi, sizeof(uint64_t), (__compar_d_fn_t)indexcmp, nodeIds);
-		{
-			union {
-				uint64_t s1;
-				struct pbfPtr s2;
-			} scratch;
-			permuteFrom(fromIndex, nodeIds,  sizeof(uint64_t),      entryi, &scratch);
-			permuteFrom(fromIndex, nodePtrs, sizeof(struct pbfPtr), entryi, &scratch);
-		}
-		free(fromIndex);
-	}
-
-	ftruncate(inodeIds.fd, sizeof(uint64_t) * entryi);
-	ftruncate(inodePtrs.fd, sizeof(struct pbfPtr) * entryi);
-	close(inodeIds.fd);
-	close(inodePtrs.fd);
-
-	eprintf("Sorting ways\n");
-	{
-		uint64_t *fromIndex = malloc(entryw * sizeof(uint64_t));
-		for(size_t i = 0; i < entryw; i++) {
-			fromIndex[i] = i;
-		}
-		qsort_r(fromIndex, entryw, sizeof(uint64_t), (__compar_d_fn_t)indexcmp, wayIds);
-		{
-			union {
-				uint64_t s1;
-				struct pbfPtr s2;
-			} scratch;
-			permuteFrom(fromIndex, wayIds,  sizeof(uint64_t),      entryw, &scratch);
-			permuteFrom(fromIndex, wayPtrs, sizeof(struct pbfPtr), entryw, &scratch);
-		}
-		free(fromIndex);
-	}
-
-	ftruncate(iwayIds.fd, sizeof(uint64_t) * entryw);
-	ftruncate(iwayPtrs.fd, sizeof(struct pbfPtr) * entryw);
-	close(iwayIds.fd);
-	close(iwayPtrs.fd);
-
-	eprintf("Sorting relations\n");
-	{
-		uint64_t *fromIndex = malloc(entryr * sizeof(uint64_t));
-		for(size_t i = 0; i < entryr; i++) {
-			fromIndex[i] = i;
-		}
-		qsort_r(fromIndex, entryr, sizeof(uint64_t), (__compar_d_fn_t)indexcmp, relIds);
-		{
-			union {
-				uint64_t s1;
-				struct pbfPtr s2;
-			} scratch;
-			permuteFrom(fromIndex, relIds,  sizeof(uint64_t),      entryr, &scratch);
-			permuteFrom(fromIndex, relPtrs, sizeof(struct pbfPtr), entryr, &scratch);
-		}
-		free(fromIndex);
-	}
-
-	ftruncate(irelIds.fd, sizeof(uint64_t) * entryr);
-	ftruncate(irelPtrs.fd, sizeof(struct pbfPtr) * entryr);
-	close(irelIds.fd);
-	close(irelPtrs.fd);
-}
-
-size_t binSearch(uint64_t *data, size_t elemSize, size_t elemCnt, uint64_t needle) {
-	assert(elemSize == sizeof(uint64_t));
-
-	size_t low = 0;
-	size_t high = elemCnt - 1;
-
-	while(low <= high) {
-		size_t pivot = (high + low) / 2;
-		uint64_t elem = data[pivot];
-		if(elem == needle) {
-			return pivot;
-		} else if(elem > needle) {
-			high = pivot - 1;
-		} else {
-			low = pivot + 1;
-		}
-	}
-
-	eprintf("BAIL on %lu signed %ld\n", needle, (uint64_t)needle);
-	return high + 1;
-}
-
-void expandMemids(struct pbfPtr *relPtr, FILE *pbf, uint64_t **memidsPtr, size_t *memidsCnt, struct blockData *blockData) {
-	struct libdeflate_decompressor* decompressor;
-	decompressor = libdeflate_alloc_decompressor();
-
-	struct blockData block = blockData[relPtr->blockid];
-	struct slice blob = extractblob(pbf, decompressor, block.block, block.blockSize, block.blockSizeD);
-	assert(relPtr->offset < blob.size);
-	struct pbfcursor data = {
-		.cursor = blob.data + relPtr->offset,
-		.end = blob.data + blob.size,
-	};
-
-	size_t memberCnt = 0;
-
-	uint64_t data_len = readVarInt(&data);
-	void* data_end = data.cursor + data_len;
-	while(data.cursor < data_end) {
-		uint64_t key = readVarInt(&data);
-		switch(KEY_PART(key)) {
-			case 10: {
-				// types
-				uint64_t data_len = readVarInt(&data);
-				void* data_end = data.cursor + data_len;
-				while(data.cursor < data_end) {
-					readVarInt(&data);
-					memberCnt++;
-				}
-				assert(data.cursor == data_end);
-				break;
 			}
-			default:
-				skip(&data, TYPE_PART(key));
-				break;
-		}
-	}
-	assert(data.cursor == data_end);
-	eprintf("Relation contains %lu members\n", memberCnt);
-
-	// Reset the cursor
-	data.cursor = blob.data + relPtr->offset;
-
-	uint8_t *types = malloc(sizeof(bool) * memberCnt);
-	size_t waysCnt = 0;
-	{
-		size_t typesi = 0;
 
-		uint64_t data_len = readVarInt(&data);
-		void* data_end = data.cursor + data_len;
-		while(data.cursor < data_end) {
-			uint64_t key = readVarInt(&data);
-			switch(KEY_PART(key)) {
-				case 10: {
-					// types
-					uint64_t data_len = readVarInt(&data);
-					void* data_end = data.cursor + data_len;
-					while(data.cursor < data_end) {
-						types[typesi] = readVarInt(&data);
-						// @SPEED Maybe this should be vectorized and a post
-						// proc
-						waysCnt += types[typesi] == 1 ? 1 : 0;
-						typesi++;
-					}
-					break;
-				}
-				default:
-					skip(&data, TYPE_PART(key));
-					break;
-			}
 		}
-	}
-	eprintf(" of those %lu are ways\n", waysCnt);
 
-	// Reset the cursor
-	data.cursor = blob.data + relPtr->offset;
-
-	uint64_t *memids = malloc(sizeof(uint64_t) * waysCnt);
-	{
-		size_t writei = 0;
-		size_t memi = 0;
-
-		uint64_t data_len = readVarInt(&data);
-		void* data_end = data.cursor + data_len;
-		while(data.cursor < data_end) {
-			uint64_t key = readVarInt(&data);
-			switch(KEY_PART(key)) {
-				case 1: {
-					// id
-					uint64_t id = readVarInt(&data);
-					/* printf("Relation %lu\n", id); */
-					break;
-				}
-				case 9: {
-					// memids
-					uint64_t data_len = readVarInt(&data);
-					void* data_end = data.cursor + data_len;
-					uint64_t last = 0;
-					while(data.cursor < data_end) {
-						int64_t value = readVarZig(&data);
-						last += value;
-						if(types[memi] == 1) { // Way
-							memids[writei++] = last;
-						}
-						memi++;
-					}
-					break;
-				}
-				default:
-					skip(&data, TYPE_PART(key));
-					break;
-			}
+		if(pass == 0) {
+			entryb = blocki;
 		}
 	}
 
-	*memidsCnt = waysCnt;
-	*memidsPtr = memids;
+	metrics_end(PHASE_DECODE);
 
-	free(types);
-	free(blob.data);
+	free(predKey);
+	free(predVal);
+	u64vec_kill(&keys);
+	u64vec_kill(&vals);
+	u64vec_kill(&memids);
+	u64vec_kill(&types);
+	u64vec_kill(&wantWays);
+	u64vec_kill(&wantNodes);
+	free(blockKinds);
 	libdeflate_free_decompressor(decompressor);
-}
-
-/* void expandRefs(struct pbfPtr *ways, size_t wayCnt, FILE *pbf, uint64_t *(*refs)[], size_t (*refCnt)[]) { */
-/* } */
-
-void lookupIds(uint64_t *needles, size_t needleCnt, uint64_t *wayIds, size_t wayCnt, size_t *pos) {
-	// @SPEED It seems like it should be possible to do this faster if you somehow
-	// compare all the id's at the same time.
-	for (size_t i = 0; i < needleCnt; i++) {
-		pos[i] = binSearch(wayIds, sizeof(uint64_t), wayCnt, needles[i]);
-	}
-}
-
-void lookup() {
-	size_t indexSze;
-	int err;
-
-	struct blockData *blockData;
-	err = openIndexFile("blocks", &indexSze, (void**)&blockData);
-	if(err != 0) {
-		printf("Fatal: Could not open block file\n");
-		abort();
-	}
-	uint32_t blockCnt = indexSze/sizeof(struct blockData);
-	assert(blockCnt * sizeof(struct blockData) == indexSze);
+	fclose(pbf);
 
-	uint64_t *nodeIds;
-	err = openIndexFile("node.id", &indexSze, (void**)&nodeIds);
-	if(err != 0) {
-		printf("Fatal: Could not open index file\n");
-		abort();
-	}
-	uint32_t nodeCnt = indexSze/sizeof(uint64_t);
-	assert(nodeCnt * sizeof(uint64_t) == indexSze);
+	blobEntryVec_kill(&index);
+	LOG_INFO(LOGCAT_BUILD, "Found: %lu blocks %lu nodes %lu ways %lu relations\n", entryb, entryi, entryw, entryr);
 
-	struct pbfPtr *nodePtrs;
-	err = openIndexFile("node.ptr", &indexSze, (void**)&nodePtrs);
-	if(err != 0) {
-		printf("Fatal: Could not open index file\n");
+	metrics_begin(PHASE_TRUNCATE);
+	if(ftruncate(blockDatas.fd, sizeof(struct blockData) * entryb) != 0) {
+		printf("Fatal: Could not truncate the blocks file\n");
 		abort();
 	}
-	assert(nodeCnt * sizeof(struct pbfPtr) == indexSze);
+	close(blockDatas.fd);
+	metrics_end(PHASE_TRUNCATE);
 
-	uint64_t *wayIds;
-	err = openIndexFile("way.id", &indexSze, (void**)&wayIds);
-	if(err != 0) {
-		printf("Fatal: Could not open index file\n");
-		abort();
-	}
-	uint32_t wayCnt = indexSze/sizeof(uint64_t);
-	assert(wayCnt * sizeof(uint64_t) == indexSze);
+	LOG_INFO(LOGCAT_BUILD, "Sorting nodes\n");
+	sortIndex(&inodeIds, &inodePtrs, &nodePtrs, "node.seg", entryi);
 
-	struct pbfPtr *wayPtrs;
-	err = openIndexFile("way.ptr", &indexSze, (void**)&wayPtrs);
-	if(err != 0) {
-		printf("Fatal: Could not open index file\n");
-		abort();
-	}
-	assert(wayCnt * sizeof(struct pbfPtr) == indexSze);
-
-	uint64_t *relIds;
-	err = openIndexFile("rel.id", &indexSze, (void**)&relIds);
-	if(err != 0) {
-		printf("Fatal: Could not open index file\n");
-		abort();
-	}
-	uint32_t relCnt = indexSze/sizeof(uint64_t);
-	assert(relCnt * sizeof(uint64_t) == indexSze);
+	LOG_INFO(LOGCAT_BUILD, "Sorting ways\n");
+	sortIndex(&iwayIds, &iwayPtrs, &wayPtrs, "way.seg", entryw);
 
-	struct pbfPtr *relPtrs;
-	err = openIndexFile("rel.ptr", &indexSze, (void**)&relPtrs);
-	if(err != 0) {
-		printf("Fatal: Could not open index file\n");
-		abort();
-	}
-	assert(relCnt * sizeof(struct pbfPtr) == indexSze);
-
-	eprintf("Found: %u nodes %u ways %u relations\n", nodeCnt, wayCnt, relCnt);
-
-	uint64_t relid = 8312746;
-	size_t item = binSearch(relIds, sizeof(uint64_t), relCnt, relid);
-	eprintf("Found: Relation %lu at %lu, val %lu\n", relid, item, relIds[item]);
-
-	FILE *pbf = fopen("denmark-latest.osm.pbf", "rb");
-	uint64_t *members;
-	size_t memberCnt;
-	expandMemids(&relPtrs[item], pbf, &members, &memberCnt, blockData);
-
-	size_t *memberPos = malloc(sizeof(size_t) * memberCnt);
-	lookupIds(members, memberCnt, wayIds, wayCnt, memberPos);
-	eprintf("member[%lu] = %lu\n", memberPos[398], wayIds[memberPos[398]]);
-
-	// Array of pointers to the array of nodeids. One array per member
-	uint64_t **refs = malloc(sizeof(uint64_t) * memberCnt);
-	// The number of nodes per member way
-	size_t *refCnt = malloc(sizeof(size_t) * memberCnt);
-	// Expand the ways to find all the nodes
-	{
-
-		struct libdeflate_decompressor* decompressor;
-		decompressor = libdeflate_alloc_decompressor();
-
-		// @SPEED For now we just expand each member in whatever order
-		// they happen to appear in. To increase efficiency, we could
-		// sort them based on the ptr block first (to maybe get some
-		// more use out of our decompression)
-		for(size_t i = 0; i < memberCnt; i++) {
-			struct pbfPtr wayPtr = wayPtrs[memberPos[i]];
-			struct blockData block = blockData[wayPtr.blockid];
-			struct slice blob = extractblob(pbf, decompressor, block.block, block.blockSize, block.blockSizeD);
-			assert(wayPtr.offset < blob.size);
-
-			struct pbfcursor data = {
-				.cursor = blob.data + wayPtr.offset,
-				.end = blob.data + blob.size,
-			};
-
-			// Count the number of refs
-			{
-				refCnt[i] = 0;
-
-				uint64_t data_len = readVarInt(&data);
-				void* data_end = data.cursor + data_len;
-				while(data.cursor < data_end) {
-					uint64_t key = readVarInt(&data);
-					switch(KEY_PART(key)) {
-						case 8: {
-							// refs
-							uint64_t data_len = readVarInt(&data);
-							void* data_end = data.cursor + data_len;
-							while(data.cursor < data_end) {
-								readVarInt(&data);
-								refCnt[i]++;
-							}
-							assert(data.cursor == data_end);
-							break;
-						}
-						default:
-							skip(&data, TYPE_PART(key));
-							break;
-					}
-				}
-				assert(data.cursor == data_end);
-				eprintf("Way contains %lu nodes\n", refCnt[i]);
-			}
-
-			// Reset the cursor
-			data.cursor = blob.data + wayPtr.offset;
-
-			refs[i] = malloc(sizeof(uint64_t) * refCnt[i]);
-			{
-				size_t memi = 0;
+	LOG_INFO(LOGCAT_BUILD, "Sorting relations\n");
+	sortIndex(&irelIds, &irelPtrs, &relPtrs, "rel.seg", entryr);
+}
 
-				uint64_t data_len = readVarInt(&data);
-				void* data_end = data.cursor + data_len;
-				uint64_t last = 0;
-				while(data.cursor < data_end) {
-					uint64_t key = readVarInt(&data);
-					switch(KEY_PART(key)) {
-						case 8: {
-							// refs
-							uint64_t data_len = readVarInt(&data);
-							void* data_end = data.cursor + data_len;
-							while(data.cursor < data_end) {
-								int64_t value = readVarZig(&data);
-								last += value;
-								refs[i][memi++] = last;
-							}
-							break;
-						}
-						default:
-							skip(&data, TYPE_PART(key));
-							break;
-					}
-				}
-			}
+int main(int argc, char** argv) {
+	const char *pbfPath = "denmark-latest.osm.pbf";
+
+	// Options go before the command
+	int argi = 1;
+	while(argi < argc && argv[argi][0] == '-') {
+		if(strcmp(argv[argi], "-i") == 0 && argi + 1 < argc) {
+			pbfPath = argv[argi+1];
+			argi += 2;
+		} else {
+			printf("Unknown option %s\n", argv[argi]);
+			exit(1);
 		}
-
-		libdeflate_free_decompressor(decompressor);
-
 	}
-	free(memberPos);
 
-	// Find internal node ids
-	size_t totalNodeCnt = 0;
-	for(size_t i = 0; i < memberCnt; i++) {
-		totalNodeCnt += refCnt[i];
+	if(argc - argi < 1) {
+		printf("Wrong number of arguments\n");
+		exit(1);
 	}
+	char *command = argv[argi];
+	argc -= argi;
+	argv += argi;
 
-	// Flatten the result into one array
-	size_t *nodePos = malloc(sizeof(size_t) * totalNodeCnt);
-	size_t *nodePosCursor = nodePos;
-	for(size_t i = 0; i < memberCnt; i++) {
-		size_t cnt = refCnt[i];
-		eprintf("way[%lu] %lu\n", i, members[i]);
-		lookupIds(refs[i], refCnt[i], nodeIds, nodeCnt, nodePosCursor);
-		nodePosCursor += refCnt[i];
-	}
+	metrics_init(command);
+	log_init();
+	TRACE_INIT();
 
-	uint64_t *toIndex;
-	{
-		eprintf("Sorting the selected nodes\n");
-		uint64_t *fromIndex = malloc(sizeof(uint64_t) * totalNodeCnt);
-		for(size_t i = 0; i < totalNodeCnt; i++) {
-			fromIndex[i] = i;
-		}
-		qsort_r(fromIndex, totalNodeCnt, sizeof(uint64_t), ptrcmp, &(struct ptrCmpData){
-			.pos = nodePos,
-			.ptrs = nodePtrs,
-		});
-
-		{
-			uint64_t s1;
-			permuteFrom(fromIndex, nodePos, sizeof(uint64_t), totalNodeCnt, &s1);
+	if(strcmp(command, "build") == 0) {
+		if(argc != 1) {
+			printf("Wrong number of arguments\n");
+			exit(1);
 		}
-
-		// Remove duplicates
-		uint64_t *dupes = NULL;
-		size_t skip = 0;
-		if(totalNodeCnt > 0) {
-			// @MEMORY This is waaaay oversized
-			dupes = malloc(sizeof(uint64_t) * totalNodeCnt);
-			uint64_t last = nodePos[0];
-			for(size_t i = 1; i < totalNodeCnt; i++) {
-				if(nodePos[i] != last) {
-					nodePos[i - skip] = nodePos[i];
-				} else {
-					dupes[skip] = i;
-					skip++;
-				}
-				/* eprintf("Compare %lu (block %lu offset %lu) and %lu (block %lu offset %lu)\n", last, nodePtrs[last].blockid, nodePtrs[last].offset, nodePos[i], nodePtrs[nodePos[i]].blockid, nodePtrs[nodePos[i]].offset); */
-				last = nodePos[i];
+		build(pbfPath, NULL);
+	} else if(strcmp(command, "build-filtered") == 0) {
+		// Predicates are given as key=value, or just key to match any value
+		struct relFilter filter;
+		struct tagPredicate *preds = NULL;
+		if(argc == 1) {
+			filter.preds = defaultPreds;
+			filter.cnt = sizeof(defaultPreds)/sizeof(struct tagPredicate);
+		} else {
+			preds = malloc(sizeof(struct tagPredicate) * (argc - 1));
+			if(preds == NULL) abort();
+			for(int i = 1; i < argc; i++) {
+				char *sep = strchr(argv[i], '=');
+				if(sep != NULL) *sep = '\0';
+				preds[i-1] = (struct tagPredicate){
+					.key = argv[i],
+					.val = sep != NULL ? sep + 1 : NULL,
+				};
 			}
-			eprintf("%d duplicates removed\n", skip);
+			filter.preds = preds;
+			filter.cnt = argc - 1;
 		}
-
-		toIndex = malloc(sizeof(uint64_t) * totalNodeCnt);
-		convertFromIntoTo(fromIndex, toIndex, totalNodeCnt, dupes, skip);
-		free(fromIndex);
-		if(dupes != NULL) free(dupes);
-	}
-
-	// Lookup the node attributes that we need
-	int64_t *lat = malloc(sizeof(int64_t) * totalNodeCnt);
-	int64_t *lon = malloc(sizeof(int64_t) * totalNodeCnt);
-	{
-
-		struct libdeflate_decompressor* decompressor;
-		decompressor = libdeflate_alloc_decompressor();
-
-		// @SPEED For now we just expand each item in whatever order they
-		// happen to appear in. To increase efficiency, we could sort them
-		// based on the ptr block first (to maybe get some more use out of our
-		// decompression)
-		for(size_t i = 0; i < totalNodeCnt; i++) {
-			struct pbfPtr nodePtr = nodePtrs[nodePos[i]];
-			struct blockData block = blockData[nodePtr.blockid];
-			struct slice blob = extractblob(pbf, decompressor, block.block, block.blockSize, block.blockSizeD);
-
-			struct pbfcursor data = {
-				.cursor = blob.data + nodePtr.offset,
-				.end = blob.data + blob.size,
-			};
-
-			{
-				uint64_t data_len = readVarInt(&data);
-				void* data_end = data.cursor + data_len;
-				while(data.cursor < data_end) {
-					uint64_t key = readVarInt(&data);
-					switch(KEY_PART(key)) {
-						case 1: {
-							// id
-							uint64_t data_len = readVarInt(&data);
-							void* data_end = data.cursor + data_len;
-							uint64_t last = 0;
-							for(size_t j = 0; j < nodePtr.num; j++) {
-								int64_t value = readVarZig(&data);
-								last += value;
-							}
-							int64_t value = readVarZig(&data);
-							last += value;
-							assert(nodeIds[nodePos[i]] == last);
-							data.cursor = data_end;
-							break;
-						}
-						case 8: {
-							// lat
-							uint64_t data_len = readVarInt(&data);
-							void* data_end = data.cursor + data_len;
-							int64_t last = 0;
-							for(size_t j = 0; j < nodePtr.num; j++) {
-								int64_t value = readVarZig(&data);
-								last += value;
-							}
-							int64_t value = readVarZig(&data);
-							last += value;
-							lat[i] = last;
-							data.cursor = data_end;
-							break;
-						}
-						case 9: {
-							// lon
-							uint64_t data_len = readVarInt(&data);
-							void* data_end = data.cursor + data_len;
-							int64_t last = 0;
-							for(size_t j = 0; j < nodePtr.num; j++) {
-								int64_t value = readVarZig(&data);
-								last += value;
-							}
-							int64_t value = readVarZig(&data);
-							last += value;
-							lon[i] = last;
-							data.cursor = data_end;
-							break;
-						}
-						default:
-							skip(&data, TYPE_PART(key));
-							break;
-					}
-				}
-				assert(data.cursor == data_end);
-			}
+		build(pbfPath, &filter);
+		free(preds);
+	} else if(strcmp(command, "lookup") == 0) {
+		// Any number of relations, one after the other
+		struct index *index = index_open(".", pbfPath);
+		if(index == NULL) {
+			printf("Fatal: Could not open the index\n");
+			abort();
 		}
-
-		libdeflate_free_decompressor(decompressor);
-
-	}
-
-	printf("begin nodes\n");
-	for(size_t i = 0; i < totalNodeCnt; i++) {
-		struct blockData *block = blockData + nodePtrs[nodePos[i]].blockid;
-
-		double latCorrected = .000000001 * (blockData->latOff + (blockData->granularity * lat[i]));
-		double lonCorrected = .000000001 * (blockData->lonOff + (blockData->granularity * lon[i]));
-		printf("node iid %lu\n", i);
-		printf("node id %lu\n", nodeIds[nodePos[i]]);
-		printf("node pos %.*f %.*f\n", DBL_DIG, latCorrected, DBL_DIG, lonCorrected);
-	}
-
-	printf("begin ways\n");
-	{
-		uint64_t id = 0;
-		for(size_t i = 0; i < memberCnt; i++) {
-			printf("way\n");
-			for(size_t j = 0; j < refCnt[i]; j++) {
-				printf("mem %ld\n", toIndex[id++]);
+		struct queryCtx *ctx = query_ctx_create(index);
+		for(int i = 1; i < (argc > 1 ? argc : 2); i++) {
+			uint64_t relid = 8312746;
+			if(argc > 1) {
+				relid = strtoull(argv[i], NULL, 10);
+			}
+			if(!query_relation(ctx, relid, stdout)) {
+				printf("Fatal: Relation %lu is not in the index\n", relid);
+				abort();
 			}
 		}
-	}
-
-	printf("begin relations\n");
-	printf("relation\n");
-	for(size_t i = 0; i < memberCnt; i++) {
-		printf("mem %ld\n", i);
-	}
-
-	free(lon);
-	free(lat);
-
-	for(size_t i = 0; i < memberCnt; i++) {
-		free(refs[i]);
-	}
-	free(refs);
-	free(refCnt);
-	free(members);
-}
-
-int main(int argc, char** argv) {
-	if(argc != 2) {
-		printf("Wrong number of arguments\n");
-		exit(1);
-	}
-
-	if(strcmp(argv[1], "build") == 0) {
-		build();
-	} else if(strcmp(argv[1], "lookup") == 0) {
-		lookup();
+		query_ctx_free(ctx);
+		index_close(index);
 	}
 
 	return 0;
@@ -0,0 +1,118 @@
+#include "metrics.h"
+
+#include "trace.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+static const char *phaseNames[PHASE_CNT] = {
+	[PHASE_BLOB_INDEX] = "blob_index",
+	[PHASE_DECODE] = "decode",
+	[PHASE_SORT] = "sort",
+	[PHASE_PERMUTE] = "permute",
+	[PHASE_TRUNCATE] = "truncate",
+	[PHASE_SEGMENTS] = "segments",
+	[PHASE_RELATION_RESOLVE] = "relation_resolve",
+	[PHASE_WAY_EXPAND] = "way_expand",
+	[PHASE_NODE_GATHER] = "node_gather",
+	[PHASE_OUTPUT] = "output",
+};
+
+static const char *counterNames[COUNTER_CNT] = {
+	[COUNTER_BYTES_READ] = "bytes_read",
+	[COUNTER_BYTES_INFLATED] = "bytes_inflated",
+	[COUNTER_BLOBS_DECODED] = "blobs_decoded",
+	[COUNTER_CACHE_HITS] = "cache_hits",
+	[COUNTER_SCRATCH_PEAK] = "scratch_peak_bytes",
+};
+
+struct phaseTimes {
+	uint64_t wall;
+	uint64_t cpu;
+	uint64_t entered;
+	// Phases that were never entered are left out of the dump
+	bool active;
+};
+
+static const char *metricsCommand;
+static uint64_t metricsStart;
+static struct phaseTimes phases[PHASE_CNT];
+// Queries can run the same phase on several threads at once
+static _Thread_local uint64_t wallStart[PHASE_CNT];
+static _Thread_local uint64_t cpuStart[PHASE_CNT];
+static uint64_t counters[COUNTER_CNT];
+
+static uint64_t clockNs(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void metrics_dump() {
+	const char *path = getenv(METRICS_ENV);
+	FILE *out = stderr;
+	if(path != NULL && path[0] != '\0') {
+		out = fopen(path, "w");
+		if(out == NULL) {
+			fprintf(stderr, "Could not write metrics to %s\n", path);
+			return;
+		}
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	fprintf(out, "{\"command\":\"%s\",\"wall_s\":%.6f", metricsCommand,
+			(clockNs(CLOCK_MONOTONIC) - metricsStart) / 1e9);
+	fprintf(out, ",\"phases\":{");
+	bool first = true;
+	for(size_t i = 0; i < PHASE_CNT; i++) {
+		if(!__atomic_load_n(&phases[i].active, __ATOMIC_RELAXED)) continue;
+		fprintf(out, "%s\"%s\":{\"wall_s\":%.6f,\"cpu_s\":%.6f,\"entered\":%lu}",
+				first ? "" : ",", phaseNames[i],
+				__atomic_load_n(&phases[i].wall, __ATOMIC_RELAXED) / 1e9,
+				__atomic_load_n(&phases[i].cpu, __ATOMIC_RELAXED) / 1e9,
+				__atomic_load_n(&phases[i].entered, __ATOMIC_RELAXED));
+		first = false;
+	}
+	fprintf(out, "},\"counters\":{");
+	for(size_t i = 0; i < COUNTER_CNT; i++) {
+		fprintf(out, "%s\"%s\":%lu", i == 0 ? "" : ",", counterNames[i],
+				__atomic_load_n(&counters[i], __ATOMIC_RELAXED));
+	}
+	// ru_maxrss is in kilobytes
+	fprintf(out, "},\"peak_rss_bytes\":%lu}\n", (uint64_t)usage.ru_maxrss * 1024);
+
+	if(out != stderr) fclose(out);
+}
+
+void metrics_init(const char *command) {
+	metricsCommand = command;
+	metricsStart = clockNs(CLOCK_MONOTONIC);
+	atexit(metrics_dump);
+}
+
+void metrics_begin(enum metricPhase phase) {
+	assert(phase < PHASE_CNT);
+	TRACE_BEGIN(phaseNames[phase]);
+	wallStart[phase] = clockNs(CLOCK_MONOTONIC);
+	cpuStart[phase] = clockNs(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void metrics_end(enum metricPhase phase) {
+	assert(phase < PHASE_CNT);
+	__atomic_fetch_add(&phases[phase].wall, clockNs(CLOCK_MONOTONIC) - wallStart[phase], __ATOMIC_RELAXED);
+	__atomic_fetch_add(&phases[phase].cpu, clockNs(CLOCK_THREAD_CPUTIME_ID) - cpuStart[phase], __ATOMIC_RELAXED);
+	__atomic_fetch_add(&phases[phase].entered, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&phases[phase].active, true, __ATOMIC_RELAXED);
+	TRACE_END(phaseNames[phase]);
+}
+
+void metrics_add(enum metricCounter counter, uint64_t value) {
+	assert(counter < COUNTER_CNT);
+	__atomic_fetch_add(&counters[counter], value, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// Per phase timings and counters for a run. Everything is dumped as JSON when
+// the process exits, to the file named by METRICS_ENV or to stderr if it's
+// unset.
+#define METRICS_ENV "INDEX_METRICS"
+
+enum metricPhase {
+	// build
+	PHASE_BLOB_INDEX,
+	PHASE_DECODE,
+	PHASE_SORT,
+	PHASE_PERMUTE,
+	PHASE_TRUNCATE,
+	PHASE_SEGMENTS,
+
+	// lookup
+	PHASE_RELATION_RESOLVE,
+	PHASE_WAY_EXPAND,
+	PHASE_NODE_GATHER,
+	PHASE_OUTPUT,
+
+	PHASE_CNT,
+};
+
+enum metricCounter {
+	COUNTER_BYTES_READ,
+	COUNTER_BYTES_INFLATED,
+	COUNTER_BLOBS_DECODED,
+	COUNTER_CACHE_HITS,
+	// The most scratch memory a query context had allocated at once, summed
+	// over the contexts
+	COUNTER_SCRATCH_PEAK,
+
+	COUNTER_CNT,
+};
+
+void metrics_init(const char *command);
+
+// Phases are timed from the thread driving them. A phase can be entered more
+// than once, also from several threads at the same time, the times add up.
+// The cpu time is that of the driving thread only, threads it hands work to
+// (like the pread pool) aren't counted.
+// Phases also show up as spans in the trace.
+void metrics_begin(enum metricPhase phase);
+void metrics_end(enum metricPhase phase);
+
+// Safe to call from any thread
+void metrics_add(enum metricCounter counter, uint64_t value);
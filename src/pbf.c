@@ -0,0 +1,81 @@
+#include "pbf.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+uint32_t readInt32(struct pbfcursor *data) {
+	assert(data->cursor + 4 <= data->end);
+
+	int32_t value = 0;
+	value |= *(uint8_t*)(data->cursor+0) >> 24;
+	value |= *(uint8_t*)(data->cursor+1) >> 16;
+	value |= *(uint8_t*)(data->cursor+2) >>  8;
+	value |= *(uint8_t*)(data->cursor+3) >>  0;
+
+	data->cursor += 4;
+	return value;
+}
+
+uint64_t readVarInt(struct pbfcursor* data) {
+	uint64_t value = 0;
+
+	uint8_t byte;
+	uint8_t i = 0;
+	do {
+		assert(data->cursor + 1 <= data->end);
+
+		byte = *(uint8_t*)data->cursor;
+
+		value |= (uint64_t)(byte & 0x7F) << i;
+
+		data->cursor++;
+		i += 7;
+	} while(byte & 0x80);
+
+	return value;
+}
+
+int64_t readVarZig(struct pbfcursor* data) {
+	uint64_t value = readVarInt(data);
+	value = (value >> 1) ^ -(value & 1);
+	return value;
+}
+
+struct sizestr readString(struct pbfcursor* data) {
+	uint64_t len = readVarInt(data);
+	assert(data->cursor + len <= data->end);
+	char* str = data->cursor;
+	data->cursor += len;
+
+	return (struct sizestr){
+		.str = str,
+		.len = len,
+	};
+}
+
+void skip(struct pbfcursor *data, uint64_t type) {
+	switch(type) {
+		case 0:
+			readVarInt(data); //Discard it
+			break;
+		case 1:
+			assert(data->cursor + 8 <= data->end);
+			data->cursor += 8;
+			break;
+		case 2: {
+			uint64_t len = readVarInt(data);
+			assert(data->cursor + len <= data->end);
+			data->cursor += len;
+			break;
+		}
+		case 3: case 4:
+			abort();
+			break;
+		case 5:
+			assert(data->cursor + 4 <= data->end);
+			data->cursor += 4;
+			break;
+		default:
+			abort();
+	}
+}
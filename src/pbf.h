@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+// The end is only read by the asserts, but it's always there so the
+// initializers look the same in release builds.
+struct pbfcursor {
+	void* cursor;
+	void* end;
+};
+
+struct sizestr {
+	char* str;
+	uint64_t len;
+};
+
+uint32_t readInt32(struct pbfcursor *data);
+uint64_t readVarInt(struct pbfcursor* data);
+int64_t readVarZig(struct pbfcursor* data);
+struct sizestr readString(struct pbfcursor* data);
+void skip(struct pbfcursor *data, uint64_t type);
+
+#define KEY_PART(x) (x >> 3)
+#define TYPE_PART(x) (x & 3)
@@ -0,0 +1,254 @@
+#include "predicates.h"
+
+#include <math.h>
+
+// A number as an expansion, a sum of doubles that don't overlap, stored from
+// the smallest magnitude to the largest. The sign of the sum is the sign of
+// the last one.
+
+#define EPSILON 0x1p-53
+
+// Error bounds of the float determinants, from the paper
+#define CCW_ERRBOUND ((3.0 + 16.0 * EPSILON) * EPSILON)
+#define ICC_ERRBOUND ((10.0 + 96.0 * EPSILON) * EPSILON)
+
+// Exact a+b, when |a| >= |b|
+static inline void fastTwoSum(double a, double b, double *x, double *y) {
+	*x = a + b;
+	double bv = *x - a;
+	*y = b - bv;
+}
+
+// Exact a+b as x+y
+static inline void twoSum(double a, double b, double *x, double *y) {
+	*x = a + b;
+	double bv = *x - a;
+	double av = *x - bv;
+	*y = (a - av) + (b - bv);
+}
+
+// Exact a-b as x+y
+static inline void twoDiff(double a, double b, double *x, double *y) {
+	*x = a - b;
+	double bv = a - *x;
+	double av = *x + bv;
+	*y = (a - av) + (bv - b);
+}
+
+// Exact a*b as x+y. fma rounds once, so it gives the error of the product
+// without splitting the operands
+static inline void twoProduct(double a, double b, double *x, double *y) {
+	*x = a * b;
+	*y = fma(a, b, -*x);
+}
+
+// a-b as an expansion of 1 or 2 doubles, returns the length
+static int diffExpansion(double a, double b, double *h) {
+	double x, y;
+	twoDiff(a, b, &x, &y);
+	if(y == 0.0) {
+		h[0] = x;
+		return 1;
+	}
+	h[0] = y;
+	h[1] = x;
+	return 2;
+}
+
+// h = e + f, without zeros. h has room for elen + flen
+static int expansionSum(int elen, const double *e, int flen, const double *f, double *h) {
+	double q, qnew, hh;
+	int ei = 0, fi = 0, hi = 0;
+
+	// Merge the two by magnitude, carrying the sum so far in q
+	if((f[0] > e[0]) == (f[0] > -e[0])) {
+		q = e[ei++];
+	} else {
+		q = f[fi++];
+	}
+	while(ei < elen || fi < flen) {
+		double next;
+		if(fi >= flen || (ei < elen && (f[fi] > e[ei]) == (f[fi] > -e[ei]))) {
+			next = e[ei++];
+		} else {
+			next = f[fi++];
+		}
+		twoSum(q, next, &qnew, &hh);
+		q = qnew;
+		if(hh != 0.0) {
+			h[hi++] = hh;
+		}
+	}
+	if(q != 0.0 || hi == 0) {
+		h[hi++] = q;
+	}
+	return hi;
+}
+
+// h = e * b, without zeros. h has room for 2 * elen
+static int scaleExpansion(int elen, const double *e, double b, double *h) {
+	double q, sum, hh, p1, p0;
+	int hi = 0;
+
+	twoProduct(e[0], b, &q, &hh);
+	if(hh != 0.0) {
+		h[hi++] = hh;
+	}
+	for(int i = 1; i < elen; i++) {
+		twoProduct(e[i], b, &p1, &p0);
+		twoSum(q, p0, &sum, &hh);
+		if(hh != 0.0) {
+			h[hi++] = hh;
+		}
+		fastTwoSum(p1, sum, &q, &hh);
+		if(hh != 0.0) {
+			h[hi++] = hh;
+		}
+	}
+	if(q != 0.0 || hi == 0) {
+		h[hi++] = q;
+	}
+	return hi;
+}
+
+// The longest product is two 16 long expansions in incircle
+#define MAX_PRODUCT 512
+
+// h = e * f. h has room for 2 * elen * flen, at most MAX_PRODUCT
+static int productExpansion(int elen, const double *e, int flen, const double *f, double *h) {
+	double part[2 * MAX_PRODUCT / 16];
+	double acc[2][MAX_PRODUCT];
+	int cur = 0;
+
+	int len = scaleExpansion(elen, e, f[0], acc[cur]);
+	for(int i = 1; i < flen; i++) {
+		int plen = scaleExpansion(elen, e, f[i], part);
+		len = expansionSum(len, acc[cur], plen, part, acc[!cur]);
+		cur = !cur;
+	}
+	for(int i = 0; i < len; i++) {
+		h[i] = acc[cur][i];
+	}
+	return len;
+}
+
+static int negateExpansion(int elen, double *e) {
+	for(int i = 0; i < elen; i++) {
+		e[i] = -e[i];
+	}
+	return elen;
+}
+
+// h = a*d - b*c, for expansions of at most 2. h has room for 16
+static int det2Expansion(int alen, const double *a, int blen, const double *b,
+		int clen, const double *c, int dlen, const double *d, double *h) {
+	double ad[8], bc[8];
+	int adlen = productExpansion(alen, a, dlen, d, ad);
+	int bclen = negateExpansion(productExpansion(blen, b, clen, c, bc), bc);
+	return expansionSum(adlen, ad, bclen, bc, h);
+}
+
+static double orient2dExact(double ax, double ay, double bx, double by, double cx, double cy) {
+	double acx[2], acy[2], bcx[2], bcy[2];
+	int acxlen = diffExpansion(ax, cx, acx);
+	int acylen = diffExpansion(ay, cy, acy);
+	int bcxlen = diffExpansion(bx, cx, bcx);
+	int bcylen = diffExpansion(by, cy, bcy);
+
+	double det[16];
+	int len = det2Expansion(acxlen, acx, acylen, acy, bcxlen, bcx, bcylen, bcy, det);
+	return det[len - 1];
+}
+
+double predicates_orient2d(double ax, double ay, double bx, double by, double cx, double cy) {
+	double detleft = (ax - cx) * (by - cy);
+	double detright = (ay - cy) * (bx - cx);
+	double det = detleft - detright;
+
+	// When the two products have different signs there's no cancellation
+	double detsum;
+	if(detleft > 0.0) {
+		if(detright <= 0.0) return det;
+		detsum = detleft + detright;
+	} else if(detleft < 0.0) {
+		if(detright >= 0.0) return det;
+		detsum = -detleft - detright;
+	} else {
+		return det;
+	}
+
+	double errbound = CCW_ERRBOUND * detsum;
+	if(det >= errbound || -det >= errbound) {
+		return det;
+	}
+	return orient2dExact(ax, ay, bx, by, cx, cy);
+}
+
+// lift * det, for the lift of one point and the 2x2 determinant of the
+// other two. h has room for MAX_PRODUCT
+static int liftTerm(int xlen, const double *x, int ylen, const double *y, int detlen, const double *det, double *h) {
+	double xx[8], yy[8], lift[16];
+	int xxlen = productExpansion(xlen, x, xlen, x, xx);
+	int yylen = productExpansion(ylen, y, ylen, y, yy);
+	int liftlen = expansionSum(xxlen, xx, yylen, yy, lift);
+	return productExpansion(liftlen, lift, detlen, det, h);
+}
+
+static double incircleExact(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy) {
+	double adx[2], ady[2], bdx[2], bdy[2], cdx[2], cdy[2];
+	int adxlen = diffExpansion(ax, dx, adx);
+	int adylen = diffExpansion(ay, dy, ady);
+	int bdxlen = diffExpansion(bx, dx, bdx);
+	int bdylen = diffExpansion(by, dy, bdy);
+	int cdxlen = diffExpansion(cx, dx, cdx);
+	int cdylen = diffExpansion(cy, dy, cdy);
+
+	double bc[16], ca[16], ab[16];
+	int bclen = det2Expansion(bdxlen, bdx, bdylen, bdy, cdxlen, cdx, cdylen, cdy, bc);
+	int calen = det2Expansion(cdxlen, cdx, cdylen, cdy, adxlen, adx, adylen, ady, ca);
+	int ablen = det2Expansion(adxlen, adx, adylen, ady, bdxlen, bdx, bdylen, bdy, ab);
+
+	double aterm[MAX_PRODUCT], bterm[MAX_PRODUCT], cterm[MAX_PRODUCT];
+	int alen = liftTerm(adxlen, adx, adylen, ady, bclen, bc, aterm);
+	int blen = liftTerm(bdxlen, bdx, bdylen, bdy, calen, ca, bterm);
+	int clen = liftTerm(cdxlen, cdx, cdylen, cdy, ablen, ab, cterm);
+
+	double abterm[2 * MAX_PRODUCT], det[3 * MAX_PRODUCT];
+	int ablen2 = expansionSum(alen, aterm, blen, bterm, abterm);
+	int len = expansionSum(ablen2, abterm, clen, cterm, det);
+	return det[len - 1];
+}
+
+double predicates_incircle(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy) {
+	double adx = ax - dx;
+	double bdx = bx - dx;
+	double cdx = cx - dx;
+	double ady = ay - dy;
+	double bdy = by - dy;
+	double cdy = cy - dy;
+
+	double bdxcdy = bdx * cdy;
+	double cdxbdy = cdx * bdy;
+	double alift = adx * adx + ady * ady;
+
+	double cdxady = cdx * ady;
+	double adxcdy = adx * cdy;
+	double blift = bdx * bdx + bdy * bdy;
+
+	double adxbdy = adx * bdy;
+	double bdxady = bdx * ady;
+	double clift = cdx * cdx + cdy * cdy;
+
+	double det = alift * (bdxcdy - cdxbdy)
+		+ blift * (cdxady - adxcdy)
+		+ clift * (adxbdy - bdxady);
+
+	double permanent = (fabs(bdxcdy) + fabs(cdxbdy)) * alift
+		+ (fabs(cdxady) + fabs(adxcdy)) * blift
+		+ (fabs(adxbdy) + fabs(bdxady)) * clift;
+	double errbound = ICC_ERRBOUND * permanent;
+	if(det > errbound || -det > errbound) {
+		return det;
+	}
+	return incircleExact(ax, ay, bx, by, cx, cy, dx, dy);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Orientation and incircle tests for the triangulation, robust for any
+// double input. They are plain float determinants as long as the error bound
+// says the sign is right, and only when it isn't they work the determinant
+// out exactly (Shewchuk, Adaptive Precision Floating-Point Arithmetic and
+// Fast Robust Geometric Predicates, 1997).
+//
+// Only the sign of the result is meaningful. The triangulation in lua loads
+// these from predicates.so through the ffi, see predicates.lua.
+
+// Positive if a, b, c are in counterclockwise order, negative if they are
+// clockwise and 0 if they are on a line
+double predicates_orient2d(double ax, double ay, double bx, double by, double cx, double cy);
+
+// Positive if d is inside the circle through a, b, c when they are
+// counterclockwise, negative if it's outside and 0 if it's on the circle.
+// The sign flips when a, b, c are clockwise
+double predicates_incircle(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy);
@@ -0,0 +1,42 @@
+#include "ptr.h"
+
+#include "log.h"
+
+void ptrarray_widen(struct ptrArray *array, size_t cnt) {
+	if(array->wide) return;
+
+	// Back to front, so every packed ptr is read before the wider ones
+	// overwrite it
+	uint64_t *packed = array->data;
+	struct pbfPtr *wide = array->data;
+	for(size_t i = cnt; i > 0; i--) {
+		wide[i-1] = ptr_unpack(packed[i-1]);
+	}
+	array->wide = true;
+}
+
+void ptrarray_set(struct ptrArray *array, size_t cnt, size_t i, struct pbfPtr ptr) {
+	if(!array->wide && !ptr_fits(ptr)) {
+		LOG_INFO(LOGCAT_BUILD, "ptr (block %lu offset %lu num %d) doesn't fit, widening %lu ptrs\n",
+				ptr.blockid, ptr.offset, ptr.num, cnt);
+		ptrarray_widen(array, cnt);
+	}
+
+	if(array->wide) {
+		((struct pbfPtr*)array->data)[i] = ptr;
+	} else {
+		((uint64_t*)array->data)[i] = ptr_pack(ptr);
+	}
+}
+
+bool ptrarray_fromFile(struct ptrArray *array, void *data, size_t size, size_t cnt) {
+	array->data = data;
+	if(size == cnt * sizeof(uint64_t)) {
+		array->wide = false;
+	} else if(size == cnt * sizeof(struct pbfPtr)) {
+		array->wide = true;
+	} else {
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Where an entity is in the pbf: the block, the offset of the entity (or the
+// dense group for nodes) in the decompressed block and the index into the
+// dense group.
+struct pbfPtr {
+	uint64_t blockid;
+	size_t offset;
+	int num;
+};
+
+// The ptr files store the ptrs packed into 64 bits, block in the high bits and
+// num in the low bits so packed ptrs sort like the unpacked ones. Decompressed
+// blocks are at most 32MB, so the offset always fits. A build that has a ptr
+// that doesn't fit in the other fields falls back to storing the struct as is,
+// which lookup tells apart from the file size.
+#define PTR_BLOCK_BITS 22
+#define PTR_OFFSET_BITS 26
+#define PTR_NUM_BITS 16
+
+#define PTR_OFFSET_SHIFT PTR_NUM_BITS
+#define PTR_BLOCK_SHIFT (PTR_NUM_BITS + PTR_OFFSET_BITS)
+#define PTR_MASK(bits) ((1ULL << (bits)) - 1)
+
+static inline bool ptr_fits(struct pbfPtr ptr) {
+	return ptr.blockid <= PTR_MASK(PTR_BLOCK_BITS)
+		&& ptr.offset <= PTR_MASK(PTR_OFFSET_BITS)
+		&& ptr.num >= 0 && (uint64_t)ptr.num <= PTR_MASK(PTR_NUM_BITS);
+}
+
+static inline uint64_t ptr_pack(struct pbfPtr ptr) {
+	return ptr.blockid << PTR_BLOCK_SHIFT
+		| (uint64_t)ptr.offset << PTR_OFFSET_SHIFT
+		| (uint64_t)ptr.num;
+}
+
+static inline struct pbfPtr ptr_unpack(uint64_t packed) {
+	return (struct pbfPtr){
+		.blockid = packed >> PTR_BLOCK_SHIFT,
+		.offset = (packed >> PTR_OFFSET_SHIFT) & PTR_MASK(PTR_OFFSET_BITS),
+		.num = packed & PTR_MASK(PTR_NUM_BITS),
+	};
+}
+
+// An array of ptrs in either format
+struct ptrArray {
+	void *data;
+	bool wide;
+};
+
+static inline size_t ptrarray_elemSize(const struct ptrArray *array) {
+	return array->wide ? sizeof(struct pbfPtr) : sizeof(uint64_t);
+}
+
+static inline struct pbfPtr ptrarray_get(const struct ptrArray *array, size_t i) {
+	if(array->wide) {
+		return ((struct pbfPtr*)array->data)[i];
+	}
+	return ptr_unpack(((uint64_t*)array->data)[i]);
+}
+
+// Store ptr at i. If it doesn't fit the packed format, the cnt ptrs already in
+// the array are widened first, so data must have room for the wide format.
+void ptrarray_set(struct ptrArray *array, size_t cnt, size_t i, struct pbfPtr ptr);
+void ptrarray_widen(struct ptrArray *array, size_t cnt);
+
+// Tell the format of a ptr file from its size. Returns false if the size
+// doesn't match cnt ptrs in either format.
+bool ptrarray_fromFile(struct ptrArray *array, void *data, size_t size, size_t cnt);
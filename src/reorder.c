@@ -1,14 +1,19 @@
 #include "reorder.h"
 
+#include "trace.h"
+
 #include <limits.h>
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #define SIZE_BITS (sizeof(size_t)*CHAR_BIT)
 void permuteFrom(uint64_t* from, void* data, size_t elemSize, size_t elemCnt, void* scratch) {
 	assert(elemCnt>>(SIZE_BITS-1) == 0);
+	TRACE_BEGIN("permuteFrom");
 #ifndef NDEBUG
 	// Save the from so that we can check that we don't touch it (only if debug
 	// is enabled)
@@ -66,6 +71,7 @@ void permuteFrom(uint64_t* from, void* data, size_t elemSize, size_t elemCnt, vo
 	assert(memcmp(sourceArray, from, sizeof(uint64_t) * elemCnt) == 0);
 	free(sourceArray);
 #endif
+	TRACE_END("permuteFrom");
 }
 
 void convertFromIntoTo(uint64_t *from, uint64_t *to, size_t elemCnt, uint64_t *dupes, size_t dupeCnt) {
@@ -83,3 +89,154 @@ void convertFromIntoTo(uint64_t *from, uint64_t *to, size_t elemCnt, uint64_t *d
 		to[from[j]] = j-dupeCnt;
 	}
 }
+
+// Elements gathered per array before moving on to the next array. The block of
+// from stays in cache while it's used for all of them.
+#define PERMUTE_BLOCK 2048
+// How far ahead of the gather the source is prefetched
+#define PERMUTE_PREFETCH 16
+// Starting a thread isn't worth it for less than this
+#define PERMUTE_MIN_PER_THREAD (64 * 1024)
+#define PERMUTE_MAX_THREADS 64
+
+struct permuteJob {
+	const uint64_t* from;
+	const struct permuteArray* arrays;
+	size_t arrayCnt;
+	size_t begin;
+	size_t end;
+};
+
+// Always inlined so the switch below gets a copy with a constant elemSize for
+// the common sizes, which turns the memcpy into plain moves.
+static inline __attribute__((always_inline)) void gatherElems(const uint64_t* from, const char* src, char* dst, size_t elemSize, size_t begin, size_t end) {
+	for(size_t i = begin; i < end; i++) {
+		if(i + PERMUTE_PREFETCH < end) {
+			__builtin_prefetch(src + from[i + PERMUTE_PREFETCH] * elemSize);
+		}
+		memcpy(dst + i*elemSize, src + from[i]*elemSize, elemSize);
+	}
+}
+
+static void gatherBlock(const uint64_t* from, const struct permuteArray* array, size_t begin, size_t end) {
+	switch(array->elemSize) {
+		case 4:
+			gatherElems(from, array->src, array->dst, 4, begin, end);
+			break;
+		case 8:
+			gatherElems(from, array->src, array->dst, 8, begin, end);
+			break;
+		case 16:
+			gatherElems(from, array->src, array->dst, 16, begin, end);
+			break;
+		case 24:
+			gatherElems(from, array->src, array->dst, 24, begin, end);
+			break;
+		default:
+			gatherElems(from, array->src, array->dst, array->elemSize, begin, end);
+			break;
+	}
+}
+
+static void* permuteWorker(void* arg) {
+	struct permuteJob* job = arg;
+	TRACE_BEGIN("permuteArrays");
+	for(size_t begin = job->begin; begin < job->end; begin += PERMUTE_BLOCK) {
+		size_t end = begin + PERMUTE_BLOCK;
+		if(end > job->end) end = job->end;
+		for(size_t a = 0; a < job->arrayCnt; a++) {
+			gatherBlock(job->from, &job->arrays[a], begin, end);
+		}
+	}
+	TRACE_END("permuteArrays");
+	return NULL;
+}
+
+void permuteArrays(const uint64_t* from, size_t elemCnt, const struct permuteArray* arrays, size_t arrayCnt, size_t threadCnt) {
+	if(threadCnt == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threadCnt = cpus > 0 ? cpus : 1;
+	}
+	size_t maxThreads = elemCnt / PERMUTE_MIN_PER_THREAD;
+	if(threadCnt > maxThreads) threadCnt = maxThreads;
+	if(threadCnt > PERMUTE_MAX_THREADS) threadCnt = PERMUTE_MAX_THREADS;
+	if(threadCnt == 0) threadCnt = 1;
+
+	struct permuteJob jobs[PERMUTE_MAX_THREADS];
+	pthread_t threads[PERMUTE_MAX_THREADS];
+	bool started[PERMUTE_MAX_THREADS];
+	// Every thread writes its own range of the output. Ranges are whole
+	// blocks, so no two threads share a cache line of dst.
+	size_t blocks = (elemCnt + PERMUTE_BLOCK - 1) / PERMUTE_BLOCK;
+	for(size_t t = 0; t < threadCnt; t++) {
+		size_t begin = blocks * t / threadCnt * PERMUTE_BLOCK;
+		size_t end = blocks * (t+1) / threadCnt * PERMUTE_BLOCK;
+		jobs[t] = (struct permuteJob){
+			.from = from,
+			.arrays = arrays,
+			.arrayCnt = arrayCnt,
+			.begin = begin < elemCnt ? begin : elemCnt,
+			.end = end < elemCnt ? end : elemCnt,
+		};
+	}
+
+	for(size_t t = 1; t < threadCnt; t++) {
+		started[t] = pthread_create(&threads[t], NULL, permuteWorker, &jobs[t]) == 0;
+		if(!started[t]) {
+			// Just do it ourselves
+			permuteWorker(&jobs[t]);
+		}
+	}
+	permuteWorker(&jobs[0]);
+	for(size_t t = 1; t < threadCnt; t++) {
+		if(started[t]) pthread_join(threads[t], NULL);
+	}
+}
+
+void permuteArraysInPlace(const uint64_t* from, size_t elemCnt, const struct permuteArray* arrays, size_t arrayCnt) {
+	TRACE_BEGIN("permuteArraysInPlace");
+	// A bit per element that has its final value
+	uint64_t* done = calloc((elemCnt + 63) / 64, sizeof(uint64_t));
+	size_t scratchSize = 0;
+	for(size_t a = 0; a < arrayCnt; a++) {
+		scratchSize += arrays[a].elemSize;
+	}
+	char* scratch = malloc(scratchSize > 0 ? scratchSize : 1);
+	if(done == NULL || scratch == NULL) abort();
+
+	// Like permuteFrom, element i is set aside and the cycle it starts is
+	// followed until it comes back around to take from i
+	for(size_t i = 0; i < elemCnt; i++) {
+		if(done[i / 64] & (1ULL << (i % 64))) continue;
+
+		char* held = scratch;
+		for(size_t a = 0; a < arrayCnt; a++) {
+			memcpy(held, (char*)arrays[a].dst + i*arrays[a].elemSize, arrays[a].elemSize);
+			held += arrays[a].elemSize;
+		}
+
+		size_t dest = i;
+		while(true) {
+			done[dest / 64] |= 1ULL << (dest % 64);
+			size_t source = from[dest];
+			if(source == i) break;
+
+			for(size_t a = 0; a < arrayCnt; a++) {
+				char* data = arrays[a].dst;
+				size_t elemSize = arrays[a].elemSize;
+				memcpy(data + dest*elemSize, data + source*elemSize, elemSize);
+			}
+			dest = source;
+		}
+
+		held = scratch;
+		for(size_t a = 0; a < arrayCnt; a++) {
+			memcpy((char*)arrays[a].dst + dest*arrays[a].elemSize, held, arrays[a].elemSize);
+			held += arrays[a].elemSize;
+		}
+	}
+
+	free(scratch);
+	free(done);
+	TRACE_END("permuteArraysInPlace");
+}
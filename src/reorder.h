@@ -9,4 +9,21 @@ struct order {
 };
 
 void permuteFrom(uint64_t* from, void* data, size_t elemSize, size_t elemCnt, void* scratch);
+
+// An array moved by permuteArrays. src and dst must not overlap
+struct permuteArray {
+    const void* src;
+    void* dst;
+    size_t elemSize;
+};
+
+// Apply the same permutation to all the arrays at once, dst[i] = src[from[i]].
+// from is only read. The work is split over threadCnt threads, 0 picks one per
+// cpu.
+void permuteArrays(const uint64_t* from, size_t elemCnt, const struct permuteArray* arrays, size_t arrayCnt, size_t threadCnt);
+// The same permutation, but done in place on dst of every array, src isn't
+// used. It follows the cycles of the permutation, moving all the arrays along
+// each one. The only scratch is a bit per element and one element per array,
+// but it runs on one thread and reads the arrays in random order.
+void permuteArraysInPlace(const uint64_t* from, size_t elemCnt, const struct permuteArray* arrays, size_t arrayCnt);
 void convertFromIntoTo(uint64_t *from, uint64_t *to, size_t elemCnt, uint64_t *dupes, size_t dupeCnt);
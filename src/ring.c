@@ -1,8 +1,11 @@
 #include "ring.h"
 
+#include "log.h"
+
 #include <assert.h>
 #include <float.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 static double pseudoangle(double x, double y) {
@@ -24,194 +27,497 @@ static size_t endOfWay(struct ways ways, size_t way, int direction) {
 	}
 }
 
+// The ends of the ways, keyed on their node. A node where several ways meet
+// has an entry for every way end, they are found by probing on until an empty
+// slot.
+struct wayEnd {
+	uint64_t node;
+	size_t way;
+	// The direction of the link when the ring enters the way at this end
+	int8_t direction;
+};
+
+struct endMap {
+	struct wayEnd *ends;
+	size_t mask;
+};
+
+#define END_EMPTY SIZE_MAX
+
+static size_t endHash(uint64_t node) {
+	return (node * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+static void endmap_init(struct endMap *map, size_t wayCnt) {
+	// At most half full
+	size_t cap = 4;
+	while(cap < wayCnt * 4) cap <<= 1;
+	map->ends = malloc(sizeof(struct wayEnd) * cap);
+	if(map->ends == NULL) abort();
+	for(size_t i = 0; i < cap; i++) {
+		map->ends[i].way = END_EMPTY;
+	}
+	map->mask = cap - 1;
+}
+
+static void endmap_put(struct endMap *map, uint64_t node, size_t way, int8_t direction) {
+	size_t slot = endHash(node) & map->mask;
+	while(map->ends[slot].way != END_EMPTY) {
+		slot = (slot + 1) & map->mask;
+	}
+	map->ends[slot] = (struct wayEnd){
+		.node = node,
+		.way = way,
+		.direction = direction,
+	};
+}
+
+
+// The node the link arrives at when walking the ring
+static uint64_t linkEnd(struct ways ways, struct link link) {
+	return ways.nodes[endOfWay(ways, link.way, link.direction)];
+}
+
+// Follow the open ways from the end of start, at every node taking the first
+// unused way counterclockwise from the one we came in on, until we are back
+// where start began. The links go into links, returns how many or 0 when the
+// ring doesn't close.
+static size_t walkRing(struct nodes nodes, struct ways ways, const struct endMap *ends, uint8_t *usedWays, size_t start, struct link *links) {
+	size_t linkCnt = 0;
+	struct link link = {
+		.way = start,
+		.direction = -1,
+	};
+	uint64_t begin = ways.nodes[endOfWay(ways, start, 1)];
+	while(1) {
+		LOG_TRACE(LOGCAT_RING, "We pick way %lu in direction %d\n", link.way, link.direction);
+		usedWays[link.way] = 1;
+		links[linkCnt++] = link;
+
+		// If we return to the start the ring is complete
+		size_t endi = endOfWay(ways, link.way, link.direction);
+		uint64_t nnode = ways.nodes[endi];
+		if(nnode == begin) return linkCnt;
+
+		uint64_t lnode = ways.nodes[endi + link.direction];
+		double refAngle = pseudoangle(nodes.nodes[lnode].x - nodes.nodes[nnode].x, nodes.nodes[lnode].y - nodes.nodes[nnode].y);
+
+		double minAngle = DBL_MAX;
+		size_t nextWay = END_EMPTY;
+		int8_t nextDirection = 0;
+		LOG_TRACE(LOGCAT_RING, "Fetch angles for neighbours to %ld\n", nnode);
+		for(size_t slot = endHash(nnode) & ends->mask; ends->ends[slot].way != END_EMPTY; slot = (slot + 1) & ends->mask) {
+			const struct wayEnd *end = &ends->ends[slot];
+			if(end->node != nnode || usedWays[end->way]) continue;
+
+			// The node next to the end, going into the way
+			size_t wayi = endOfWay(ways, end->way, -end->direction);
+			size_t onode = ways.nodes[wayi - end->direction];
+			double angle = pseudoangle(nodes.nodes[onode].x - nodes.nodes[nnode].x, nodes.nodes[onode].y - nodes.nodes[nnode].y) - refAngle;
+			if(angle <= 0) angle += 4;
+			if(angle < minAngle) {
+				minAngle = angle;
+				nextWay = end->way;
+				nextDirection = end->direction;
+			}
+		}
+		if(nextWay == END_EMPTY) {
+			LOG_TRACE(LOGCAT_RING, "Way %lu ends in %lu without closing the ring\n", link.way, nnode);
+			return 0;
+		}
+		link = (struct link){
+			.way = nextWay,
+			.direction = nextDirection,
+		};
+	}
+}
+
+// The shape of an assembled ring, for orienting and nesting it
+struct ringShape {
+	// The ring's vertices, in the order they are walked
+	size_t firstVertex;
+	size_t vertexCnt;
+	// Positive when the ring winds counterclockwise
+	double area;
+	double minX, minY, maxX, maxY;
+};
+
+struct vertex {
+	double x;
+	double y;
+};
+
+static size_t ringVertices(struct nodes nodes, struct ways ways, const struct link *links, size_t linkCnt, struct vertex *vertices) {
+	size_t cnt = 0;
+	for(size_t l = 0; l < linkCnt; l++) {
+		// The first node of a link is the last of the one before
+		size_t begin = endOfWay(ways, links[l].way, -links[l].direction);
+		size_t end = endOfWay(ways, links[l].way, links[l].direction);
+		for(size_t i = begin; i != end;) {
+			i -= links[l].direction;
+			struct node *node = &nodes.nodes[ways.nodes[i]];
+			vertices[cnt++] = (struct vertex){ node->x, node->y };
+		}
+	}
+	return cnt;
+}
+
+static void shapeOf(const struct vertex *vertices, size_t cnt, struct ringShape *shape) {
+	shape->area = 0;
+	shape->minX = shape->minY = DBL_MAX;
+	shape->maxX = shape->maxY = -DBL_MAX;
+	for(size_t i = 0; i < cnt; i++) {
+		const struct vertex *a = &vertices[i];
+		const struct vertex *b = &vertices[i+1 < cnt ? i+1 : 0];
+		shape->area += a->x * b->y - b->x * a->y;
+		shape->minX = fmin(shape->minX, a->x);
+		shape->minY = fmin(shape->minY, a->y);
+		shape->maxX = fmax(shape->maxX, a->x);
+		shape->maxY = fmax(shape->maxY, a->y);
+	}
+	shape->area /= 2;
+}
+
+// Crossing number test
+static bool insideRing(const struct vertex *vertices, size_t cnt, double x, double y) {
+	bool inside = false;
+	for(size_t i = 0, j = cnt-1; i < cnt; j = i++) {
+		const struct vertex *a = &vertices[i];
+		const struct vertex *b = &vertices[j];
+		if((a->y > y) != (b->y > y)
+				&& x < (b->x - a->x) * (y - a->y) / (b->y - a->y) + a->x) {
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+struct areaOrder {
+	double area;
+	size_t ring;
+};
+
+static int areacmp(const void *a, const void *b) {
+	const struct areaOrder *ao = a;
+	const struct areaOrder *bo = b;
+	if(ao->area != bo->area) return ao->area > bo->area ? -1 : 1;
+	return ao->ring < bo->ring ? -1 : ao->ring > bo->ring ? 1 : 0;
+}
+
+static void reverseLinks(struct link *links, size_t cnt) {
+	for(size_t i = 0; i < cnt / 2; i++) {
+		struct link tmp = links[i];
+		links[i] = links[cnt-1-i];
+		links[cnt-1-i] = tmp;
+	}
+	for(size_t i = 0; i < cnt; i++) {
+		links[i].direction = -links[i].direction;
+	}
+}
+
+// Start the ring with the link that arrives at its leftmost (then lowest)
+// junction, so the result doesn't depend on which way the walk started from
+static void rotateLinks(struct nodes nodes, struct ways ways, struct link *links, size_t cnt, struct link *scratch) {
+	size_t first = 0;
+	struct node *best = &nodes.nodes[linkEnd(ways, links[0])];
+	for(size_t i = 1; i < cnt; i++) {
+		struct node *node = &nodes.nodes[linkEnd(ways, links[i])];
+		if(node->x < best->x || (node->x == best->x && node->y < best->y)) {
+			best = node;
+			first = i;
+		}
+	}
+	if(first == 0) return;
+
+	for(size_t i = 0; i < cnt; i++) {
+		scratch[i] = links[(first + i) % cnt];
+	}
+	for(size_t i = 0; i < cnt; i++) {
+		links[i] = scratch[i];
+	}
+}
+
+// A uniform grid over the bounds of all the rings, with about a cell per ring.
+// Every cell lists the rings whose bounds overlap it, as positions in the area
+// order. Rings that would go in more than GRID_BIG_CELLS cells are kept in a
+// list of their own instead.
+#define GRID_BIG_CELLS 16
+
+struct ringGrid {
+	double minX, minY;
+	double cellW, cellH;
+	size_t side;
+
+	// Where the rings of every cell start in cellRings, side*side+1 entries
+	size_t *cellStart;
+	size_t *cellRings;
+
+	size_t *bigRings;
+	size_t bigCnt;
+};
+
+static size_t gridCoord(double v, double min, double size, size_t side) {
+	double c = (v - min) / size;
+	if(!(c > 0)) return 0;
+	if(c >= side) return side - 1;
+	return c;
+}
+
+static size_t ringgrid_cell(const struct ringGrid *grid, double x, double y) {
+	return gridCoord(y, grid->minY, grid->cellH, grid->side) * grid->side
+		+ gridCoord(x, grid->minX, grid->cellW, grid->side);
+}
+
+struct cellRange {
+	size_t x0, x1;
+	size_t y0, y1;
+};
+
+// The cells the bounds of the shape overlap, or false if there are too many
+static bool ringgrid_cells(const struct ringGrid *grid, const struct ringShape *shape, struct cellRange *range) {
+	range->x0 = gridCoord(shape->minX, grid->minX, grid->cellW, grid->side);
+	range->x1 = gridCoord(shape->maxX, grid->minX, grid->cellW, grid->side);
+	range->y0 = gridCoord(shape->minY, grid->minY, grid->cellH, grid->side);
+	range->y1 = gridCoord(shape->maxY, grid->minY, grid->cellH, grid->side);
+	return (range->x1 - range->x0 + 1) * (range->y1 - range->y0 + 1) <= GRID_BIG_CELLS;
+}
+
+static void ringgrid_build(struct ringGrid *grid, const struct ringShape *shapes, const struct areaOrder *order, size_t cnt) {
+	double minX = DBL_MAX, minY = DBL_MAX;
+	double maxX = -DBL_MAX, maxY = -DBL_MAX;
+	for(size_t r = 0; r < cnt; r++) {
+		minX = fmin(minX, shapes[r].minX);
+		minY = fmin(minY, shapes[r].minY);
+		maxX = fmax(maxX, shapes[r].maxX);
+		maxY = fmax(maxY, shapes[r].maxY);
+	}
+	size_t side = 1;
+	while(side * side < cnt) side++;
+	grid->side = side;
+	grid->minX = minX;
+	grid->minY = minY;
+	grid->cellW = maxX > minX ? (maxX - minX) / side : 1;
+	grid->cellH = maxY > minY ? (maxY - minY) / side : 1;
+
+	size_t cellCnt = side * side;
+	grid->cellStart = calloc(cellCnt + 1, sizeof(size_t));
+	grid->bigRings = malloc(sizeof(size_t) * (cnt + 1));
+	if(grid->cellStart == NULL || grid->bigRings == NULL) abort();
+
+	// Count the rings per cell, then fill them in, in sorted order
+	for(size_t k = 0; k < cnt; k++) {
+		struct cellRange range;
+		if(!ringgrid_cells(grid, &shapes[order[k].ring], &range)) continue;
+		for(size_t y = range.y0; y <= range.y1; y++) {
+			for(size_t x = range.x0; x <= range.x1; x++) {
+				grid->cellStart[y * side + x + 1]++;
+			}
+		}
+	}
+	for(size_t c = 0; c < cellCnt; c++) {
+		grid->cellStart[c+1] += grid->cellStart[c];
+	}
+	grid->cellRings = malloc(sizeof(size_t) * (grid->cellStart[cellCnt] + 1));
+	size_t *fill = malloc(sizeof(size_t) * cellCnt);
+	if(grid->cellRings == NULL || fill == NULL) abort();
+	for(size_t c = 0; c < cellCnt; c++) {
+		fill[c] = grid->cellStart[c];
+	}
+
+	grid->bigCnt = 0;
+	for(size_t k = 0; k < cnt; k++) {
+		struct cellRange range;
+		if(!ringgrid_cells(grid, &shapes[order[k].ring], &range)) {
+			grid->bigRings[grid->bigCnt++] = k;
+			continue;
+		}
+		for(size_t y = range.y0; y <= range.y1; y++) {
+			for(size_t x = range.x0; x <= range.x1; x++) {
+				grid->cellRings[fill[y * side + x]++] = k;
+			}
+		}
+	}
+	free(fill);
+}
+
+static void ringgrid_kill(struct ringGrid *grid) {
+	free(grid->cellStart);
+	free(grid->cellRings);
+	free(grid->bigRings);
+}
+
+// The number of entries in the sorted list that are below k
+static size_t below(const size_t *list, size_t cnt, size_t k) {
+	size_t low = 0;
+	size_t high = cnt;
+	while(low < high) {
+		size_t mid = low + (high - low) / 2;
+		if(list[mid] < k) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
 int rings_find(struct nodes nodes, struct ways ways, struct ring *ring) {
 	uint8_t *usedWays = calloc(ways.cnt, sizeof(uint8_t));
 	if(usedWays == NULL) abort();
-	size_t remain = ways.cnt;
+	int rc = 0;
 
 	size_t maxRings = ring->cnt;
 	ring->cnt = 0;
 	size_t nextLink = 0;
 
-	// Handle the closed ways (single way forms a cycle)
+	// The closed ways are rings by themselves
 	for(size_t i = 0; i < ways.cnt; i++) {
 		uint64_t firsti = ways.firstNode[i];
 		uint64_t lasti = i == ways.cnt-1 ? ways.nodesCnt-1 : ways.firstNode[i+1]-1;
 
+		if(lasti == firsti) {
+			// A single node doesn't connect anything
+			usedWays[i] = 1;
+			continue;
+		}
 		if(lasti - firsti < 2) continue;
 
 		uint64_t first = ways.nodes[firsti];
 		uint64_t last = ways.nodes[lasti];
 		if(first == last) {
-			assert(nextLink < ways.cnt);
 			ring->links[nextLink] = (struct link){
 				.way = i,
-				.direction = 1 // @INCOMPLETE: We need to calculate the direction here
+				.direction = -1,
 			};
 			usedWays[i] = 1;
-			remain--;
-			assert(ring->cnt < maxRings);
+			if(ring->cnt >= maxRings) abort();
 			ring->firstLink[ring->cnt] = nextLink;
 			nextLink++;
 			ring->cnt++;
 		}
 	}
 
-	if(remain == 0) return 0;
-
-	// Rings that require connecting multiple cycles
-
-	// Find the leftmost node
-	size_t minI = 0;
-	{
-		uint64_t minX = -1;
-		size_t way = 0;
-		for(size_t wi = 0; wi < ways.nodesCnt; wi++) {
-			while(way+1 < ways.cnt && ways.firstNode[way+1] <= wi) way++;
-			printf("Check %ld of way %ld\n", wi, way);
-			if(usedWays[way]) continue;
-			printf("No skip\n");
-
-			size_t i = ways.nodes[wi];
-			if(minX == -1 || nodes.nodes[i].x < minX) {
-				minI = i;
-				minX = nodes.nodes[i].x;
-			}
-		}
+	// Every step of the walk looks up the ways that end in the node it got
+	// to
+	struct endMap ends;
+	endmap_init(&ends, ways.cnt);
+	for(size_t i = 0; i < ways.cnt; i++) {
+		if(usedWays[i]) continue;
+		endmap_put(&ends, ways.nodes[endOfWay(ways, i, 1)], i, -1);
+		endmap_put(&ends, ways.nodes[endOfWay(ways, i, -1)], i, 1);
 	}
-	printf("%ld is the leftmost node\n", minI);
-
-	double minangle = DBL_MAX;
-	size_t minWay;
-	int direction;
-
-	// Find the leftmost way (and direction) in the counterclockwise winding order
-	size_t way = 0;
-	for(size_t i = 0; i < ways.nodesCnt; i++) {
-		if(ways.nodes[i] == minI) {
-			printf("%ld == %ld at position %ld\n", minI, ways.nodes[i], i);
-			// Skip to the current way
-			while(way+1 < ways.cnt && ways.firstNode[way+1] <= i) way++;
-			if(ways.firstNode[way] < i) {
-				// Check negative direction
-				size_t nodei = ways.nodes[i-1];
-				struct node* node = &nodes.nodes[nodei];
-				float localx = node->x - nodes.nodes[minI].x;
-				float localy = node->y - nodes.nodes[minI].y;
-				double angle = fmod(0 - pseudoangle(localx, localy), 4);
-
-				if(angle < minangle) {
-					printf("New min angle %f\n", angle);
-					minangle = angle;
-					minWay = way;
-					direction = -1;
-				}
-			}
 
-			if((way+1 < ways.cnt && i < ways.firstNode[way+1]) || i+1 < ways.nodesCnt) {
-				// Check positive direction
-				size_t nodei = ways.nodes[i+1];
-				struct node* node = &nodes.nodes[nodei];
-				float localx = node->x - nodes.nodes[minI].x;
-				float localy = node->y - nodes.nodes[minI].y; double angle = fmod(0 - pseudoangle(localx, localy), 4);
-
-				if(angle < minangle) {
-					printf("New min angle %f\n", angle);
-					minangle = angle;
-					minWay = way;
-					direction = 1;
-				}
-			}
-		}
-	}
+	// Connect the open ways into rings
+	for(size_t i = 0; i < ways.cnt; i++) {
+		if(usedWays[i]) continue;
 
-	{
-		assert(nextLink < ways.cnt);
-		ring->links[nextLink] = (struct link){
-			.way = minWay,
-			.direction = direction,
-		};
-		assert(ring->cnt < maxRings);
+		size_t linkCnt = walkRing(nodes, ways, &ends, usedWays, i, ring->links + nextLink);
+		if(linkCnt == 0) {
+			// The ways of a ring that doesn't close are left out
+			rc = -1;
+			continue;
+		}
+		if(ring->cnt >= maxRings) abort();
 		ring->firstLink[ring->cnt] = nextLink;
-		nextLink++;
+		nextLink += linkCnt;
 		ring->cnt++;
 	}
+	free(ends.ends);
+	free(usedWays);
 
-	// Notice that we reverse the direction since we want the opposite end than the one we are going to walk
-	size_t begin;
-	{
-		size_t nodei = endOfWay(ways, minWay, -direction);;
-		begin = ways.nodes[nodei];
-	}
+	// Find the area and bounds of every ring
+	struct vertex *vertices = malloc(sizeof(struct vertex) * (ways.nodesCnt + 1));
+	struct ringShape *shapes = malloc(sizeof(struct ringShape) * (ring->cnt + 1));
+	struct areaOrder *order = malloc(sizeof(struct areaOrder) * (ring->cnt + 1));
+	size_t *parents = malloc(sizeof(size_t) * (ring->cnt + 1));
+	bool *inner = malloc(sizeof(bool) * (ring->cnt + 1));
+	struct link *linkScratch = malloc(sizeof(struct link) * (nextLink + 1));
+	if(vertices == NULL || shapes == NULL || order == NULL || parents == NULL || inner == NULL || linkScratch == NULL) abort();
 
-	// Follow the way around to build a ring
+	size_t vertexCnt = 0;
+	for(size_t r = 0; r < ring->cnt; r++) {
+		size_t firstLink = ring->firstLink[r];
+		size_t linkCnt = (r+1 < ring->cnt ? ring->firstLink[r+1] : nextLink) - firstLink;
+		struct ringShape *shape = &shapes[r];
+		shape->firstVertex = vertexCnt;
+		shape->vertexCnt = ringVertices(nodes, ways, ring->links + firstLink, linkCnt, vertices + vertexCnt);
+		vertexCnt += shape->vertexCnt;
+		shapeOf(vertices + shape->firstVertex, shape->vertexCnt, shape);
 
-	while(1) {
-		printf("We pick way %lu in direction %d\n", minWay, direction);
-		usedWays[minWay] = 1;
-
-		size_t nnode;
-		double refAngle;
-		{
-			size_t endi = endOfWay(ways, minWay, direction);
-			nnode = ways.nodes[endi];
-			size_t lnode = ways.nodes[endi + direction];
-
-			float localx = nodes.nodes[lnode].x - nodes.nodes[nnode].x;
-			float localy = nodes.nodes[lnode].y - nodes.nodes[nnode].y;
-			refAngle = fmod(0 - pseudoangle(localx, localy), 4);
-		}
+		order[r] = (struct areaOrder){
+			.area = fabs(shape->area),
+			.ring = r,
+		};
+	}
 
-		// If we return to the start the ring is complete
-		if(nnode == begin) break;
+	// A ring can only be inside of a bigger one, so with the rings sorted by
+	// area the parent is the last ring before it that contains it.
+	qsort(order, ring->cnt, sizeof(struct areaOrder), areacmp);
+	struct ringGrid grid;
+	ringgrid_build(&grid, shapes, order, ring->cnt);
+	for(size_t k = 0; k < ring->cnt; k++) {
+		size_t r = order[k].ring;
+		const struct ringShape *shape = &shapes[r];
+		const struct vertex *v = vertices + shape->firstVertex;
+		// Rings can share their nodes, the middle of an edge is less likely
+		// to be on the other ring
+		double x = (v[0].x + v[1 % shape->vertexCnt].x) / 2;
+		double y = (v[0].y + v[1 % shape->vertexCnt].y) / 2;
 
-		double minAngle = DBL_MAX;
-		size_t nextWay = 0;
-		size_t nextDirection = 0;
-		printf("Fetch angles for neighbours to %ld\n", nnode);
-		for(size_t i = 0; i < ways.cnt; i++) {
-			if(usedWays[i]) continue;
-
-			{ // Forwards
-				size_t endi = endOfWay(ways, i, 1);
-				if(ways.nodes[endi] == nnode) {
-					size_t lnode = ways.nodes[endi+1];
-					float localx = nodes.nodes[lnode].x - nodes.nodes[nnode].x;
-					float localy = nodes.nodes[lnode].y - nodes.nodes[nnode].y;
-					double angle = fmod(refAngle - pseudoangle(localx, localy), 4);
-					if(angle < minAngle) {
-						nextWay = i;
-						nextDirection = -1;
-					}
-				}
+		parents[r] = RING_NO_PARENT;
+		inner[r] = false;
+
+		// The rings whose bounds cover the cell of the point, and the ones
+		// too big to be put in cells, both in sorted order. Walk them back
+		// from k together.
+		size_t cell = ringgrid_cell(&grid, x, y);
+		const size_t *cellRings = grid.cellRings + grid.cellStart[cell];
+		size_t ci = below(cellRings, grid.cellStart[cell+1] - grid.cellStart[cell], k);
+		size_t bi = below(grid.bigRings, grid.bigCnt, k);
+		while(ci > 0 || bi > 0) {
+			size_t j;
+			if(bi == 0 || (ci > 0 && cellRings[ci-1] > grid.bigRings[bi-1])) {
+				j = cellRings[--ci];
+			} else {
+				j = grid.bigRings[--bi];
 			}
 
-			{ // Backwards
-				size_t endi = endOfWay(ways, i, -1);
-				if(ways.nodes[endi] == nnode) {
-					size_t lnode = ways.nodes[endi-1];
-					float localx = nodes.nodes[lnode].x - nodes.nodes[nnode].x;
-					float localy = nodes.nodes[lnode].y - nodes.nodes[nnode].y;
-					double angle = fmod(refAngle - pseudoangle(localx, localy), 4);
-					if(angle < minAngle) {
-						nextWay = i;
-						nextDirection = 1;
-					}
-				}
+			// Rings of the same size can't be inside each other
+			if(order[j].area <= order[k].area) continue;
+			size_t p = order[j].ring;
+			const struct ringShape *pshape = &shapes[p];
+			if(shape->minX < pshape->minX || shape->maxX > pshape->maxX
+					|| shape->minY < pshape->minY || shape->maxY > pshape->maxY) {
+				continue;
+			}
+			if(insideRing(vertices + pshape->firstVertex, pshape->vertexCnt, x, y)) {
+				parents[r] = p;
+				inner[r] = !inner[p];
+				break;
 			}
 		}
-		minWay = nextWay;
-		direction = nextDirection;
+	}
+	ringgrid_kill(&grid);
 
-		{
-			assert(nextLink < ways.cnt);
-			ring->links[nextLink] = (struct link){
-				.way = minWay,
-				.direction = direction,
-			};
-			nextLink++;
+	// Outer rings go counterclockwise and inner rings clockwise
+	for(size_t r = 0; r < ring->cnt; r++) {
+		size_t firstLink = ring->firstLink[r];
+		size_t linkCnt = (r+1 < ring->cnt ? ring->firstLink[r+1] : nextLink) - firstLink;
+		bool ccw = shapes[r].area > 0;
+		if(ccw == inner[r]) {
+			reverseLinks(ring->links + firstLink, linkCnt);
 		}
+		rotateLinks(nodes, ways, ring->links + firstLink, linkCnt, linkScratch);
+
+		if(ring->parent != NULL) ring->parent[r] = parents[r];
+		if(ring->inner != NULL) ring->inner[r] = inner[r];
 	}
 
-	return 0;
+	free(linkScratch);
+	free(inner);
+	free(parents);
+	free(order);
+	free(shapes);
+	free(vertices);
+	return rc;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -24,15 +25,32 @@ struct ways {
 
 struct link {
 	size_t way;
-	// -1 for clockwise, 1 for anticlockwise
+	// -1 walks the way from its first node to its last, 1 from the last to
+	// the first
 	int8_t direction;
 };
 
+#define RING_NO_PARENT SIZE_MAX
+
 struct ring {
+	// Room for a link per way
 	struct link *links;
 	// The index of the first link in a ring.
 	uint64_t *firstLink;
+	// The room in firstLink going in, the number of rings found coming out
 	size_t cnt;
+
+	// Optional, one per ring: the ring it's directly inside of or
+	// RING_NO_PARENT
+	size_t *parent;
+	// Optional, one per ring: true for the holes, the rings nested an odd
+	// number of levels deep
+	bool *inner;
 };
 
+// Assemble the ways into rings. Outer rings wind counterclockwise and holes
+// clockwise, every ring starts with the link that arrives at its leftmost
+// junction. Ways that don't close into a ring are left out, and -1 is
+// returned. Nothing is kept between calls, relations can be assembled on
+// several threads at once.
 int rings_find(struct nodes nodes, struct ways ways, struct ring *ring);
@@ -0,0 +1,166 @@
+#include "search.h"
+
+#include "log.h"
+
+#include <assert.h>
+
+size_t binSearch(uint64_t *data, size_t elemSize, size_t elemCnt, uint64_t needle) {
+	assert(elemSize == sizeof(uint64_t));
+
+	size_t low = 0;
+	size_t high = elemCnt - 1;
+
+	while(low <= high) {
+		size_t pivot = (high + low) / 2;
+		uint64_t elem = data[pivot];
+		if(elem == needle) {
+			return pivot;
+		} else if(elem > needle) {
+			high = pivot - 1;
+		} else {
+			low = pivot + 1;
+		}
+	}
+
+	LOG_DEBUG(LOGCAT_SEARCH, "BAIL on %lu signed %ld\n", needle, (uint64_t)needle);
+	return high + 1;
+}
+
+// Count the segments the ids span and how many of them are dense
+static void idsegments_count(const uint64_t *ids, size_t idCnt, uint64_t *segmentCnt, uint64_t *directCnt) {
+	*segmentCnt = 0;
+	*directCnt = 0;
+	if(idCnt == 0) return;
+
+	*segmentCnt = (ids[idCnt-1] >> ID_SEGMENT_BITS) - (ids[0] >> ID_SEGMENT_BITS) + 1;
+	size_t begin = 0;
+	while(begin < idCnt) {
+		uint64_t segment = ids[begin] >> ID_SEGMENT_BITS;
+		size_t end = begin;
+		while(end < idCnt && ids[end] >> ID_SEGMENT_BITS == segment) end++;
+		if(end - begin >= ID_DIRECT_MIN_IDS) (*directCnt)++;
+		begin = end;
+	}
+}
+
+size_t idsegments_size(const uint64_t *ids, size_t idCnt) {
+	uint64_t segmentCnt, directCnt;
+	idsegments_count(ids, idCnt, &segmentCnt, &directCnt);
+
+	// When there's on average less than an id per segment the table would
+	// mostly describe empty segments
+	if(segmentCnt == 0 || segmentCnt > idCnt) return 0;
+
+	return sizeof(struct idSegmentsHeader)
+		+ sizeof(struct idSegment) * (segmentCnt + 1)
+		+ sizeof(uint16_t) * ID_SEGMENT_SPAN * directCnt;
+}
+
+void idsegments_build(const uint64_t *ids, size_t idCnt, void *buf) {
+	struct idSegmentsHeader *header = buf;
+	idsegments_count(ids, idCnt, &header->segmentCnt, &header->directCnt);
+	assert(header->segmentCnt > 0);
+	header->firstSegment = ids[0] >> ID_SEGMENT_BITS;
+
+	struct idSegment *segments = (struct idSegment*)(header + 1);
+	uint16_t *direct = (uint16_t*)(segments + header->segmentCnt + 1);
+
+	size_t slot = 0;
+	uint32_t directi = 0;
+	for(uint64_t i = 0; i < header->segmentCnt; i++) {
+		uint64_t segment = header->firstSegment + i;
+		size_t end = slot;
+		while(end < idCnt && ids[end] >> ID_SEGMENT_BITS == segment) end++;
+
+		segments[i] = (struct idSegment){
+			.firstSlot = slot,
+			.direct = ID_DIRECT_NONE,
+		};
+		if(end - slot >= ID_DIRECT_MIN_IDS) {
+			uint16_t *table = direct + (size_t)directi * ID_SEGMENT_SPAN;
+			for(size_t j = 0; j < ID_SEGMENT_SPAN; j++) {
+				table[j] = ID_SLOT_NONE;
+			}
+			for(size_t j = slot; j < end; j++) {
+				table[ids[j] & (ID_SEGMENT_SPAN - 1)] = j - slot;
+			}
+			segments[i].direct = directi++;
+		}
+		slot = end;
+	}
+	segments[header->segmentCnt] = (struct idSegment){
+		.firstSlot = slot,
+		.direct = ID_DIRECT_NONE,
+	};
+	assert(slot == idCnt);
+	assert(directi == header->directCnt);
+}
+
+bool idindex_init(struct idIndex *index, uint64_t *ids, size_t idCnt, const void *segments, size_t size) {
+	*index = (struct idIndex){
+		.ids = ids,
+		.idCnt = idCnt,
+	};
+	if(segments == NULL) return true;
+
+	const struct idSegmentsHeader *header = segments;
+	if(size < sizeof(struct idSegmentsHeader)) return false;
+	size_t expected = sizeof(struct idSegmentsHeader)
+		+ sizeof(struct idSegment) * (header->segmentCnt + 1)
+		+ sizeof(uint16_t) * ID_SEGMENT_SPAN * header->directCnt;
+	if(size != expected) return false;
+
+	index->firstSegment = header->firstSegment;
+	index->segmentCnt = header->segmentCnt;
+	index->segments = (const struct idSegment*)(header + 1);
+	index->direct = (const uint16_t*)(index->segments + header->segmentCnt + 1);
+	if(index->segments[index->segmentCnt].firstSlot != idCnt) return false;
+	return true;
+}
+
+size_t idindex_find(const struct idIndex *index, uint64_t needle) {
+	if(index->segmentCnt == 0) {
+		return binSearch(index->ids, sizeof(uint64_t), index->idCnt, needle);
+	}
+
+	uint64_t segment = (needle >> ID_SEGMENT_BITS) - index->firstSegment;
+	if(needle >> ID_SEGMENT_BITS < index->firstSegment) {
+		segment = 0;
+	} else if(segment >= index->segmentCnt) {
+		LOG_DEBUG(LOGCAT_SEARCH, "BAIL on %lu signed %ld\n", needle, (uint64_t)needle);
+		return index->idCnt;
+	}
+
+	const struct idSegment *seg = &index->segments[segment];
+	if(seg->direct != ID_DIRECT_NONE) {
+		uint16_t slot = index->direct[(size_t)seg->direct * ID_SEGMENT_SPAN + (needle & (ID_SEGMENT_SPAN - 1))];
+		if(slot != ID_SLOT_NONE) {
+			return seg->firstSlot + slot;
+		}
+	}
+
+	// Search the ids of the segment, the direct tables don't know where
+	// missing ids would go
+	size_t low = seg->firstSlot;
+	size_t high = (seg+1)->firstSlot;
+	while(low < high) {
+		size_t pivot = low + (high - low) / 2;
+		if(index->ids[pivot] < needle) {
+			low = pivot + 1;
+		} else {
+			high = pivot;
+		}
+	}
+	if(low < index->idCnt && index->ids[low] == needle) {
+		return low;
+	}
+
+	LOG_DEBUG(LOGCAT_SEARCH, "BAIL on %lu signed %ld\n", needle, (uint64_t)needle);
+	return low;
+}
+
+void lookupIds(uint64_t *needles, size_t needleCnt, const struct idIndex *index, size_t *pos) {
+	for (size_t i = 0; i < needleCnt; i++) {
+		pos[i] = idindex_find(index, needles[i]);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+size_t binSearch(uint64_t *data, size_t elemSize, size_t elemCnt, uint64_t needle);
+
+// The id space is cut into segments of ID_SEGMENT_SPAN consecutive ids. Where
+// a segment is dense enough a direct table maps the id to its slot with a
+// single load, elsewhere the segment table at least narrows the binary search
+// down to the ids in the segment.
+#define ID_SEGMENT_BITS 12
+#define ID_SEGMENT_SPAN (1 << ID_SEGMENT_BITS)
+// A direct table takes 2 bytes per id in the span, so it's used once it's no
+// bigger than the ids it covers.
+#define ID_DIRECT_MIN_IDS (ID_SEGMENT_SPAN * sizeof(uint16_t) / sizeof(uint64_t))
+
+#define ID_DIRECT_NONE UINT32_MAX
+#define ID_SLOT_NONE UINT16_MAX
+
+struct idSegmentsHeader {
+	uint64_t firstSegment;
+	uint64_t segmentCnt;
+	uint64_t directCnt;
+};
+
+struct idSegment {
+	// The slot of the first id in the segment (or where it would be)
+	uint64_t firstSlot;
+	// Which direct table, or ID_DIRECT_NONE
+	uint32_t direct;
+	uint32_t pad;
+};
+
+// The segment table file is the header, followed by segmentCnt+1 segments
+// (the last one just ends the one before) and the direct tables.
+struct idIndex {
+	uint64_t *ids;
+	size_t idCnt;
+
+	// segmentCnt is 0 without a segment table
+	uint64_t firstSegment;
+	uint64_t segmentCnt;
+	const struct idSegment *segments;
+	const uint16_t *direct;
+};
+
+// The size of the segment table for the sorted ids, or 0 when the ids are too
+// sparse for one to pay off.
+size_t idsegments_size(const uint64_t *ids, size_t idCnt);
+// Fill in the segment table, buf must be idsegments_size bytes
+void idsegments_build(const uint64_t *ids, size_t idCnt, void *buf);
+
+// Set up an index over the sorted ids, with a segment table of size bytes or
+// none when it's NULL. Returns false if the table doesn't fit the ids.
+bool idindex_init(struct idIndex *index, uint64_t *ids, size_t idCnt, const void *segments, size_t size);
+size_t idindex_find(const struct idIndex *index, uint64_t needle);
+
+void lookupIds(uint64_t *needles, size_t needleCnt, const struct idIndex *index, size_t *pos);
@@ -0,0 +1,123 @@
+#include "trace.h"
+
+#ifdef TRACE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Events per thread. When a thread records more than this the oldest events
+// are overwritten.
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+struct traceEvent {
+	const char *name;
+	uint64_t ts;
+	char phase;
+};
+
+// Every thread only ever writes to its own buffer, so recording needs no
+// locks. The buffers are pushed onto a global list the first time a thread
+// records something, and read back when the process exits.
+struct traceBuffer {
+	struct traceBuffer *next;
+	uint64_t tid;
+	uint64_t head;
+	struct traceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+static struct traceBuffer *buffers;
+static uint64_t nextTid = 1;
+static uint64_t traceStart;
+static _Thread_local struct traceBuffer *localBuffer;
+
+static uint64_t clockNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct traceBuffer *trace_buffer() {
+	if(localBuffer != NULL) return localBuffer;
+
+	struct traceBuffer *buffer = malloc(sizeof(struct traceBuffer));
+	if(buffer == NULL) abort();
+	buffer->tid = __atomic_fetch_add(&nextTid, 1, __ATOMIC_RELAXED);
+	buffer->head = 0;
+
+	buffer->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&buffers, &buffer->next, buffer, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	localBuffer = buffer;
+	return buffer;
+}
+
+static void trace_record(const char *name, char phase) {
+	struct traceBuffer *buffer = trace_buffer();
+	uint64_t head = buffer->head;
+	buffer->events[head % TRACE_BUFFER_EVENTS] = (struct traceEvent){
+		.name = name,
+		.ts = clockNs(),
+		.phase = phase,
+	};
+	// Publish the event for the flush
+	__atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_begin(const char *name) {
+	trace_record(name, 'B');
+}
+
+void trace_end(const char *name) {
+	trace_record(name, 'E');
+}
+
+static void trace_flush() {
+	const char *path = getenv(TRACE_ENV);
+	if(path == NULL || path[0] == '\0') path = TRACE_DEFAULT_PATH;
+	FILE *out = fopen(path, "w");
+	if(out == NULL) {
+		fprintf(stderr, "Could not write trace to %s\n", path);
+		return;
+	}
+
+	int pid = getpid();
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	bool first = true;
+	struct traceBuffer *buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+	while(buffer != NULL) {
+		uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+
+		// If the buffer wrapped we may have lost the begin of some spans.
+		// Their ends are dropped, unmatched ends confuse the viewers.
+		size_t depth = 0;
+		for(uint64_t i = tail; i < head; i++) {
+			struct traceEvent *event = &buffer->events[i % TRACE_BUFFER_EVENTS];
+			if(event->phase == 'B') {
+				depth++;
+			} else {
+				if(depth == 0) continue;
+				depth--;
+			}
+			fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%lu}",
+					first ? "" : ",", event->name, event->phase,
+					(event->ts - traceStart) / 1e3, pid, buffer->tid);
+			first = false;
+		}
+
+		buffer = buffer->next;
+	}
+	fprintf(out, "\n]}\n");
+	fclose(out);
+}
+
+void trace_init() {
+	traceStart = clockNs();
+	atexit(trace_flush);
+}
+
+#endif
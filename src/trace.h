@@ -0,0 +1,31 @@
+#pragma once
+
+// Timeline tracing of the pipeline, written in the Chrome trace event format
+// so it can be opened in chrome://tracing or ui.perfetto.dev. Spans are only
+// recorded when compiled with TRACE defined (make TRACE=1), otherwise the
+// macros expand to nothing.
+//
+// The trace is written when the process exits, to the file named by TRACE_ENV
+// or to TRACE_DEFAULT_PATH.
+#define TRACE_ENV "INDEX_TRACE"
+#define TRACE_DEFAULT_PATH "trace.json"
+
+#ifdef TRACE
+
+// Names are kept by pointer, they have to outlive the process (string
+// literals).
+void trace_init();
+void trace_begin(const char *name);
+void trace_end(const char *name);
+
+#define TRACE_INIT() trace_init()
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END(name) trace_end(name)
+
+#else
+
+#define TRACE_INIT() do { } while(0)
+#define TRACE_BEGIN(name) do { } while(0)
+#define TRACE_END(name) do { } while(0)
+
+#endif
@@ -0,0 +1,15 @@
+#include "tvec.h"
+
+static void *heap_grow(void *userdata, void *ptr, size_t oldSize, size_t newSize) {
+	return realloc(ptr, newSize);
+}
+
+static void heap_release(void *userdata, void *ptr, size_t size) {
+	free(ptr);
+}
+
+const struct tvecAllocator tvec_heap = {
+	.grow = heap_grow,
+	.release = heap_release,
+	.userdata = NULL,
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Typed vectors. TVEC(name, type, inlineCnt) defines struct name and its
+// functions name_push, name_get and so on, specialized for the element type.
+// The first inlineCnt elements live inside the struct itself, so small
+// vectors never touch the allocator. TVEC_SCALAR is for integer element
+// types, it additionally defines find, and fills a lane vector at a time.
+//
+// Elements are copied with memcpy, so types with const members work too. The
+// vector can be moved around by value as long as it's not being used at
+// the same time, nothing points into the struct itself.
+
+struct tvecAllocator {
+	// Like realloc, ptr is NULL for a fresh allocation. Returns NULL on
+	// failure
+	void *(*grow)(void *userdata, void *ptr, size_t oldSize, size_t newSize);
+	void (*release)(void *userdata, void *ptr, size_t size);
+	void *userdata;
+};
+
+// malloc/realloc/free, used when a vector is initialized with a NULL allocator
+extern const struct tvecAllocator tvec_heap;
+
+// Bytes compared or written at once by find and fill of TVEC_SCALAR. That's
+// an SSE2 register, wider vectors are split up element by element by the
+// compiler when it can't assume AVX
+#define TVEC_LANE_BYTES 16
+// Lane vectors find compares before checking for a match
+#define TVEC_FIND_UNROLL 8
+
+// A lane vector viewed as 64 or 32 bit words, to test compare masks
+typedef uint64_t tvec_words __attribute__((vector_size(TVEC_LANE_BYTES)));
+typedef uint32_t tvec_halves __attribute__((vector_size(TVEC_LANE_BYTES)));
+
+// Everything but fill, which TVEC and TVEC_SCALAR define their own way
+#define TVEC_COMMON(name, type, inlineCnt) \
+	struct name { \
+		size_t size; \
+		size_t cap; \
+		/* NULL while the elements fit inline */ \
+		type *heap; \
+		const struct tvecAllocator *alloc; \
+		type inlineData[(inlineCnt) > 0 ? (inlineCnt) : 1]; \
+	}; \
+	\
+	static inline void name##_init(struct name *v, const struct tvecAllocator *alloc) { \
+		v->size = 0; \
+		v->cap = (inlineCnt) > 0 ? (inlineCnt) : 0; \
+		v->heap = NULL; \
+		v->alloc = alloc != NULL ? alloc : &tvec_heap; \
+	} \
+	\
+	static inline void name##_kill(struct name *v) { \
+		if(v->heap != NULL) { \
+			v->alloc->release(v->alloc->userdata, v->heap, v->cap * sizeof(type)); \
+		} \
+		v->heap = NULL; \
+		v->size = 0; \
+		v->cap = 0; \
+	} \
+	\
+	static inline type *name##_data(struct name *v) { \
+		return v->heap != NULL ? v->heap : v->inlineData; \
+	} \
+	\
+	static inline void name##_grow(struct name *v, size_t cap) { \
+		size_t newCap = v->cap > 0 ? v->cap : 8; \
+		while(newCap < cap) newCap *= 2; \
+		size_t oldSize = v->heap != NULL ? v->cap * sizeof(type) : 0; \
+		type *mem = v->alloc->grow(v->alloc->userdata, v->heap, oldSize, newCap * sizeof(type)); \
+		if(mem == NULL) abort(); \
+		if(v->heap == NULL) { \
+			memcpy(mem, v->inlineData, v->size * sizeof(type)); \
+		} \
+		v->heap = mem; \
+		v->cap = newCap; \
+	} \
+	\
+	/* Make room for cnt more elements and return them, uninitialized */ \
+	static inline type *name##_reserve(struct name *v, size_t cnt) { \
+		if(v->size + cnt > v->cap) name##_grow(v, v->size + cnt); \
+		type *dest = name##_data(v) + v->size; \
+		v->size += cnt; \
+		return dest; \
+	} \
+	\
+	static inline void name##_push(struct name *v, type elem) { \
+		if(v->size == v->cap) name##_grow(v, v->size + 1); \
+		memcpy(&name##_data(v)[v->size++], &elem, sizeof(type)); \
+	} \
+	\
+	static inline void name##_pushList(struct name *v, const type *list, size_t cnt) { \
+		memcpy(name##_reserve(v, cnt), list, cnt * sizeof(type)); \
+	} \
+	\
+	static inline type *name##_get(struct name *v, size_t i) { \
+		return &name##_data(v)[i]; \
+	} \
+	\
+	static inline void name##_clear(struct name *v) { \
+		v->size = 0; \
+	} \
+	\
+	/* Keeps the order */ \
+	static inline void name##_remove(struct name *v, size_t i) { \
+		type *data = name##_data(v); \
+		memmove(&data[i], &data[i+1], (v->size - i - 1) * sizeof(type)); \
+		v->size--; \
+	} \
+	\
+	/* O(1), the last element takes the place of the removed one */ \
+	static inline void name##_swapRemove(struct name *v, size_t i) { \
+		type *data = name##_data(v); \
+		memcpy(&data[i], &data[v->size - 1], sizeof(type)); \
+		v->size--; \
+	} \
+	\
+	/* Move the element at old to new, shifting the ones in between */ \
+	static inline void name##_circulate(struct name *v, size_t old, size_t new) { \
+		type *data = name##_data(v); \
+		type tmp; \
+		memcpy(&tmp, &data[old], sizeof(type)); \
+		if(old < new) { \
+			memmove(&data[old], &data[old+1], (new - old) * sizeof(type)); \
+		} else { \
+			memmove(&data[new+1], &data[new], (old - new) * sizeof(type)); \
+		} \
+		memcpy(&data[new], &tmp, sizeof(type)); \
+	}
+
+#define TVEC(name, type, inlineCnt) \
+	TVEC_COMMON(name, type, inlineCnt) \
+	\
+	static inline void name##_fill(struct name *v, type value) { \
+		type *data = name##_data(v); \
+		for(size_t i = 0; i < v->size; i++) { \
+			memcpy(&data[i], &value, sizeof(type)); \
+		} \
+	}
+
+#define TVEC_SCALAR(name, type, inlineCnt) \
+	TVEC_COMMON(name, type, inlineCnt) \
+	\
+	typedef type name##_lanes __attribute__((vector_size(TVEC_LANE_BYTES))); \
+	\
+	/* Writes a whole lane vector at a time */ \
+	static inline void name##_fill(struct name *v, type value) { \
+		type *data = name##_data(v); \
+		const size_t lanes = TVEC_LANE_BYTES / sizeof(type); \
+		name##_lanes splat = (name##_lanes){ 0 } + value; \
+		size_t i = 0; \
+		for(; i + lanes <= v->size; i += lanes) { \
+			memcpy(&data[i], &splat, sizeof(splat)); \
+		} \
+		for(; i < v->size; i++) { \
+			data[i] = value; \
+		} \
+	} \
+	\
+	/* The index of the first element equal to value, or SIZE_MAX. Compares \
+	 * TVEC_FIND_UNROLL lane vectors at a time and ORs their masks, the block \
+	 * with the match is then searched element by element */ \
+	static inline size_t name##_find(struct name *v, type value) { \
+		const type *data = name##_data(v); \
+		const size_t block = TVEC_FIND_UNROLL * (TVEC_LANE_BYTES / sizeof(type)); \
+		name##_lanes needle = (name##_lanes){ 0 } + value; \
+		size_t i = 0; \
+		for(; i + block <= v->size; i += block) { \
+			tvec_words hits = { 0 }; \
+			for(size_t c = 0; c < TVEC_FIND_UNROLL; c++) { \
+				name##_lanes chunk; \
+				memcpy(&chunk, &data[i + c * (TVEC_LANE_BYTES / sizeof(type))], sizeof(chunk)); \
+				if(sizeof(type) == sizeof(uint64_t)) { \
+					/* Without SSE4.1 there's no 64 bit compare, the halves are \
+					 * compared on their own and both have to match */ \
+					tvec_words eq = (tvec_words)((tvec_halves)chunk == (tvec_halves)needle); \
+					hits |= eq & (eq >> 32); \
+				} else { \
+					hits |= (tvec_words)(chunk == needle); \
+				} \
+			} \
+			uint64_t any = 0; \
+			for(size_t w = 0; w < TVEC_LANE_BYTES / sizeof(uint64_t); w++) { \
+				any |= hits[w]; \
+			} \
+			if(any != 0) break; \
+		} \
+		for(; i < v->size; i++) { \
+			if(data[i] == value) return i; \
+		} \
+		return SIZE_MAX; \
+	}
+
+TVEC_SCALAR(u64vec, uint64_t, 16)
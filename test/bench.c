@@ -0,0 +1,510 @@
+#include "libtest.h"
+
+#include "pbf.h"
+#include "reorder.h"
+#include "ring.h"
+#include "search.h"
+#include "tvec.h"
+#include "vector.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Deterministic input, so runs are comparable
+static uint64_t rngState;
+static void rng_seed(uint64_t seed) {
+	rngState = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+static uint64_t rng_next() {
+	// xorshift64*
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return rngState * 0x2545F4914F6CDD1DULL;
+}
+
+// A random permutation of 0..n-1 in from-index form
+static uint64_t* randomPermutation(size_t n) {
+	uint64_t *from = malloc(sizeof(uint64_t) * n);
+	if(from == NULL) return NULL;
+
+	for(size_t i = 0; i < n; i++) {
+		from[i] = i;
+	}
+	for(size_t i = n-1; i > 0; i--) {
+		size_t j = rng_next() % (i+1);
+		uint64_t tmp = from[i];
+		from[i] = from[j];
+		from[j] = tmp;
+	}
+	return from;
+}
+
+static void permuteElems(struct Bench* bench, size_t elemSize) {
+	rng_seed(1);
+	uint64_t *from = randomPermutation(bench->n);
+	void *data = malloc(elemSize * bench->n);
+	if(from == NULL || data == NULL) {
+		free(from);
+		free(data);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+	memset(data, 0xAB, elemSize * bench->n);
+
+	bench->elements = bench->n;
+	bench->bytes = elemSize * bench->n;
+
+	// Applying it again just permutes the already permuted data, the work is
+	// the same.
+	char scratch[64];
+	while(bench_next(bench)) {
+		permuteFrom(from, data, elemSize, bench->n, scratch);
+	}
+	bench_keep(data);
+
+	free(data);
+	free(from);
+}
+
+void permuteFrom_uint64(struct Bench* bench) {
+	permuteElems(bench, sizeof(uint64_t));
+}
+
+// The size of a pbfPtr
+void permuteFrom_24byte(struct Bench* bench) {
+	permuteElems(bench, 24);
+}
+
+// What build does for every index, ids and ptrs gathered together
+void permuteArrays_idsAndPtrs(struct Bench* bench) {
+	rng_seed(1);
+	uint64_t *from = randomPermutation(bench->n);
+	uint64_t *ids = malloc(sizeof(uint64_t) * bench->n);
+	void *ptrs = malloc(24 * bench->n);
+	uint64_t *sortedIds = malloc(sizeof(uint64_t) * bench->n);
+	void *sortedPtrs = malloc(24 * bench->n);
+	if(from == NULL || ids == NULL || ptrs == NULL || sortedIds == NULL || sortedPtrs == NULL) {
+		free(from);
+		free(ids);
+		free(ptrs);
+		free(sortedIds);
+		free(sortedPtrs);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+	memset(ids, 0xAB, sizeof(uint64_t) * bench->n);
+	memset(ptrs, 0xAB, 24 * bench->n);
+
+	bench->elements = bench->n;
+	bench->bytes = (sizeof(uint64_t) + 24) * bench->n;
+
+	struct permuteArray arrays[] = {
+		{ .src = ids,  .dst = sortedIds,  .elemSize = sizeof(uint64_t) },
+		{ .src = ptrs, .dst = sortedPtrs, .elemSize = 24 },
+	};
+	while(bench_next(bench)) {
+		permuteArrays(from, bench->n, arrays, 2, 0);
+	}
+	bench_keep(sortedIds);
+	bench_keep(sortedPtrs);
+
+	free(sortedPtrs);
+	free(sortedIds);
+	free(ptrs);
+	free(ids);
+	free(from);
+}
+
+// What build does for every index now, ids and ptrs permuted in place
+void permuteArraysInPlace_idsAndPtrs(struct Bench* bench) {
+	rng_seed(1);
+	uint64_t *from = randomPermutation(bench->n);
+	uint64_t *ids = malloc(sizeof(uint64_t) * bench->n);
+	void *ptrs = malloc(24 * bench->n);
+	if(from == NULL || ids == NULL || ptrs == NULL) {
+		free(from);
+		free(ids);
+		free(ptrs);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+	memset(ids, 0xAB, sizeof(uint64_t) * bench->n);
+	memset(ptrs, 0xAB, 24 * bench->n);
+
+	bench->elements = bench->n;
+	bench->bytes = (sizeof(uint64_t) + 24) * bench->n;
+
+	struct permuteArray arrays[] = {
+		{ .dst = ids,  .elemSize = sizeof(uint64_t) },
+		{ .dst = ptrs, .elemSize = 24 },
+	};
+	while(bench_next(bench)) {
+		permuteArraysInPlace(from, bench->n, arrays, 2);
+	}
+	bench_keep(ids);
+	bench_keep(ptrs);
+
+	free(ptrs);
+	free(ids);
+	free(from);
+}
+
+void convertFromIntoTo_noDupes(struct Bench* bench) {
+	rng_seed(2);
+	uint64_t *from = randomPermutation(bench->n);
+	uint64_t *to = malloc(sizeof(uint64_t) * bench->n);
+	if(from == NULL || to == NULL) {
+		free(from);
+		free(to);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+
+	bench->elements = bench->n;
+	bench->bytes = sizeof(uint64_t) * bench->n;
+
+	while(bench_next(bench)) {
+		convertFromIntoTo(from, to, bench->n, NULL, 0);
+	}
+	bench_keep(to);
+
+	free(to);
+	free(from);
+}
+
+#define SEARCH_LOOKUPS 100000
+
+void binSearch_randomHits(struct Bench* bench) {
+	rng_seed(3);
+	uint64_t *ids = malloc(sizeof(uint64_t) * bench->n);
+	uint64_t *needles = malloc(sizeof(uint64_t) * SEARCH_LOOKUPS);
+	if(ids == NULL || needles == NULL) {
+		free(ids);
+		free(needles);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+
+	// Sorted ids with small gaps, like the node ids in an extract
+	uint64_t id = 1000;
+	for(size_t i = 0; i < bench->n; i++) {
+		id += 1 + rng_next() % 4;
+		ids[i] = id;
+	}
+	for(size_t i = 0; i < SEARCH_LOOKUPS; i++) {
+		needles[i] = ids[rng_next() % bench->n];
+	}
+
+	bench->elements = SEARCH_LOOKUPS;
+
+	while(bench_next(bench)) {
+		size_t sum = 0;
+		for(size_t i = 0; i < SEARCH_LOOKUPS; i++) {
+			sum += binSearch(ids, sizeof(uint64_t), bench->n, needles[i]);
+		}
+		bench_keep(sum);
+	}
+
+	free(needles);
+	free(ids);
+}
+
+// The same ids and lookups as binSearch_randomHits, through the segment table
+void idindex_find_randomHits(struct Bench* bench) {
+	rng_seed(3);
+	uint64_t *ids = malloc(sizeof(uint64_t) * bench->n);
+	uint64_t *needles = malloc(sizeof(uint64_t) * SEARCH_LOOKUPS);
+	if(ids == NULL || needles == NULL) {
+		free(ids);
+		free(needles);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+
+	uint64_t id = 1000;
+	for(size_t i = 0; i < bench->n; i++) {
+		id += 1 + rng_next() % 4;
+		ids[i] = id;
+	}
+	for(size_t i = 0; i < SEARCH_LOOKUPS; i++) {
+		needles[i] = ids[rng_next() % bench->n];
+	}
+
+	size_t size = idsegments_size(ids, bench->n);
+	void *segments = size != 0 ? malloc(size) : NULL;
+	if(size != 0 && segments == NULL) {
+		free(ids);
+		free(needles);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+	if(segments != NULL) idsegments_build(ids, bench->n, segments);
+	struct idIndex index;
+	idindex_init(&index, ids, bench->n, segments, size);
+
+	bench->elements = SEARCH_LOOKUPS;
+
+	while(bench_next(bench)) {
+		size_t sum = 0;
+		for(size_t i = 0; i < SEARCH_LOOKUPS; i++) {
+			sum += idindex_find(&index, needles[i]);
+		}
+		bench_keep(sum);
+	}
+
+	free(segments);
+	free(needles);
+	free(ids);
+}
+
+void readVarInt_deltaIds(struct Bench* bench) {
+	rng_seed(4);
+	// At most 10 bytes per varint
+	uint8_t *buf = malloc(10 * bench->n);
+	if(buf == NULL) {
+		bench_skip(bench, "out of memory");
+		return;
+	}
+
+	// Mostly small values with the occasional large one, like delta coded
+	// ids
+	size_t len = 0;
+	for(size_t i = 0; i < bench->n; i++) {
+		uint64_t r = rng_next();
+		uint64_t value = (r & 0xF) == 0 ? r >> 20 : r % 300;
+		do {
+			uint8_t byte = value & 0x7F;
+			value >>= 7;
+			buf[len++] = byte | (value != 0 ? 0x80 : 0);
+		} while(value != 0);
+	}
+
+	bench->elements = bench->n;
+	bench->bytes = len;
+
+	while(bench_next(bench)) {
+		struct pbfcursor data = {
+			.cursor = buf,
+			.end = buf + len,
+		};
+		uint64_t sum = 0;
+		while(data.cursor < data.end) {
+			sum += readVarInt(&data);
+		}
+		bench_keep(sum);
+	}
+
+	free(buf);
+}
+
+// Scans to the end, the needle isn't there
+void vector_find_uint64_miss(struct Bench* bench) {
+	Vector v;
+	vector_init(&v, sizeof(uint64_t), bench->n);
+	for(uint64_t i = 0; i < bench->n; i++) {
+		vector_putBack(&v, &i);
+	}
+
+	bench->elements = bench->n;
+	bench->bytes = sizeof(uint64_t) * bench->n;
+
+	while(bench_next(bench)) {
+		bench_keep(vector_find_uint64(&v, UINT64_MAX));
+	}
+
+	vector_kill(&v);
+}
+
+void u64vec_find_miss(struct Bench* bench) {
+	struct u64vec v;
+	u64vec_init(&v, NULL);
+	uint64_t *data = u64vec_reserve(&v, bench->n);
+	for(uint64_t i = 0; i < bench->n; i++) {
+		data[i] = i;
+	}
+
+	bench->elements = bench->n;
+	bench->bytes = sizeof(uint64_t) * bench->n;
+
+	while(bench_next(bench)) {
+		bench_keep(u64vec_find(&v, UINT64_MAX));
+	}
+
+	u64vec_kill(&v);
+}
+
+#define NODES_PER_WAY 10
+
+// A single ring of bench->n nodes on a circle, split into ways that share
+// their endpoints.
+void rings_find_singleRing(struct Bench* bench) {
+	size_t wayCnt = bench->n / (NODES_PER_WAY - 1);
+	if(wayCnt < 2) wayCnt = 2;
+	size_t nodeCnt = wayCnt * (NODES_PER_WAY - 1);
+
+	struct node *nodesData = malloc(sizeof(struct node) * nodeCnt);
+	uint64_t *firstNodes = malloc(sizeof(uint64_t) * wayCnt);
+	uint64_t *wayNodes = malloc(sizeof(uint64_t) * wayCnt * NODES_PER_WAY);
+	struct link *links = malloc(sizeof(struct link) * wayCnt);
+	uint64_t *firstLink = malloc(sizeof(uint64_t) * wayCnt);
+	if(nodesData == NULL || firstNodes == NULL || wayNodes == NULL || links == NULL || firstLink == NULL) {
+		free(nodesData);
+		free(firstNodes);
+		free(wayNodes);
+		free(links);
+		free(firstLink);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+
+	for(size_t i = 0; i < nodeCnt; i++) {
+		double angle = 2 * M_PI * i / nodeCnt;
+		nodesData[i] = (struct node){
+			.x = 1000 * cos(angle),
+			.y = 1000 * sin(angle),
+		};
+	}
+	size_t nodei = 0;
+	for(size_t w = 0; w < wayCnt; w++) {
+		firstNodes[w] = nodei;
+		for(size_t j = 0; j < NODES_PER_WAY; j++) {
+			wayNodes[nodei++] = (w * (NODES_PER_WAY - 1) + j) % nodeCnt;
+		}
+	}
+
+	struct nodes nodes = {
+		.nodes = nodesData,
+		.cnt = nodeCnt,
+	};
+	struct ways ways = {
+		.firstNode = firstNodes,
+		.cnt = wayCnt,
+		.nodes = wayNodes,
+		.nodesCnt = nodei,
+	};
+
+	bench->elements = nodeCnt;
+
+	while(bench_next(bench)) {
+		struct ring ring = {
+			.links = links,
+			.firstLink = firstLink,
+			.cnt = wayCnt,
+		};
+		rings_find(nodes, ways, &ring);
+		bench_keep(ring.cnt);
+	}
+
+	free(nodesData);
+	free(firstNodes);
+	free(wayNodes);
+	free(links);
+	free(firstLink);
+}
+
+// A square outer ring split into four ways, with a grid of square holes in it
+// of slightly different sizes, bench->n nodes in all.
+void rings_find_gridOfHoles(struct Bench* bench) {
+	size_t side = sqrt(bench->n / 5);
+	if(side < 1) side = 1;
+	size_t holeCnt = side * side;
+	size_t wayCnt = 4 + holeCnt;
+	size_t nodeCnt = 4 + holeCnt * 4;
+
+	struct node *nodesData = malloc(sizeof(struct node) * nodeCnt);
+	uint64_t *firstNodes = malloc(sizeof(uint64_t) * wayCnt);
+	uint64_t *wayNodes = malloc(sizeof(uint64_t) * (8 + holeCnt * 5));
+	struct link *links = malloc(sizeof(struct link) * wayCnt);
+	uint64_t *firstLink = malloc(sizeof(uint64_t) * wayCnt);
+	size_t *parent = malloc(sizeof(size_t) * wayCnt);
+	if(nodesData == NULL || firstNodes == NULL || wayNodes == NULL || links == NULL || firstLink == NULL || parent == NULL) {
+		free(nodesData);
+		free(firstNodes);
+		free(wayNodes);
+		free(links);
+		free(firstLink);
+		free(parent);
+		bench_skip(bench, "out of memory");
+		return;
+	}
+
+	float extent = side * 10 + 10;
+	nodesData[0] = (struct node){ 0, 0 };
+	nodesData[1] = (struct node){ extent, 0 };
+	nodesData[2] = (struct node){ extent, extent };
+	nodesData[3] = (struct node){ 0, extent };
+	size_t nodei = 0;
+	for(size_t w = 0; w < 4; w++) {
+		firstNodes[w] = nodei;
+		wayNodes[nodei++] = w;
+		wayNodes[nodei++] = (w + 1) % 4;
+	}
+
+	rng_seed(5);
+	for(size_t h = 0; h < holeCnt; h++) {
+		float x = 10 + (h % side) * 10;
+		float y = 10 + (h / side) * 10;
+		float size = 2 + (rng_next() % 60) / 10.0;
+		size_t first = 4 + h * 4;
+		nodesData[first + 0] = (struct node){ x, y };
+		nodesData[first + 1] = (struct node){ x + size, y };
+		nodesData[first + 2] = (struct node){ x + size, y + size };
+		nodesData[first + 3] = (struct node){ x, y + size };
+		firstNodes[4 + h] = nodei;
+		for(size_t j = 0; j < 5; j++) {
+			wayNodes[nodei++] = first + j % 4;
+		}
+	}
+
+	struct nodes nodes = {
+		.nodes = nodesData,
+		.cnt = nodeCnt,
+	};
+	struct ways ways = {
+		.firstNode = firstNodes,
+		.cnt = wayCnt,
+		.nodes = wayNodes,
+		.nodesCnt = nodei,
+	};
+
+	bench->elements = nodeCnt;
+
+	while(bench_next(bench)) {
+		struct ring ring = {
+			.links = links,
+			.firstLink = firstLink,
+			.cnt = wayCnt,
+			.parent = parent,
+		};
+		rings_find(nodes, ways, &ring);
+		bench_keep(ring.cnt);
+	}
+
+	free(nodesData);
+	free(firstNodes);
+	free(wayNodes);
+	free(links);
+	free(firstLink);
+	free(parent);
+}
+
+int main(int argc, char** argv) {
+	bench_select(argc, argv);
+
+	BENCH(permuteFrom_uint64, 1e3, 1e8);
+	BENCH(permuteFrom_24byte, 1e3, 1e8);
+	BENCH(permuteArrays_idsAndPtrs, 1e3, 1e8);
+	BENCH(permuteArraysInPlace_idsAndPtrs, 1e3, 1e8);
+	BENCH(convertFromIntoTo_noDupes, 1e3, 1e8);
+	BENCH(binSearch_randomHits, 1e3, 1e8);
+	BENCH(idindex_find_randomHits, 1e3, 1e8);
+	BENCH(readVarInt_deltaIds, 1e3, 1e8);
+	BENCH(vector_find_uint64_miss, 1e3, 1e7);
+	BENCH(u64vec_find_miss, 1e3, 1e7);
+	BENCH(rings_find_singleRing, 1e3, 1e7);
+	BENCH(rings_find_gridOfHoles, 1e3, 1e6);
+
+	return bench_end();
+}
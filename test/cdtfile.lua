@@ -1,4 +1,5 @@
 local triang = require("triangulation")
+local mesh = require("mesh")
 
 local function read_test_input(path)
 	local contents, size = love.filesystem.read(path)
@@ -42,12 +43,12 @@ local function triulate(poly)
 	return face, 0
 end
 
-local function smallest_vert(tris)
+local function smallest_vert(face)
 	local res = {}
-	for k,tri in pairs(tris) do
+	for k = 1,face.nt do
 		local small = 1
 		for i = 2,3 do
-			if tri[i] < tri[small] then
+			if face.tv[mesh.half(k, i)] < face.tv[mesh.half(k, small)] then
 				small = i
 			end
 		end
@@ -63,16 +64,17 @@ local function assert_matches_file(face, path)
 	local ntris = tonumber(nextLine())
 
 	local map = {}
-	for k,v in pairs(face.t) do
+	for k = 1,face.nt do
 		table.insert(map, k)
 	end
 
-	local stris = smallest_vert(face.t)
+	local tv = face.tv
+	local stris = smallest_vert(face)
 	table.sort(map, function(a, b)
 		local ia, ib = stris[a], stris[b]
 		for i = 1,3 do
-			if face.t[a][ia] ~= face.t[b][ib] then
-				return face.t[a][ia] < face.t[b][ib]
+			if tv[mesh.half(a, ia)] ~= tv[mesh.half(b, ib)] then
+				return tv[mesh.half(a, ia)] < tv[mesh.half(b, ib)]
 			end
 			
 			ia, ib = clockwise_vert(ia), clockwise_vert(ib)
@@ -96,13 +98,13 @@ local function assert_matches_file(face, path)
 		local c = stris[v]
 		for i = 1,3 do
 			expected = nextSymbol()
-			assert(face.t[v][c]-1 == expected)
+			assert(tv[mesh.half(v, c)]-1 == expected)
 			c = clockwise_vert(c)
 		end
 
 		local c = anticlockwise_vert(stris[v])
 		for i = 1,3 do
-			local adjtri = face.adj[v][c][1]
+			local adjtri = opposing_tri(face, v, c)
 			if adjtri == nil then
 				adjtri = 4294967295
 			else
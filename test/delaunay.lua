@@ -0,0 +1,90 @@
+local function assert(cond, message)
+	tests = tests + 1
+	_G.assert(cond, message)
+end
+
+local triang = require("triangulation")
+
+local seed = 7
+local function rand()
+	seed = seed * 16807 % 2147483647
+	return seed / 2147483647
+end
+
+-- The triangles as sorted coordinate strings, so meshes with their vertices
+-- numbered differently compare equal
+local function tri_set(face)
+	local set = {}
+	local x, y, tv = face.x, face.y, face.tv
+	for t = 1,face.nt do
+		local corners = {}
+		for j = 0,2 do
+			local v = tv[t*3+j]
+			corners[j+1] = x[v] .. "," .. y[v]
+		end
+		table.sort(corners)
+		set[table.concat(corners, " ")] = true
+	end
+	return set
+end
+
+local pts = {}
+for i = 1,2000 do
+	pts[i] = {rand() * 100, rand() * 100}
+end
+-- Some of them again
+for i = 1,50 do
+	pts[#pts+1] = pts[i*7]
+end
+
+local box = bbox({v = pts})
+local bulk = superTri(box)
+local ids = triang.add_points_bulk(bulk, pts)
+local one = superTri(box)
+triang.add_points(one, {unpack(pts, 1, 2000)})
+
+assert(bulk.nv == 2003)
+assert(bulk.nt == 2*bulk.nv - 5)
+assert(ids[2001] == ids[7] and ids[2050] == ids[350])
+
+local a, b = tri_set(bulk), tri_set(one)
+local same = true
+for k in pairs(a) do
+	same = same and b[k] ~= nil
+end
+for k in pairs(b) do
+	same = same and a[k] ~= nil
+end
+assert(same, "The sweep and adding the points one at a time make the same mesh")
+
+-- Points along a smooth curve make the sweep flip a lot, it hands them to
+-- add_points instead and the mesh is still the same
+local ring = {}
+for i = 1,2000 do
+	local a = i / 2000 * 2 * math.pi
+	local r = 100 + 20 * math.sin(7 * a)
+	ring[i] = {r * math.cos(a), r * math.sin(a)}
+end
+local ringbox = bbox({v = ring})
+bulk = superTri(ringbox)
+ids = triang.add_points_bulk(bulk, ring)
+one = superTri(ringbox)
+triang.add_points(one, ring)
+
+assert(bulk.nv == 2003)
+assert(bulk.nt == 2*bulk.nv - 5)
+local distinct = true
+for i = 1,2000 do
+	distinct = distinct and ids[i] ~= nil and (i == 1 or ids[i] ~= ids[i-1])
+end
+assert(distinct, "Every point of the ring has its own vertex")
+
+a, b = tri_set(bulk), tri_set(one)
+same = true
+for k in pairs(a) do
+	same = same and b[k] ~= nil
+end
+for k in pairs(b) do
+	same = same and a[k] ~= nil
+end
+assert(same, "The sweep and adding the points one at a time make the same mesh of the ring")
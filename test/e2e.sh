@@ -0,0 +1,95 @@
+#!/bin/sh
+# End-to-end benchmark: generate a pbf, build the index from it and run a
+# fixed set of lookups against it, reporting the throughput of each phase.
+#
+# Arguments are passed to genpbf. INDEX and GEN point at the binaries,
+# THREADS lists the concurrency levels the lookups are run at and WORKDIR
+# where the data goes (a temporary directory by default).
+set -e
+
+INDEX=$(realpath "${INDEX:-./index}")
+GEN=$(realpath "${GEN:-obj/test/genpbf}")
+THREADS=${THREADS:-"1 2 4"}
+LOOKUPS=${LOOKUPS:-16}
+
+if [ $# -eq 0 ]; then
+	set -- --relations 1000 --ways-per-relation 16 --nodes-per-way 100 \
+		--extra-nodes 1000000 --extra-ways 50000 --extra-relations 1000
+fi
+
+# The multipolygons get the ids 1..relations
+relations=100
+prev=
+for arg in "$@"; do
+	if [ "$prev" = "--relations" ]; then
+		relations=$arg
+	fi
+	prev=$arg
+done
+
+if [ -z "$WORKDIR" ]; then
+	WORKDIR=$(mktemp -d)
+	trap 'rm -rf "$WORKDIR"' EXIT
+fi
+cd "$WORKDIR"
+
+now() {
+	date +%s.%N
+}
+
+# report phase threads start end amount unit
+report() {
+	awk -v phase="$1" -v threads="$2" -v start="$3" -v end="$4" -v amount="$5" -v unit="$6" 'BEGIN {
+		secs = end - start
+		rate = secs > 0 ? amount / secs : 0
+		printf "%-16s %7d %10.3f %14.1f %s/s\n", phase, threads, secs, rate, unit
+	}'
+}
+
+start=$(now)
+"$GEN" -o data.osm.pbf "$@" 2> gen.log
+end=$(now)
+cat gen.log
+pbfBytes=$(stat -c %s data.osm.pbf)
+
+printf "%-16s %7s %10s %14s\n" "phase" "threads" "seconds" "throughput"
+report generate 1 "$start" "$end" "$pbfBytes" B
+
+start=$(now)
+"$INDEX" -i data.osm.pbf build-filtered 2> build.log > /dev/null
+end=$(now)
+report build-filtered 1 "$start" "$end" "$pbfBytes" B
+
+start=$(now)
+"$INDEX" -i data.osm.pbf build 2> build.log > /dev/null
+end=$(now)
+report build 1 "$start" "$end" "$pbfBytes" B
+grep "^Found" build.log
+
+# Spread the lookups evenly over the relations
+ids=
+step=$((relations / LOOKUPS))
+[ $step -eq 0 ] && step=1
+id=1
+while [ $id -le $relations ] && [ $(echo "$ids" | wc -w) -lt $LOOKUPS ]; do
+	ids="$ids $id"
+	id=$((id + step))
+done
+lookupCnt=$(echo "$ids" | wc -w)
+
+for threads in $THREADS; do
+	start=$(now)
+	worker=0
+	while [ $worker -lt $threads ]; do
+		(
+			for id in $ids; do
+				"$INDEX" -i data.osm.pbf lookup "$id" > /dev/null 2>&1 \
+					|| echo "lookup of $id failed" >&2
+			done
+		) &
+		worker=$((worker + 1))
+	done
+	wait
+	end=$(now)
+	report lookup "$threads" "$start" "$end" $((lookupCnt * threads)) lookups
+done
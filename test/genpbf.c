@@ -0,0 +1,503 @@
+// Generates a deterministic, synthetic OSM pbf file.
+//
+// The file contains an OSMHeader block followed by OSMData blocks with the
+// dense nodes, then the ways, then the relations, like a planet extract. Every
+// relation is a type=multipolygon made of a single closed ring of ways that
+// share their endpoints. On top of that there are filler nodes that aren't in
+// any way, filler ways that aren't in any relation and type=route relations
+// over the filler ways, so the filtered build has something to filter out.
+//
+// Node ids are assigned in increasing order with random gaps of up to
+// --id-gap. --locality controls how the nodes of a ring are spread over the
+// id space (and thereby over the blocks): 1 keeps them consecutive, 0 scatters
+// them over the whole file.
+
+#include "vector.h"
+
+#include <libdeflate.h>
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct genConfig {
+	const char *out;
+	uint64_t relations;
+	uint64_t waysPerRelation;
+	uint64_t nodesPerWay;
+	uint64_t extraNodes;
+	uint64_t extraWays;
+	uint64_t extraRelations;
+	uint64_t blockSize;
+	uint64_t idGap;
+	double locality;
+	bool zlib;
+	uint64_t seed;
+};
+
+static uint64_t rngState;
+static void rng_seed(uint64_t seed) {
+	rngState = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+static uint64_t rng_next() {
+	// xorshift64*
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return rngState * 0x2545F4914F6CDD1DULL;
+}
+
+// Protobuf writing. Buffers are byte vectors.
+
+static void putVarInt(Vector *buf, uint64_t value) {
+	uint8_t bytes[10];
+	size_t len = 0;
+	do {
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+		bytes[len++] = byte | (value != 0 ? 0x80 : 0);
+	} while(value != 0);
+	vector_putListBack(buf, bytes, len);
+}
+
+static void putVarZig(Vector *buf, int64_t value) {
+	putVarInt(buf, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static void putKey(Vector *buf, uint64_t field, uint64_t type) {
+	putVarInt(buf, field << 3 | type);
+}
+
+static void putUInt(Vector *buf, uint64_t field, uint64_t value) {
+	putKey(buf, field, 0);
+	putVarInt(buf, value);
+}
+
+static void putBytes(Vector *buf, uint64_t field, const void *data, size_t len) {
+	putKey(buf, field, 2);
+	putVarInt(buf, len);
+	vector_putListBack(buf, data, len);
+}
+
+// Append a nested message and clear the buffer it was built in
+static void putMessage(Vector *buf, uint64_t field, Vector *msg) {
+	putBytes(buf, field, msg->data, msg->size);
+	vector_clear(msg);
+}
+
+static void putPackedUInt(Vector *buf, Vector *scratch, uint64_t field, const uint64_t *values, size_t cnt) {
+	for(size_t i = 0; i < cnt; i++) {
+		putVarInt(scratch, values[i]);
+	}
+	putMessage(buf, field, scratch);
+}
+
+static void putPackedDelta(Vector *buf, Vector *scratch, uint64_t field, const int64_t *values, size_t cnt) {
+	int64_t last = 0;
+	for(size_t i = 0; i < cnt; i++) {
+		putVarZig(scratch, values[i] - last);
+		last = values[i];
+	}
+	putMessage(buf, field, scratch);
+}
+
+// The strings every data block carries. Index 0 has to be the empty string.
+enum {
+	STR_EMPTY,
+	STR_TYPE,
+	STR_MULTIPOLYGON,
+	STR_ROUTE,
+	STR_OUTER,
+};
+static const char *strings[] = { "", "type", "multipolygon", "route", "outer" };
+
+struct writer {
+	FILE *out;
+	bool zlib;
+	struct libdeflate_compressor *compressor;
+	Vector blob;
+	Vector header;
+	Vector compressed;
+
+	uint64_t blocks;
+	uint64_t bytes;
+};
+
+static void writeBlob(struct writer *w, const char *type, Vector *data) {
+	vector_clear(&w->blob);
+	if(w->zlib) {
+		size_t bound = libdeflate_zlib_compress_bound(w->compressor, data->size);
+		vector_clear(&w->compressed);
+		void *dest = vector_reserve(&w->compressed, bound);
+		size_t len = libdeflate_zlib_compress(w->compressor, data->data, data->size, dest, bound);
+		if(len == 0) abort();
+
+		putUInt(&w->blob, 2, data->size); // raw_size
+		putBytes(&w->blob, 3, dest, len); // zlib_data
+	} else {
+		putBytes(&w->blob, 1, data->data, data->size); // raw
+	}
+
+	vector_clear(&w->header);
+	putBytes(&w->header, 1, type, strlen(type)); // type
+	putUInt(&w->header, 3, w->blob.size); // datasize
+
+	uint32_t headerSize = htonl(w->header.size);
+	if(fwrite(&headerSize, 1, 4, w->out) != 4
+			|| fwrite(w->header.data, 1, w->header.size, w->out) != w->header.size
+			|| fwrite(w->blob.data, 1, w->blob.size, w->out) != w->blob.size) {
+		perror("write");
+		exit(1);
+	}
+	w->bytes += 4 + w->header.size + w->blob.size;
+	w->blocks++;
+}
+
+static void writeHeader(struct writer *w) {
+	Vector block;
+	vector_init(&block, 1, 128);
+	static const char *features[] = { "OsmSchema-V0.6", "DenseNodes" };
+	for(size_t i = 0; i < sizeof(features)/sizeof(char*); i++) {
+		putBytes(&block, 4, features[i], strlen(features[i])); // required_features
+	}
+	static const char *program = "genpbf";
+	putBytes(&block, 16, program, strlen(program)); // writingprogram
+	writeBlob(w, "OSMHeader", &block);
+	vector_kill(&block);
+}
+
+// Wrap a primitive group into a block with the shared string table and write
+// it.
+static void writeGroup(struct writer *w, Vector *group) {
+	Vector block;
+	Vector table;
+	vector_init(&block, 1, group->size + 64);
+	vector_init(&table, 1, 64);
+	for(size_t i = 0; i < sizeof(strings)/sizeof(char*); i++) {
+		putBytes(&table, 1, strings[i], strlen(strings[i])); // s
+	}
+	putMessage(&block, 1, &table); // stringtable
+	putMessage(&block, 2, group); // primitivegroup
+	writeBlob(w, "OSMData", &block);
+	vector_kill(&table);
+	vector_kill(&block);
+}
+
+static uint64_t parseCount(const char *str) {
+	char *end;
+	double value = strtod(str, &end);
+	if(*end != '\0' || value < 0) {
+		fprintf(stderr, "Not a count: %s\n", str);
+		exit(1);
+	}
+	return (uint64_t)value;
+}
+
+static void usage() {
+	fprintf(stderr,
+		"usage: genpbf [options] -o out.osm.pbf\n"
+		"  --relations N          multipolygon relations (100)\n"
+		"  --ways-per-relation N  ways in each relation ring (8)\n"
+		"  --nodes-per-way N      nodes in each way (50)\n"
+		"  --extra-nodes N        nodes that aren't in any way (10000)\n"
+		"  --extra-ways N         ways that aren't in any multipolygon (1000)\n"
+		"  --extra-relations N    type=route relations over the extra ways (10)\n"
+		"  --block-size N         entities per block (8000)\n"
+		"  --id-gap N             max gap between consecutive node ids (1)\n"
+		"  --locality F           0 scatters ring nodes over the file, 1 keeps them together (1)\n"
+		"  --encoding raw|zlib    blob encoding (zlib)\n"
+		"  --seed N               random seed (1)\n");
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	struct genConfig cfg = {
+		.out = NULL,
+		.relations = 100,
+		.waysPerRelation = 8,
+		.nodesPerWay = 50,
+		.extraNodes = 10000,
+		.extraWays = 1000,
+		.extraRelations = 10,
+		.blockSize = 8000,
+		.idGap = 1,
+		.locality = 1,
+		.zlib = true,
+		.seed = 1,
+	};
+
+	for(int i = 1; i < argc; i++) {
+		if(i + 1 >= argc) usage();
+		const char *opt = argv[i];
+		const char *val = argv[++i];
+		if(strcmp(opt, "-o") == 0) {
+			cfg.out = val;
+		} else if(strcmp(opt, "--relations") == 0) {
+			cfg.relations = parseCount(val);
+		} else if(strcmp(opt, "--ways-per-relation") == 0) {
+			cfg.waysPerRelation = parseCount(val);
+		} else if(strcmp(opt, "--nodes-per-way") == 0) {
+			cfg.nodesPerWay = parseCount(val);
+		} else if(strcmp(opt, "--extra-nodes") == 0) {
+			cfg.extraNodes = parseCount(val);
+		} else if(strcmp(opt, "--extra-ways") == 0) {
+			cfg.extraWays = parseCount(val);
+		} else if(strcmp(opt, "--extra-relations") == 0) {
+			cfg.extraRelations = parseCount(val);
+		} else if(strcmp(opt, "--block-size") == 0) {
+			cfg.blockSize = parseCount(val);
+		} else if(strcmp(opt, "--id-gap") == 0) {
+			cfg.idGap = parseCount(val);
+		} else if(strcmp(opt, "--locality") == 0) {
+			cfg.locality = strtod(val, NULL);
+		} else if(strcmp(opt, "--encoding") == 0) {
+			if(strcmp(val, "raw") == 0) {
+				cfg.zlib = false;
+			} else if(strcmp(val, "zlib") == 0) {
+				cfg.zlib = true;
+			} else {
+				usage();
+			}
+		} else if(strcmp(opt, "--seed") == 0) {
+			cfg.seed = parseCount(val);
+		} else {
+			usage();
+		}
+	}
+	if(cfg.out == NULL || cfg.nodesPerWay < 2 || cfg.waysPerRelation < 1 || cfg.blockSize < 1 || cfg.idGap < 1) {
+		usage();
+	}
+	if(cfg.waysPerRelation * (cfg.nodesPerWay - 1) < 3) {
+		fprintf(stderr, "A ring needs at least 3 nodes\n");
+		exit(1);
+	}
+	if(cfg.extraWays > 0 && cfg.extraNodes < cfg.nodesPerWay) {
+		fprintf(stderr, "The extra ways need at least --nodes-per-way extra nodes\n");
+		exit(1);
+	}
+	rng_seed(cfg.seed);
+
+	// Nodes are numbered ring by ring, followed by the extra nodes. That
+	// number is then mapped to a slot in the id order.
+	uint64_t ringNodes = cfg.waysPerRelation * (cfg.nodesPerWay - 1);
+	uint64_t nodeCnt = cfg.relations * ringNodes + cfg.extraNodes;
+
+	uint64_t *ids = malloc(sizeof(uint64_t) * nodeCnt);
+	uint64_t *slotOf = malloc(sizeof(uint64_t) * nodeCnt);
+	uint64_t *nodeAt = malloc(sizeof(uint64_t) * nodeCnt);
+	if(ids == NULL || slotOf == NULL || nodeAt == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	{
+		uint64_t id = 0;
+		for(uint64_t i = 0; i < nodeCnt; i++) {
+			id += 1 + (cfg.idGap > 1 ? rng_next() % cfg.idGap : 0);
+			ids[i] = id;
+			slotOf[i] = i;
+		}
+
+		// Shuffle within windows, the smaller the locality the larger the
+		// windows
+		double loc = cfg.locality < 0 ? 0 : cfg.locality > 1 ? 1 : cfg.locality;
+		uint64_t window = (uint64_t)((1 - loc) * nodeCnt);
+		if(window > 1) {
+			for(uint64_t start = 0; start < nodeCnt; start += window) {
+				uint64_t len = start + window > nodeCnt ? nodeCnt - start : window;
+				for(uint64_t i = len-1; i > 0; i--) {
+					uint64_t j = rng_next() % (i+1);
+					uint64_t tmp = slotOf[start+i];
+					slotOf[start+i] = slotOf[start+j];
+					slotOf[start+j] = tmp;
+				}
+			}
+		}
+		for(uint64_t i = 0; i < nodeCnt; i++) {
+			nodeAt[slotOf[i]] = i;
+		}
+	}
+
+	// The rings are laid out on a grid of unit cells (in 1e-7 degrees)
+	uint64_t gridW = (uint64_t)ceil(sqrt((double)(cfg.relations > 0 ? cfg.relations : 1)));
+	const int64_t cell = 10000000 / (gridW > 0 ? gridW : 1);
+
+	struct writer w = {
+		.zlib = cfg.zlib,
+	};
+	w.out = fopen(cfg.out, "wb");
+	if(w.out == NULL) {
+		perror(cfg.out);
+		exit(1);
+	}
+	w.compressor = libdeflate_alloc_compressor(6);
+	vector_init(&w.blob, 1, 1024);
+	vector_init(&w.header, 1, 64);
+	vector_init(&w.compressed, 1, 1024);
+
+	writeHeader(&w);
+
+	Vector group;
+	Vector msg;
+	Vector scratch;
+	vector_init(&group, 1, 1024 * 1024);
+	vector_init(&msg, 1, 1024);
+	vector_init(&scratch, 1, 1024);
+
+	// Nodes
+	{
+		int64_t *denseIds = malloc(sizeof(int64_t) * cfg.blockSize);
+		int64_t *lats = malloc(sizeof(int64_t) * cfg.blockSize);
+		int64_t *lons = malloc(sizeof(int64_t) * cfg.blockSize);
+		if(denseIds == NULL || lats == NULL || lons == NULL) abort();
+
+		for(uint64_t start = 0; start < nodeCnt; start += cfg.blockSize) {
+			uint64_t cnt = start + cfg.blockSize > nodeCnt ? nodeCnt - start : cfg.blockSize;
+			for(uint64_t i = 0; i < cnt; i++) {
+				uint64_t slot = start + i;
+				uint64_t node = nodeAt[slot];
+				denseIds[i] = ids[slot];
+
+				// Lat/lon in units of the default granularity (100 nanodegrees)
+				if(node < cfg.relations * ringNodes) {
+					uint64_t rel = node / ringNodes;
+					uint64_t j = node % ringNodes;
+					double angle = 2 * M_PI * j / ringNodes;
+					int64_t cx = (rel % gridW) * cell + cell / 2;
+					int64_t cy = (rel / gridW) * cell + cell / 2;
+					lats[i] = 500000000 + cy + (int64_t)(cell * .4 * sin(angle));
+					lons[i] = 100000000 + cx + (int64_t)(cell * .4 * cos(angle));
+				} else {
+					lats[i] = 500000000 + rng_next() % 10000000;
+					lons[i] = 100000000 + rng_next() % 10000000;
+				}
+			}
+
+			putPackedDelta(&msg, &scratch, 1, denseIds, cnt); // id
+			putPackedDelta(&msg, &scratch, 8, lats, cnt); // lat
+			putPackedDelta(&msg, &scratch, 9, lons, cnt); // lon
+			putMessage(&group, 2, &msg); // dense
+			writeGroup(&w, &group);
+		}
+
+		free(denseIds);
+		free(lats);
+		free(lons);
+	}
+
+	// Ways. The ring ways come first, the extra ways reference runs of
+	// consecutive extra nodes.
+	uint64_t wayCnt = cfg.relations * cfg.waysPerRelation + cfg.extraWays;
+	{
+		int64_t *refs = malloc(sizeof(int64_t) * cfg.nodesPerWay);
+		if(refs == NULL) abort();
+
+		uint64_t inGroup = 0;
+		for(uint64_t way = 0; way < wayCnt; way++) {
+			if(way < cfg.relations * cfg.waysPerRelation) {
+				uint64_t rel = way / cfg.waysPerRelation;
+				uint64_t wi = way % cfg.waysPerRelation;
+				for(uint64_t j = 0; j < cfg.nodesPerWay; j++) {
+					uint64_t node = rel * ringNodes + (wi * (cfg.nodesPerWay - 1) + j) % ringNodes;
+					refs[j] = ids[slotOf[node]];
+				}
+			} else {
+				uint64_t first = rng_next() % (cfg.extraNodes - cfg.nodesPerWay + 1);
+				for(uint64_t j = 0; j < cfg.nodesPerWay; j++) {
+					uint64_t node = cfg.relations * ringNodes + first + j;
+					refs[j] = ids[slotOf[node]];
+				}
+			}
+
+			putUInt(&msg, 1, way + 1); // id
+			putPackedDelta(&msg, &scratch, 8, refs, cfg.nodesPerWay); // refs
+			putMessage(&group, 3, &msg); // ways
+
+			if(++inGroup == cfg.blockSize) {
+				writeGroup(&w, &group);
+				inGroup = 0;
+			}
+		}
+		if(inGroup > 0) {
+			writeGroup(&w, &group);
+		}
+
+		free(refs);
+	}
+
+	// Relations
+	{
+		uint64_t relCnt = cfg.relations + cfg.extraRelations;
+		uint64_t maxMembers = cfg.waysPerRelation;
+		int64_t *memids = malloc(sizeof(int64_t) * maxMembers);
+		uint64_t *roles = malloc(sizeof(uint64_t) * maxMembers);
+		uint64_t *types = malloc(sizeof(uint64_t) * maxMembers);
+		if(memids == NULL || roles == NULL || types == NULL) abort();
+
+		uint64_t inGroup = 0;
+		for(uint64_t rel = 0; rel < relCnt; rel++) {
+			uint64_t memCnt = 0;
+			uint64_t typeVal;
+			if(rel < cfg.relations) {
+				typeVal = STR_MULTIPOLYGON;
+				for(uint64_t i = 0; i < cfg.waysPerRelation; i++) {
+					memids[memCnt] = rel * cfg.waysPerRelation + i + 1;
+					roles[memCnt] = STR_OUTER;
+					types[memCnt] = 1; // way
+					memCnt++;
+				}
+			} else {
+				typeVal = STR_ROUTE;
+				if(cfg.extraWays > 0) {
+					uint64_t cnt = 1 + rng_next() % maxMembers;
+					for(uint64_t i = 0; i < cnt; i++) {
+						memids[memCnt] = cfg.relations * cfg.waysPerRelation + rng_next() % cfg.extraWays + 1;
+						roles[memCnt] = STR_EMPTY;
+						types[memCnt] = 1; // way
+						memCnt++;
+					}
+				}
+			}
+
+			uint64_t key = STR_TYPE;
+			putUInt(&msg, 1, rel + 1); // id
+			putPackedUInt(&msg, &scratch, 2, &key, 1); // keys
+			putPackedUInt(&msg, &scratch, 3, &typeVal, 1); // vals
+			putPackedUInt(&msg, &scratch, 8, roles, memCnt); // roles_sid
+			putPackedDelta(&msg, &scratch, 9, memids, memCnt); // memids
+			putPackedUInt(&msg, &scratch, 10, types, memCnt); // types
+			putMessage(&group, 4, &msg); // relations
+
+			if(++inGroup == cfg.blockSize) {
+				writeGroup(&w, &group);
+				inGroup = 0;
+			}
+		}
+		if(inGroup > 0) {
+			writeGroup(&w, &group);
+		}
+
+		free(memids);
+		free(roles);
+		free(types);
+	}
+
+	fclose(w.out);
+	fprintf(stderr, "Wrote %lu nodes %lu ways %lu relations in %lu blocks (%lu bytes)\n",
+			nodeCnt, wayCnt, cfg.relations + cfg.extraRelations, w.blocks, w.bytes);
+
+	libdeflate_free_compressor(w.compressor);
+	vector_kill(&w.blob);
+	vector_kill(&w.header);
+	vector_kill(&w.compressed);
+	vector_kill(&group);
+	vector_kill(&msg);
+	vector_kill(&scratch);
+	free(ids);
+	free(slotOf);
+	free(nodeAt);
+	return 0;
+}
@@ -6,6 +6,9 @@
 #include <assert.h>
 #include <sys/resource.h>
 #include <fnmatch.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
 
 #define RET_IF_FAIL(STMT) \
         do{ \
@@ -14,7 +17,7 @@
                 return r; \
         }while(0)
 
-Vector results;
+struct testVec results;
 char** selected;
 size_t selected_num;
 
@@ -333,7 +336,7 @@ void test_run(char* name, test_func func) {
     }
     test.crashExpected = shouldAssert != 0;
 
-    vector_init(&test.res, sizeof(struct TestResult), 8);
+    testResultVec_init(&test.res, NULL);
     while(true) {
         struct TestResult result;
         enum TestOutcome outcome = receiveResult(fds[0], &result);
@@ -343,7 +346,7 @@ void test_run(char* name, test_func func) {
             break;
         assert(outcome == OUTCOME_SUCCESS);
 
-        vector_putBack(&test.res, &result);
+        testResultVec_push(&test.res, result);
     }
 
     int status;
@@ -354,7 +357,7 @@ void test_run(char* name, test_func func) {
         test.outcome = OUTCOME_ASSERT;
     }
 
-    vector_putBack(&results, &test);
+    testVec_push(&results, test);
 }
 
 #define ANSI_COLOR_RED     "\x1b[31m"
@@ -367,7 +370,7 @@ void test_run(char* name, test_func func) {
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
 void test_select(int argc, char** argv) {
-    vector_init(&results, sizeof(struct Test), 128);
+    testVec_init(&results, NULL);
 
     // First argument is the executable name, skip that.
     selected = argv + 1;
@@ -377,19 +380,16 @@ void test_select(int argc, char** argv) {
 uint32_t test_end() {
     uint32_t failed = 0;
 
-    size_t index;
-    struct Test* test = vector_getFirst(&results, &index);
-    while(test != NULL) {
+    for(size_t index = 0; index < results.size; index++) {
+        struct Test* test = testVec_get(&results, index);
         bool success;
         if(test->outcome == OUTCOME_SUCCESS) {
             if(!test->crashExpected) {
                 success = true;
 
-                size_t i;
-                struct TestResult *it = vector_getFirst(&test->res, &i);
-                while(it != NULL) {
+                for(size_t i = 0; i < test->res.size; i++) {
+                    struct TestResult *it = testResultVec_get(&test->res, i);
                     success = it->success ? success : false;
-                    it = vector_getNext(&test->res, &i);
                 }
 
             } else {
@@ -420,10 +420,8 @@ uint32_t test_end() {
         }
 
         if(test->outcome == OUTCOME_SUCCESS) {
-            size_t i;
-            struct TestResult *it = vector_getFirst(&test->res, &i);
-            while(it != NULL) {
-                struct TestResult result = *it;
+            for(size_t i = 0; i < test->res.size; i++) {
+                struct TestResult result = *testResultVec_get(&test->res, i);
 
                 switch(result.type) {
                     case TEST_STATIC:
@@ -457,16 +455,212 @@ uint32_t test_end() {
                         // It's a test script, so who cares?
                         break;
                 }
-                it = vector_getNext(&test->res, &i);
             }
         } else if(test->outcome == OUTCOME_ASSERT) {
             printf("\tCrashed during test\n");
         } else {
             printf("\tInternal framework error in test\n");
         }
-        test = vector_getNext(&results, &index);
     }
 
-    printf("%d/%d tests failed\n", failed, vector_size(&results));
+    printf("%d/%d tests failed\n", failed, (int)results.size);
     return failed > 0;
 }
+
+// Benchmark settings, overridable from the command line
+static size_t bench_minN = 1;
+static size_t bench_maxN = SIZE_MAX;
+static size_t bench_warmup = 1;
+static size_t bench_minReps = 3;
+static size_t bench_maxReps = 1000;
+static uint64_t bench_budgetNs = 1000000000ULL;
+static size_t bench_runs = 0;
+static size_t bench_failed = 0;
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t parseCount(const char* str) {
+    // Accept both 1000000 and 1e6
+    char* end;
+    double value = strtod(str, &end);
+    if(*end != '\0' || value < 0) {
+        fprintf(stderr, "Not a count: %s\n", str);
+        exit(1);
+    }
+    return (size_t)value;
+}
+
+void bench_select(int argc, char** argv) {
+    testVec_init(&results, NULL);
+
+    // Options come first, everything after them are name patterns
+    int i = 1;
+    for(; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "--min") == 0) {
+            bench_minN = parseCount(argv[i+1]);
+        } else if(strcmp(argv[i], "--max") == 0) {
+            bench_maxN = parseCount(argv[i+1]);
+        } else if(strcmp(argv[i], "--warmup") == 0) {
+            bench_warmup = parseCount(argv[i+1]);
+        } else if(strcmp(argv[i], "--reps") == 0) {
+            bench_minReps = parseCount(argv[i+1]);
+            if(bench_minReps == 0) bench_minReps = 1;
+        } else if(strcmp(argv[i], "--time") == 0) {
+            bench_budgetNs = strtod(argv[i+1], NULL) * 1e9;
+        } else {
+            break;
+        }
+    }
+
+    selected = argv + i;
+    selected_num = argc - i;
+}
+
+bool bench_next(struct Bench* bench) {
+    uint64_t now = nowNs();
+
+    if(bench->running) {
+        assert(bench->pauseStart == 0);
+        uint64_t elapsed = now - bench->start - bench->paused;
+        if(bench->iter >= bench_warmup) {
+            u64vec_push(&bench->samples, elapsed);
+            bench->total += elapsed;
+        }
+        bench->iter++;
+    }
+
+    size_t measured = bench->samples.size;
+    bool done = bench->skipped != NULL
+        || (measured >= bench_minReps && (bench->total >= bench_budgetNs || measured >= bench_maxReps));
+    if(done) {
+        bench->running = false;
+        return false;
+    }
+
+    bench->running = true;
+    bench->paused = 0;
+    bench->start = nowNs();
+    return true;
+}
+
+void bench_pause(struct Bench* bench) {
+    assert(bench->pauseStart == 0);
+    bench->pauseStart = nowNs();
+}
+
+void bench_resume(struct Bench* bench) {
+    assert(bench->pauseStart != 0);
+    bench->paused += nowNs() - bench->pauseStart;
+    bench->pauseStart = 0;
+}
+
+void bench_skip(struct Bench* bench, char* reason) {
+    bench->skipped = reason;
+}
+
+static int cmpSample(const void* a, const void* b) {
+    uint64_t av = *(const uint64_t*)a;
+    uint64_t bv = *(const uint64_t*)b;
+    return av < bv ? -1 : av > bv ? 1 : 0;
+}
+
+// Nearest rank percentile of sorted samples
+static uint64_t percentile(const uint64_t* samples, size_t cnt, double p) {
+    size_t rank = (size_t)ceil(p * cnt);
+    return samples[rank == 0 ? 0 : rank - 1];
+}
+
+static void printTime(uint64_t ns) {
+    if(ns < 10000ULL) {
+        printf(" %8lu ns", ns);
+    } else if(ns < 10000000ULL) {
+        printf(" %8.2f us", ns / 1e3);
+    } else if(ns < 10000000000ULL) {
+        printf(" %8.2f ms", ns / 1e6);
+    } else {
+        printf(" %8.2f s ", ns / 1e9);
+    }
+}
+
+static void printRate(uint64_t amount, uint64_t ns, const char* unit) {
+    if(amount == 0 || ns == 0) {
+        printf(" %12s", "-");
+        return;
+    }
+
+    static const char prefix[] = { ' ', 'K', 'M', 'G', 'T' };
+    double rate = amount / (ns / 1e9);
+    size_t p = 0;
+    while(rate >= 1000 && p + 1 < sizeof(prefix)) {
+        rate /= 1000;
+        p++;
+    }
+    printf(" %7.2f %c%s", rate, prefix[p], unit);
+}
+
+void bench_run(char* name, bench_func func, size_t minN, size_t maxN) {
+    if(!matchTestName(name))
+        return;
+
+    printf(ANSI_COLOR_CYAN "%s" ANSI_COLOR_RESET "\n", name);
+    printf(ANSI_COLOR_WHITE "%12s %11s %11s %11s %11s %12s %12s" ANSI_COLOR_RESET "\n",
+            "n", "median", "p10", "p90", "min", "elems/s", "bytes/s");
+
+    for(size_t n = 1; n <= maxN && n <= bench_maxN; n *= 10) {
+        if(n < minN || n < bench_minN)
+            continue;
+
+        struct Bench bench = {
+            .n = n,
+        };
+        u64vec_init(&bench.samples, NULL);
+
+        // Kernels may print, keep that out of the report
+        fflush(stdout);
+        int savedOut = dup(STDOUT_FILENO);
+        int devNull = open("/dev/null", O_WRONLY);
+        if(savedOut >= 0 && devNull >= 0)
+            dup2(devNull, STDOUT_FILENO);
+
+        func(&bench);
+
+        fflush(stdout);
+        if(savedOut >= 0 && devNull >= 0)
+            dup2(savedOut, STDOUT_FILENO);
+        if(savedOut >= 0) close(savedOut);
+        if(devNull >= 0) close(devNull);
+
+        printf("%12lu", n);
+        size_t cnt = bench.samples.size;
+        if(bench.skipped != NULL) {
+            printf(ANSI_COLOR_YELLOW " skipped: %s" ANSI_COLOR_RESET "\n", bench.skipped);
+        } else if(cnt == 0) {
+            printf(ANSI_COLOR_RED " no samples recorded" ANSI_COLOR_RESET "\n");
+            bench_failed++;
+        } else {
+            uint64_t* samples = u64vec_data(&bench.samples);
+            qsort(samples, cnt, sizeof(uint64_t), cmpSample);
+
+            uint64_t median = percentile(samples, cnt, .5);
+            printTime(median);
+            printTime(percentile(samples, cnt, .1));
+            printTime(percentile(samples, cnt, .9));
+            printTime(samples[0]);
+            printRate(bench.elements, median, "");
+            printRate(bench.bytes, median, "B");
+            printf("\n");
+        }
+        bench_runs++;
+
+        u64vec_kill(&bench.samples);
+    }
+}
+
+uint32_t bench_end() {
+    printf("%lu benchmark cases run, %lu failed\n", bench_runs, bench_failed);
+    return bench_failed > 0;
+}
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "vector.h"
+#include "tvec.h"
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -76,6 +76,8 @@ struct TestResult {
     };
 };
 
+TVEC(testResultVec, struct TestResult, 8)
+
 enum TestOutcome {
     OUTCOME_SUCCESS,
     OUTCOME_ASSERT,
@@ -89,9 +91,11 @@ struct Test {
     char* name;
     bool crashExpected;
     enum TestOutcome outcome;
-    Vector res;
+    struct testResultVec res;
 };
 
+TVEC(testVec, struct Test, 0)
+
 void assertStatic_internal(bool result);
 void assertEqPtr_internal(char* name, bool inverse, const void* value, const void* expected);
 void assertEq_internal(char* name, bool inverse, uint64_t value, uint64_t expected);
@@ -154,3 +158,53 @@ void test_shouldAssert();
 void test_parseName(char* name, struct TestName* res);
 
 uint32_t test_end();
+
+// Benchmarks
+//
+// A benchmark is run once per input size (powers of ten between the min and
+// max given to BENCH). It does its setup for bench->n elements and then times
+// its kernel in a loop:
+//
+//     while(bench_next(bench)) {
+//         kernel();
+//     }
+//
+// The first iterations are warm-up and aren't recorded. Setup that has to
+// happen inside the loop can be excluded with bench_pause/bench_resume.
+struct Bench {
+    // The input size for this case
+    size_t n;
+    // The work done by a single iteration. Used to report throughput, leave
+    // at 0 to hide the column.
+    uint64_t elements;
+    uint64_t bytes;
+
+    // Internal
+    bool running;
+    char* skipped;
+    size_t iter;
+    uint64_t start;
+    uint64_t pauseStart;
+    uint64_t paused;
+    uint64_t total;
+    struct u64vec samples;
+};
+
+typedef void (*bench_func)(struct Bench* bench);
+
+void bench_select(int argc, char** argv);
+void bench_run(char* name, bench_func func, size_t minN, size_t maxN);
+
+bool bench_next(struct Bench* bench);
+void bench_pause(struct Bench* bench);
+void bench_resume(struct Bench* bench);
+// Give up on the current size, for instance if the input doesn't fit in memory
+void bench_skip(struct Bench* bench, char* reason);
+
+// Keep the compiler from optimizing away a result
+#define bench_keep(x) __asm__ volatile("" : : "g"(x) : "memory")
+
+#define BENCH(f, minN, maxN)                \
+    bench_run(#f, f, minN, maxN)
+
+uint32_t bench_end();
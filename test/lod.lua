@@ -0,0 +1,47 @@
+local function assert(cond, message)
+	tests = tests + 1
+	_G.assert(cond, message)
+end
+
+-- A wavy ring made of two ways
+local points, a, b = {}, {}, {}
+for i = 1,400 do
+	local t = i / 400 * 2 * math.pi
+	local r = 100 + 5 * math.sin(13 * t)
+	points[i] = {200 + r * math.cos(t), 200 + r * math.sin(t)}
+end
+for i = 1,200 do
+	a[i] = i
+end
+for i = 200,400 do
+	b[#b+1] = i
+end
+b[#b+1] = 1
+
+local lod = lod_pyramid({a, b}, points, function(keep)
+	local poly = {v = {}, e = {}}
+	for _, way in ipairs({{a, keep[1]}, {b, keep[2]}}) do
+		for i, id in ipairs(way[1]) do
+			-- The last point of a way is the first of the next one
+			if way[2][i] and i < #way[1] then
+				table.insert(poly.v, points[id])
+				local n = #poly.v
+				poly.e[n] = {n, n+1}
+			end
+		end
+	end
+	poly.e[#poly.e][2] = 1
+	return {poly}
+end)
+
+assert(#lod > 2)
+local fewer = true
+for l = 2,#lod do
+	fewer = fewer and lod[l].face ~= nil and lod[l].face.nt < lod[l-1].face.nt
+end
+assert(fewer, "Every level is coarser than the one before")
+
+assert(lod_pick(lod, 1e9) == lod[1])
+assert(lod_pick(lod, lod[2].zoom) == lod[2])
+assert(lod_pick(lod, lod[2].zoom + 0.5) == lod[1])
+assert(lod_pick(lod, 0) == lod[#lod])
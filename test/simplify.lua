@@ -0,0 +1,69 @@
+local function assert(cond, message)
+	tests = tests + 1
+	_G.assert(cond, message)
+end
+
+local simplify = require("simplify")
+
+local function count(kept)
+	local n = 0
+	for _, k in ipairs(kept) do
+		if k then
+			n = n + 1
+		end
+	end
+	return n
+end
+
+-- A line that wobbles less than the tolerance loses everything between its
+-- ends
+local points = {}
+local line = {}
+for i = 0,20 do
+	points[i+1] = {i, (i % 2) * 0.1}
+	line[i+1] = i+1
+end
+local keep = simplify.lines({line}, points, 0.5)
+assert(count(keep[1]) == 2 and keep[1][1] and keep[1][21])
+
+-- An island close to a line keeps the line from cutting across it
+points = {
+	{0, 0}, {10, 0.5}, {20, 0},
+	{9.9, 0.2}, {10.1, 0.2}, {10, 0.3},
+}
+keep = simplify.lines({{1, 2, 3}, {4, 5, 6, 4}}, points, 1)
+assert(keep[1][2], "The line stays on the same side of the island")
+assert(count(keep[2]) == 4, "The island is left alone")
+
+-- Two ways making a ring between the same two points can't both become a
+-- straight line
+points = {{0, 0}, {5, 0.1}, {10, 0}, {5, -0.1}}
+keep = simplify.lines({a = {1, 2, 3}, b = {3, 4, 1}}, points, 1)
+assert(keep.a[2] ~= keep.b[2])
+
+-- A closed way keeps enough of itself to stay a ring
+points = {{0, 0}, {0, 5}, {0, 10}, {5, 10}, {10, 10}, {10, 5}, {10, 0}, {5, 0}}
+keep = simplify.lines({{1, 2, 3, 4, 5, 6, 7, 8, 1}}, points, 0.1)
+assert(count(keep[1]) == 5, "The square keeps its corners")
+keep = simplify.lines({{1, 2, 3, 4, 5, 6, 7, 8, 1}}, points, 100)
+assert(count(keep[1]) >= 4)
+
+-- Every level only has points the finer ones have, and fewer of them
+points, line = {}, {}
+for i = 0,400 do
+	local t = i / 400 * 2 * math.pi
+	local r = 100 + 10 * math.sin(9 * t) + (i % 3) * 0.01
+	points[i+1] = {r * math.cos(t), r * math.sin(t)}
+	line[i+1] = i+1
+end
+line[#line] = 1
+local levels = simplify.levels({line}, points, {0.05, 0.5, 5})
+local nested = true
+for l = 2,#levels do
+	for i, k in ipairs(levels[l][1]) do
+		nested = nested and (not k or levels[l-1][1][i])
+	end
+	nested = nested and count(levels[l][1]) < count(levels[l-1][1])
+end
+assert(nested)
+assert(count(levels[3][1]) >= 4)
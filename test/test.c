@@ -1,11 +1,22 @@
 #include "libtest.h"
 
+#include "arena.h"
+#include "blockread.h"
+#include "index.h"
+#include "predicates.h"
+#include "ptr.h"
 #include "reorder.h"
 #include "ring.h"
+#include "search.h"
+#include "tvec.h"
 
+#include <limits.h>
+#include <math.h>
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <unistd.h>
 
 void permute__create_sorted_array__unsorted_array_and_sorted_from_reordering() {
 	uint64_t arr[]      = { 3, 4, 2, 1, 6, 5 };
@@ -17,6 +28,69 @@ void permute__create_sorted_array__unsorted_array_and_sorted_from_reordering() {
 	assertEqArray(arr, expected, 6);
 }
 
+void permute__gather_two_arrays__unsorted_arrays_and_sorted_from_reordering() {
+	uint64_t ids[]      = { 3, 4, 2, 1, 6, 5 };
+	uint32_t tags[]     = { 30, 40, 20, 10, 60, 50 };
+	uint64_t from[]     = { 3, 2, 0, 1, 5, 4 };
+	uint64_t sortedIds[6];
+	uint32_t sortedTags[6];
+	struct permuteArray arrays[] = {
+		{ .src = ids,  .dst = sortedIds,  .elemSize = sizeof(uint64_t) },
+		{ .src = tags, .dst = sortedTags, .elemSize = sizeof(uint32_t) },
+	};
+	permuteArrays(from, 6, arrays, 2, 1);
+
+	uint64_t expectedIds[]  = { 1, 2, 3, 4, 5, 6 };
+	uint32_t expectedTags[] = { 10, 20, 30, 40, 50, 60 };
+	uint64_t expectedFrom[] = { 3, 2, 0, 1, 5, 4 };
+	assertEqArray(sortedIds, expectedIds, 6);
+	assertEqArray(sortedTags, expectedTags, 6);
+	assertEqArray(from, expectedFrom, 6);
+}
+
+void permute__permute_two_arrays_in_place__unsorted_arrays_and_sorted_from_reordering() {
+	uint64_t ids[]      = { 3, 4, 2, 1, 6, 5, 7 };
+	uint32_t tags[]     = { 30, 40, 20, 10, 60, 50, 70 };
+	uint64_t from[]     = { 3, 2, 0, 1, 5, 4, 6 };
+	struct permuteArray arrays[] = {
+		{ .dst = ids,  .elemSize = sizeof(uint64_t) },
+		{ .dst = tags, .elemSize = sizeof(uint32_t) },
+	};
+	permuteArraysInPlace(from, 7, arrays, 2);
+
+	uint64_t expectedIds[]  = { 1, 2, 3, 4, 5, 6, 7 };
+	uint32_t expectedTags[] = { 10, 20, 30, 40, 50, 60, 70 };
+	uint64_t expectedFrom[] = { 3, 2, 0, 1, 5, 4, 6 };
+	assertEqArray(ids, expectedIds, 7);
+	assertEqArray(tags, expectedTags, 7);
+	assertEqArray(from, expectedFrom, 7);
+}
+
+void permute__gather_across_threads__reversing_reordering() {
+	size_t cnt = 1000000;
+	uint64_t *from = malloc(sizeof(uint64_t) * cnt);
+	uint64_t *data = malloc(sizeof(uint64_t) * cnt);
+	uint64_t *sorted = malloc(sizeof(uint64_t) * cnt);
+	for(size_t i = 0; i < cnt; i++) {
+		from[i] = cnt - 1 - i;
+		data[i] = i;
+	}
+	permuteArrays(from, cnt, &(struct permuteArray){
+		.src = data,
+		.dst = sorted,
+		.elemSize = sizeof(uint64_t),
+	}, 1, 4);
+
+	size_t wrong = 0;
+	for(size_t i = 0; i < cnt; i++) {
+		if(sorted[i] != cnt - 1 - i) wrong++;
+	}
+	assertEq(wrong, 0);
+	free(sorted);
+	free(data);
+	free(from);
+}
+
 void to__convert_from_index_into_to_index__simple_index() {
 	// 3 4 2 1 6 5
 	uint64_t from[]     = { 3, 2, 0, 1, 5, 4 };
@@ -38,6 +112,386 @@ void to__map_two_spots_to_same_destination__dupes_were_detected() {
 	assertEqArray(to, expected, 6);
 }
 
+void ptr__pack_and_unpack__ptr_is_unchanged() {
+	struct pbfPtr ptr = { .blockid = 1234, .offset = 5678901, .num = 8000 };
+	assertEq(ptr_fits(ptr), true);
+
+	struct pbfPtr unpacked = ptr_unpack(ptr_pack(ptr));
+	assertEq(unpacked.blockid, ptr.blockid);
+	assertEq(unpacked.offset, ptr.offset);
+	assertEq(unpacked.num, ptr.num);
+}
+
+void ptr__packed_order__same_as_unpacked_order() {
+	struct pbfPtr a = { .blockid = 1, .offset = 900, .num = 3 };
+	struct pbfPtr b = { .blockid = 1, .offset = 1000, .num = 0 };
+	struct pbfPtr c = { .blockid = 2, .offset = 0, .num = 0 };
+	assertEq(ptr_pack(a) < ptr_pack(b), true);
+	assertEq(ptr_pack(b) < ptr_pack(c), true);
+}
+
+void ptr__set_ptr_that_does_not_fit__array_is_widened() {
+	struct pbfPtr data[3];
+	struct ptrArray array = { .data = data, .wide = false };
+	ptrarray_set(&array, 0, 0, (struct pbfPtr){ .blockid = 1, .offset = 10, .num = 0 });
+	ptrarray_set(&array, 1, 1, (struct pbfPtr){ .blockid = 2, .offset = 20, .num = 5 });
+	assertEq(array.wide, false);
+
+	ptrarray_set(&array, 2, 2, (struct pbfPtr){ .blockid = 3, .offset = 30, .num = 1 << PTR_NUM_BITS });
+	assertEq(array.wide, true);
+	assertEq(ptrarray_get(&array, 0).blockid, 1);
+	assertEq(ptrarray_get(&array, 0).offset, 10);
+	assertEq(ptrarray_get(&array, 1).blockid, 2);
+	assertEq(ptrarray_get(&array, 1).offset, 20);
+	assertEq(ptrarray_get(&array, 1).num, 5);
+	assertEq(ptrarray_get(&array, 2).num, 1 << PTR_NUM_BITS);
+}
+
+// A dense run of ids followed by a few sparse ones
+static uint64_t* mixedIds(size_t *cnt) {
+	size_t dense = 3000;
+	uint64_t sparse[] = { 20000, 20010, 50000, 1000000 };
+	size_t sparseCnt = sizeof(sparse)/sizeof(uint64_t);
+	uint64_t *ids = malloc(sizeof(uint64_t) * (dense + sparseCnt));
+	for(size_t i = 0; i < dense; i++) {
+		ids[i] = 4096 + i;
+	}
+	for(size_t i = 0; i < sparseCnt; i++) {
+		ids[dense + i] = sparse[i];
+	}
+	*cnt = dense + sparseCnt;
+	return ids;
+}
+
+void idindex__find_slot_of_id__id_in_dense_or_sparse_segment() {
+	size_t cnt;
+	uint64_t *ids = mixedIds(&cnt);
+	size_t size = idsegments_size(ids, cnt);
+	assertEq(size != 0, true);
+	void *segments = malloc(size);
+	idsegments_build(ids, cnt, segments);
+
+	struct idIndex index;
+	assertEq(idindex_init(&index, ids, cnt, segments, size), true);
+	assertEq(((struct idSegmentsHeader*)segments)->directCnt, 1);
+
+	size_t wrong = 0;
+	for(size_t i = 0; i < cnt; i++) {
+		if(idindex_find(&index, ids[i]) != i) wrong++;
+	}
+	assertEq(wrong, 0);
+
+	free(segments);
+	free(ids);
+}
+
+void idindex__find_slot_where_id_would_be__id_is_missing() {
+	size_t cnt;
+	uint64_t *ids = mixedIds(&cnt);
+	size_t size = idsegments_size(ids, cnt);
+	void *segments = malloc(size);
+	idsegments_build(ids, cnt, segments);
+
+	struct idIndex index;
+	idindex_init(&index, ids, cnt, segments, size);
+	// In the dense segment
+	assertEq(idindex_find(&index, 4096 + 3500), 3000);
+	// Between the sparse ones
+	assertEq(idindex_find(&index, 20005), 3001);
+
+	free(segments);
+	free(ids);
+}
+
+void idindex__search_without_segment_table__ids_are_sparse() {
+	uint64_t ids[] = { 1, 100000, 200000, 300000 };
+	assertEq(idsegments_size(ids, 4), 0);
+
+	struct idIndex index;
+	idindex_init(&index, ids, 4, NULL, 0);
+	assertEq(idindex_find(&index, 200000), 2);
+}
+
+// Read 100 blocks of different sizes out of a temporary file, in two batches
+// on the same reader, and check that every one comes back once with the right
+// contents. usedUring is set to whether the reader went through io_uring
+static size_t readBlocks(bool *usedUring) {
+	char path[] = "/tmp/blockreadXXXXXX";
+	int fd = mkstemp(path);
+	unlink(path);
+
+	size_t cnt = 100;
+	struct blockRead reads[100];
+	off_t offset = 0;
+	for(size_t i = 0; i < cnt; i++) {
+		size_t size = 1000 + i * 37;
+		uint8_t *buf = malloc(size);
+		memset(buf, (uint8_t)i, size);
+		if(write(fd, buf, size) != (ssize_t)size) abort();
+		free(buf);
+		reads[i] = (struct blockRead){ .offset = offset, .size = size };
+		offset += size;
+	}
+
+	bool seen[100] = { false };
+	size_t wrong = 0;
+	struct blockReader *reader = blockreader_create(fd);
+	*usedUring = blockreader_uses_uring(reader);
+	for(size_t batch = 0; batch < cnt; batch += cnt / 2) {
+		struct blockRead *batchReads = reads + batch;
+		blockreader_start(reader, batchReads, cnt / 2);
+		size_t i;
+		while((i = blockreader_next(reader)) != BLOCKREAD_DONE) {
+			if(seen[batch + i]) wrong++;
+			seen[batch + i] = true;
+			uint8_t *buf = batchReads[i].buf;
+			for(size_t j = 0; j < batchReads[i].size; j++) {
+				if(buf[j] != (uint8_t)(batch + i)) {
+					wrong++;
+					break;
+				}
+			}
+			free(buf);
+		}
+		blockreader_finish(reader);
+	}
+	blockreader_free(reader);
+	close(fd);
+
+	for(size_t j = 0; j < cnt; j++) {
+		if(!seen[j]) wrong++;
+	}
+	return wrong;
+}
+
+void blockread__return_every_block__reads_through_uring() {
+	bool usedUring;
+	size_t wrong = readBlocks(&usedUring);
+	if(!usedUring) {
+		// The kernel or the sandbox doesn't allow io_uring, so the reads
+		// went through the pool and prove nothing about the ring
+		printf("io_uring is not available, skipping\n");
+		return;
+	}
+	assertEq(wrong, 0);
+}
+
+void blockread__return_every_block__reads_through_thread_pool() {
+	bool usedUring;
+	setenv(BLOCKREAD_NO_URING_ENV, "1", 1);
+	size_t wrong = readBlocks(&usedUring);
+	unsetenv(BLOCKREAD_NO_URING_ENV);
+	assertEq(usedUring, false);
+	assertEq(wrong, 0);
+}
+
+void tvec__keep_elements__growing_out_of_inline_buffer() {
+	struct u64vec v;
+	u64vec_init(&v, NULL);
+	for(uint64_t i = 0; i < 100; i++) {
+		u64vec_push(&v, i * 3);
+	}
+	assertEq(v.size, 100);
+	assertEq(*u64vec_get(&v, 0), 0);
+	assertEq(*u64vec_get(&v, 15), 45);
+	assertEq(*u64vec_get(&v, 99), 297);
+	u64vec_kill(&v);
+}
+
+void tvec__find_first_match__match_in_lanes_and_tail() {
+	struct u64vec v;
+	u64vec_init(&v, NULL);
+	for(uint64_t i = 0; i < 37; i++) {
+		u64vec_push(&v, i % 10);
+	}
+	assertEq(u64vec_find(&v, 3), 3);
+	assertEq(u64vec_find(&v, 0), 0);
+	assertEq(u64vec_find(&v, 42), SIZE_MAX);
+
+	// Only in the tail that doesn't fill a lane vector
+	*u64vec_get(&v, 36) = 42;
+	assertEq(u64vec_find(&v, 42), 36);
+
+	// Equal in one 32 bit half only isn't a match
+	*u64vec_get(&v, 20) = (UINT64_C(1) << 32) | 77;
+	*u64vec_get(&v, 21) = UINT64_C(77) << 32;
+	assertEq(u64vec_find(&v, 77), SIZE_MAX);
+	assertEq(u64vec_find(&v, (UINT64_C(1) << 32) | 77), 20);
+	u64vec_kill(&v);
+}
+
+void tvec__fill_elements__lanes_and_tail() {
+	struct u64vec v;
+	u64vec_init(&v, NULL);
+	for(uint64_t i = 0; i < 37; i++) {
+		u64vec_push(&v, i);
+	}
+	u64vec_fill(&v, 9);
+	uint64_t filled[37];
+	for(size_t i = 0; i < 37; i++) {
+		filled[i] = 9;
+	}
+	assertEqArray(u64vec_data(&v), filled, 37);
+	u64vec_kill(&v);
+}
+
+void tvec__move_elements__remove_and_circulate() {
+	uint64_t list[] = { 1, 2, 3, 4, 5 };
+	struct u64vec v;
+	u64vec_init(&v, NULL);
+	u64vec_pushList(&v, list, 5);
+
+	u64vec_circulate(&v, 0, 3);
+	uint64_t circulated[] = { 2, 3, 4, 1, 5 };
+	assertEqArray(u64vec_data(&v), circulated, 5);
+
+	u64vec_swapRemove(&v, 0);
+	uint64_t swapped[] = { 5, 3, 4, 1 };
+	assertEqArray(u64vec_data(&v), swapped, 4);
+
+	u64vec_remove(&v, 1);
+	uint64_t removed[] = { 5, 4, 1 };
+	assertEqArray(u64vec_data(&v), removed, 3);
+
+	u64vec_fill(&v, 7);
+	uint64_t filled[] = { 7, 7, 7 };
+	assertEqArray(u64vec_data(&v), filled, 3);
+	u64vec_kill(&v);
+}
+
+static size_t countingBytes;
+static void *countingGrow(void *userdata, void *ptr, size_t oldSize, size_t newSize) {
+	countingBytes += newSize - oldSize;
+	return realloc(ptr, newSize);
+}
+static void countingRelease(void *userdata, void *ptr, size_t size) {
+	countingBytes -= size;
+	free(ptr);
+}
+
+void tvec__allocate_through_allocator__allocator_given() {
+	struct tvecAllocator counting = {
+		.grow = countingGrow,
+		.release = countingRelease,
+	};
+	countingBytes = 0;
+
+	struct u64vec v;
+	u64vec_init(&v, &counting);
+	for(uint64_t i = 0; i < 16; i++) {
+		u64vec_push(&v, i);
+	}
+	// Still inline
+	assertEq(countingBytes, 0);
+	u64vec_push(&v, 16);
+	assertEq(countingBytes, 32 * sizeof(uint64_t));
+	u64vec_kill(&v);
+	assertEq(countingBytes, 0);
+}
+
+void arena__reuse_memory__arena_was_reset() {
+	struct arena arena;
+	arena_init(&arena);
+	void *first = arena_alloc(&arena, 100);
+	void *second = arena_alloc(&arena, 3);
+	assertEq((uintptr_t)first % ARENA_ALIGN, 0);
+	assertEq((uintptr_t)second % ARENA_ALIGN, 0);
+	assertEq(arena.used, 128);
+
+	// Larger than a chunk, gets a chunk of its own
+	arena_alloc(&arena, ARENA_CHUNK_SIZE + 1);
+	size_t reserved = arena.reserved;
+
+	arena_reset(&arena);
+	assertEq(arena.used, 0);
+	assertEq(arena_alloc(&arena, 100), first);
+	// The big chunk is still there, nothing new is reserved
+	arena_alloc(&arena, ARENA_CHUNK_SIZE + 1);
+	assertEq(arena.reserved, reserved);
+	assertEq(arena.peak, arena.used);
+	arena_kill(&arena);
+}
+
+void index__fail_to_open__index_files_missing() {
+	char dir[] = "/tmp/indextestXXXXXX";
+	assertNotEq(mkdtemp(dir), NULL);
+	assertEq((void*)index_open(dir, "/dev/null"), NULL);
+	rmdir(dir);
+}
+
+// Run a query into a string
+static char *queryToString(struct queryCtx *ctx, uint64_t relid, bool *found) {
+	char *text;
+	size_t size;
+	FILE *out = open_memstream(&text, &size);
+	*found = query_relation(ctx, relid, out);
+	fclose(out);
+	return text;
+}
+
+void index__query_relation__index_built_from_generated_pbf() {
+	// The binaries are built by make test, and can be pointed elsewhere
+	// like for test/e2e.sh
+	const char *indexBin = getenv("INDEX") ? getenv("INDEX") : "./index";
+	const char *genBin = getenv("GEN") ? getenv("GEN") : "obj/test/genpbf";
+	char indexPath[PATH_MAX], genPath[PATH_MAX];
+	assertNotEq(realpath(indexBin, indexPath), NULL);
+	assertNotEq(realpath(genBin, genPath), NULL);
+
+	char dir[] = "/tmp/indextestXXXXXX";
+	assertNotEq(mkdtemp(dir), NULL);
+	// Two relations with rings of 3 ways, spread over a handful of blocks
+	char cmd[3 * PATH_MAX];
+	snprintf(cmd, sizeof(cmd), "cd %s && %s -o data.osm.pbf --relations 2 --ways-per-relation 3 --nodes-per-way 4"
+		" --extra-nodes 10 --extra-ways 2 --extra-relations 1 --block-size 5 2> /dev/null"
+		" && %s -i data.osm.pbf build > /dev/null 2>&1", dir, genPath, indexPath);
+	assertEq(system(cmd), 0);
+
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/data.osm.pbf", dir);
+	struct index *index = index_open(dir, path);
+	assertNotEq((void*)index, NULL);
+	struct queryCtx *ctx = query_ctx_create(index);
+
+	bool found;
+	char *first = queryToString(ctx, 1, &found);
+	assertEq(found, true);
+	const char *nodes =
+		"begin nodes\n"
+		"node iid 0\n"
+		"node id 1\n"
+		"node pos 50.250000000000000 10.450000000000001\n";
+	assertEqString(first, nodes, strlen(nodes));
+	// The ring closes over the ways, in member order
+	const char *ways =
+		"begin ways\n"
+		"way\nmem 0\nmem 1\nmem 2\nmem 3\n"
+		"way\nmem 3\nmem 4\nmem 5\nmem 6\n"
+		"way\nmem 6\nmem 7\nmem 8\nmem 0\n"
+		"begin relations\n"
+		"relation\nmem 0\nmem 1\nmem 2\n";
+	assertNotEq(strstr(first, ways), NULL);
+
+	// The context and its reader are reused for the next query
+	char *other = queryToString(ctx, 2, &found);
+	assertEq(found, true);
+	assertNotEq(strstr(other, "node id 10\n"), NULL);
+	char *again = queryToString(ctx, 1, &found);
+	assertEq(found, true);
+	assertEq(strcmp(again, first), 0);
+
+	free(queryToString(ctx, 999, &found));
+	assertEq(found, false);
+
+	free(first);
+	free(other);
+	free(again);
+	query_ctx_free(ctx);
+	index_close(index);
+	snprintf(cmd, sizeof(cmd), "rm -r %s", dir);
+	assertEq(system(cmd), 0);
+}
+
 void rings__find_ring__ring_is_single_way() {
 	struct node nodesData[] = {
 		{0, 0},
@@ -204,17 +658,178 @@ void rings__find_two_disjoint_rings__one_way_is_closed() {
 	assertEq(ring.links[2].direction, 1);
 }
 
+void rings__nest_and_orient_rings__island_in_hole_in_outer_ring() {
+	struct node nodesData[] = {
+		{0, 0},
+		{300, 0},
+		{300, 300},
+		{0, 300},
+		{100, 100},
+		{200, 100},
+		{200, 200},
+		{100, 200},
+		{140, 140},
+		{160, 140},
+		{150, 160},
+	};
+	struct nodes nodes = {
+		.nodes =  nodesData,
+		.cnt = sizeof(nodesData)/sizeof(struct node),
+	};
+	uint64_t firstNodes[] = { 0, 3, 6, 11 };
+	uint64_t wayNodes[] = { 0, 1, 2, 2, 3, 0, 4, 5, 6, 7, 4, 8, 9, 10, 8 };
+	struct ways ways = {
+		.firstNode = firstNodes,
+		.cnt = sizeof(firstNodes)/sizeof(uint64_t),
+		.nodes = wayNodes,
+		.nodesCnt = sizeof(wayNodes)/sizeof(uint64_t),
+	};
+
+	size_t parent[4];
+	bool inner[4];
+	struct ring ring = {
+		.links = malloc(sizeof(struct link) * ways.cnt),
+		.firstLink = malloc(sizeof(uint64_t) * ways.cnt),
+		.cnt = ways.cnt,
+		.parent = parent,
+		.inner = inner,
+	};
+	assert(ring.links != NULL);
+	assert(ring.firstLink != NULL);
+
+	int rc = rings_find(nodes, ways, &ring);
+
+	assertEq(rc, 0);
+	assertEq(ring.cnt, 3);
+	{
+		uint64_t expected[] = {0, 1, 2};
+		assertEqArray(ring.firstLink, expected, sizeof(uint64_t) * 3);
+	}
+	// The hole is turned clockwise
+	assertEq(ring.links[0].way, 2);
+	assertEq(ring.links[0].direction, 1);
+	assertEq(ring.links[1].way, 3);
+	assertEq(ring.links[1].direction, -1);
+	assertEq(ring.links[2].way, 1);
+	assertEq(ring.links[2].direction, -1);
+	assertEq(ring.links[3].way, 0);
+	assertEq(ring.links[3].direction, -1);
+
+	assertEq(parent[0], 2);
+	assertEq(inner[0], true);
+	assertEq(parent[1], 0);
+	assertEq(inner[1], false);
+	assertEq(parent[2], RING_NO_PARENT);
+	assertEq(inner[2], false);
+}
+
+void rings__fail__ring_does_not_close() {
+	struct node nodesData[] = {
+		{0, 0},
+		{0, 100},
+		{100, 100},
+		{100, 0},
+	};
+	struct nodes nodes = {
+		.nodes =  nodesData,
+		.cnt = sizeof(nodesData)/sizeof(struct node),
+	};
+	uint64_t firstNodes[] = { 0, 3, };
+	uint64_t wayNodes[] = { 0, 3, 2, 2, 1, };
+	struct ways ways = {
+		.firstNode = firstNodes,
+		.cnt = sizeof(firstNodes)/sizeof(uint64_t),
+		.nodes = wayNodes,
+		.nodesCnt = sizeof(wayNodes)/sizeof(uint64_t),
+	};
+
+	struct ring ring = {
+		.links = malloc(sizeof(struct link) * ways.cnt),
+		.firstLink = malloc(sizeof(uint64_t) * ways.cnt),
+		.cnt = ways.cnt,
+	};
+	assert(ring.links != NULL);
+	assert(ring.firstLink != NULL);
+
+	int rc = rings_find(nodes, ways, &ring);
+
+	assertEq(rc, -1);
+}
+
+void predicates__orient2d__points_on_and_next_to_a_line() {
+	assertEq(predicates_orient2d(0.5, 0.5, 12.0, 12.0, 24.0, 24.0), 0.0);
+
+	// A few ulps off the line, where the plain float determinant gets lost in
+	// rounding
+	double x = 0.5;
+	for(int i = 0; i < 8; i++) {
+		x = nextafter(x, 1.0);
+		assertEq(predicates_orient2d(x, 0.5, 12.0, 12.0, 24.0, 24.0) < 0.0, 1);
+		assertEq(predicates_orient2d(0.5, x, 12.0, 12.0, 24.0, 24.0) > 0.0, 1);
+	}
+}
+
+void predicates__incircle__points_on_and_next_to_a_circle() {
+	// Counterclockwise around the unit circle
+	assertEq(predicates_incircle(1.0, 0.0, 0.0, 1.0, -1.0, 0.0, 0.0, -1.0), 0.0);
+
+	double inside = nextafter(-1.0, 0.0);
+	double outside = nextafter(-1.0, -2.0);
+	assertEq(predicates_incircle(1.0, 0.0, 0.0, 1.0, -1.0, 0.0, 0.0, inside) > 0.0, 1);
+	assertEq(predicates_incircle(1.0, 0.0, 0.0, 1.0, -1.0, 0.0, 0.0, outside) < 0.0, 1);
+	// Clockwise flips the sign
+	assertEq(predicates_incircle(-1.0, 0.0, 0.0, 1.0, 1.0, 0.0, 0.0, inside) < 0.0, 1);
+
+	// Moved off the origin the differences are rounded and the plain float
+	// determinant comes out 0
+	double o = 0.1;
+	inside = nextafter(o-1.0, 0.0);
+	outside = nextafter(o-1.0, -2.0);
+	assertEq(predicates_incircle(o+1.0, o, o, o+1.0, o-1.0, o, o, inside) > 0.0, 1);
+	assertEq(predicates_incircle(o+1.0, o, o, o+1.0, o-1.0, o, o, outside) < 0.0, 1);
+}
+
 int main(int argc, char** argv) {
 	test_select(argc, argv);
 
 	TEST(permute__create_sorted_array__unsorted_array_and_sorted_from_reordering);
+	TEST(permute__gather_two_arrays__unsorted_arrays_and_sorted_from_reordering);
+	TEST(permute__permute_two_arrays_in_place__unsorted_arrays_and_sorted_from_reordering);
+	TEST(permute__gather_across_threads__reversing_reordering);
 
 	TEST(to__convert_from_index_into_to_index__simple_index);
 	TEST(to__map_two_spots_to_same_destination__dupes_were_detected);
 
+	TEST(ptr__pack_and_unpack__ptr_is_unchanged);
+	TEST(ptr__packed_order__same_as_unpacked_order);
+	TEST(ptr__set_ptr_that_does_not_fit__array_is_widened);
+
+	TEST(idindex__find_slot_of_id__id_in_dense_or_sparse_segment);
+	TEST(idindex__find_slot_where_id_would_be__id_is_missing);
+	TEST(idindex__search_without_segment_table__ids_are_sparse);
+
+	TEST(blockread__return_every_block__reads_through_uring);
+	TEST(blockread__return_every_block__reads_through_thread_pool);
+
+	TEST(tvec__keep_elements__growing_out_of_inline_buffer);
+	TEST(tvec__find_first_match__match_in_lanes_and_tail);
+	TEST(tvec__fill_elements__lanes_and_tail);
+	TEST(tvec__move_elements__remove_and_circulate);
+	TEST(tvec__allocate_through_allocator__allocator_given);
+
+	TEST(arena__reuse_memory__arena_was_reset);
+
+	TEST(index__fail_to_open__index_files_missing);
+	TEST(index__query_relation__index_built_from_generated_pbf);
+
 	TEST(rings__find_ring__ring_is_single_way);
 	TEST(rings__find_clockwise_ring__ring_is_single_way_clockwise);
 	TEST(rings__find_ring__ring_is_multiple_ways);
 	TEST(rings__find_two_disjoint_rings__one_way_is_closed);
+	TEST(rings__nest_and_orient_rings__island_in_hole_in_outer_ring);
+	TEST(rings__fail__ring_does_not_close);
+
+	TEST(predicates__orient2d__points_on_and_next_to_a_line);
+	TEST(predicates__incircle__points_on_and_next_to_a_circle);
 	return test_end();
 }
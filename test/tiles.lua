@@ -0,0 +1,45 @@
+local function assert(cond, message)
+	tests = tests + 1
+	_G.assert(cond, message)
+end
+
+local mesh = require("mesh")
+local tiles = require("tiles")
+
+local function area(face)
+	local sum = 0
+	local x, y, tv = face.x, face.y, face.tv
+	for t = 1,face.nt do
+		local a, b, c = tv[t*3], tv[t*3+1], tv[t*3+2]
+		sum = sum + math.abs((x[b]-x[a])*(y[c]-y[a]) - (y[b]-y[a])*(x[c]-x[a])) / 2
+	end
+	return sum
+end
+
+-- A square with a square hole that crosses a tile border
+local poly = {
+	v = {
+		{10, 10}, {10, 130}, {130, 130}, {130, 10},
+		{50, 50}, {50, 100}, {100, 100}, {100, 50},
+	},
+	e = {
+		{1, 2}, {2, 3}, {3, 4}, {4, 1},
+		{5, 6}, {6, 7}, {7, 8}, {8, 5},
+	},
+}
+
+local jobs = tiles.jobs(poly_rings(poly), 40)
+assert(#jobs == 16)
+
+local face = triangulate_tiles({poly}, 40)
+assert(area(face) == 120*120 - 50*50)
+
+-- Only the outline of the square and the hole is left open, the borders
+-- between the tiles are all linked up
+local open = 0
+for h = 3,face.nt*3+2 do
+	if face.adj[h] == mesh.NONE then
+		open = open + 1
+	end
+end
+assert(open == 16 + 8)
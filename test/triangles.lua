@@ -1,4 +1,5 @@
 local triang = require("triangulation")
+local mesh = require("mesh")
 
 local function table_eq(value, expect)
 	for k, v in pairs(value) do
@@ -52,7 +53,7 @@ local poly = {
 local face = triangulate({poly})
 assert(type(face) ~= "number")
 
-local face = {
+local face = mesh.from_tables({
 	v = {
 		{100, 300},
 		{200, 200},
@@ -112,37 +113,37 @@ local face = {
 		{104, 1},
 		{105, 3},
 	},
-}
+})
 local res = triang.add_edge(face, 1, 5)
 
 -- assert(contains_tri(face, 1, 3, 2))
 local t0, t0v = find_tri(face, 1, 3, 2)
 assert(t0 ~= nil)
-local opp = opposing_tri(face, t0, t0v)
-assert(is_tri(face, opp[1], opp[2], 4, 2, 3))
-local opp = opposing_tri(face, t0, anticlockwise_vert(t0v))
-assert(is_tri(face, opp[1], opp[2], 8, 1, 2))
-local opp = opposing_tri(face, t0, clockwise_vert(t0v))
-assert(is_tri(face, opp[1], opp[2], 5, 3, 1))
+local opp, oppv = opposing_tri(face, t0, t0v)
+assert(is_tri(face, opp, oppv, 4, 2, 3))
+local opp, oppv = opposing_tri(face, t0, anticlockwise_vert(t0v))
+assert(is_tri(face, opp, oppv, 8, 1, 2))
+local opp, oppv = opposing_tri(face, t0, clockwise_vert(t0v))
+assert(is_tri(face, opp, oppv, 5, 3, 1))
 
 -- assert(contains_tri(face, 1, 5, 3))
 local t0, t0v = find_tri(face, 1, 5, 3)
 assert(t0 ~= nil)
-local opp = opposing_tri(face, t0, t0v)
-assert(is_tri(face, opp[1], opp[2], 4, 3, 5))
-local opp = opposing_tri(face, t0, anticlockwise_vert(t0v))
-assert(is_tri(face, opp[1], opp[2], 2, 1, 3))
-local opp = opposing_tri(face, t0, clockwise_vert(t0v))
-assert(is_tri(face, opp[1], opp[2], 6, 5, 1))
+local opp, oppv = opposing_tri(face, t0, t0v)
+assert(is_tri(face, opp, oppv, 4, 3, 5))
+local opp, oppv = opposing_tri(face, t0, anticlockwise_vert(t0v))
+assert(is_tri(face, opp, oppv, 2, 1, 3))
+local opp, oppv = opposing_tri(face, t0, clockwise_vert(t0v))
+assert(is_tri(face, opp, oppv, 6, 5, 1))
 -- assert(contains_tri(face, 2, 3, 4))
 local t0, t0v = find_tri(face, 2, 3, 4)
 assert(t0 ~= nil)
-local opp = opposing_tri(face, t0, t0v)
-assert(is_tri(face, opp[1], opp[2], 4, 3, 5))
-local opp = opposing_tri(face, t0, anticlockwise_vert(t0v))
-assert(is_tri(face, opp[1], opp[2], 2, 1, 3))
-local opp = opposing_tri(face, t0, clockwise_vert(t0v))
-assert(is_tri(face, opp[1], opp[2], 6, 5, 1))
+local opp, oppv = opposing_tri(face, t0, t0v)
+assert(is_tri(face, opp, oppv, 4, 3, 5))
+local opp, oppv = opposing_tri(face, t0, anticlockwise_vert(t0v))
+assert(is_tri(face, opp, oppv, 2, 1, 3))
+local opp, oppv = opposing_tri(face, t0, clockwise_vert(t0v))
+assert(is_tri(face, opp, oppv, 6, 5, 1))
 -- assert(contains_tri(face, 3, 5, 4))
 -- assert(contains_tri(face, 3, 5, 4))
 -- assert(contains_tri(face, 1, 6, 5))
@@ -0,0 +1,45 @@
+local function assert(cond, message)
+	tests = tests + 1
+	_G.assert(cond, message)
+end
+
+local triang = require("triangulation")
+local mesh = require("mesh")
+
+-- A square with a square hole
+local poly = {
+	v = {
+		{0, 0}, {0, 90}, {90, 90}, {90, 0},
+		{30, 30}, {30, 60}, {60, 60}, {60, 30},
+	},
+	e = {
+		{1, 2}, {2, 3}, {3, 4}, {4, 1},
+		{5, 6}, {6, 7}, {7, 8}, {8, 5},
+	},
+}
+
+local face = superTri(bbox(poly))
+local ids = triang.add_points_bulk(face, poly.v)
+local nt = face.nt
+for _, e in ipairs(poly.e) do
+	triang.add_edge(face, ids[e[1]], ids[e[2]])
+end
+-- add_edge only ever refills the triangles it took out
+assert(face.nt == nt and face.nfree == 0)
+
+assert(trim(face) == face)
+assert(face.nv == 8 and face.nt == 8)
+local ok = true
+for v = 1,face.nv do
+	ok = ok and face.vt[v] ~= mesh.NONE
+	ok = ok and face.tv[face.vt[v]] == v
+	ok = ok and face.x[v] == poly.v[v][1] and face.y[v] == poly.v[v][2]
+end
+for t = 1,face.nt do
+	ok = ok and face.flags[t] == 0
+	for h = t*3,t*3+2 do
+		local o = face.adj[h]
+		ok = ok and (o == mesh.NONE or face.adj[o] == h)
+	end
+end
+assert(ok, "The trimmed mesh is linked up and its vertices point into it")
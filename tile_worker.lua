@@ -0,0 +1,26 @@
+-- A thread of triangulate_tiles. It takes tiles packed by pack_tile_job off
+-- the first channel until it gets "stop", and puts the meshes on the second
+-- one as {job, 1, mesh.pack(...)} or {job, 0, message}
+require("love.filesystem")
+
+local todo, done = ...
+
+-- The triangulation lives in globals there
+love.filesystem.load("tri_main.lua")()
+local mesh = require("mesh")
+
+while true do
+	local msg = todo:demand()
+	if msg == "stop" then
+		break
+	end
+
+	local i, job = unpack_tile_job(msg)
+	local success, face = pcall(triangulate, {job})
+	if success then
+		done:push(mesh.pack(face, {i, 1}))
+	else
+		local err = type(face) == "table" and face.msg or face
+		done:push({i, 0, tostring(err)})
+	end
+end
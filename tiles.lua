@@ -0,0 +1,748 @@
+-- Clips a polygon ring to the squares of a grid, so every tile can be
+-- triangulated on its own. Grid coordinates start at 1 for the tile at the
+-- origin, the polygons of a tile are flat x, y lists relative to its corner.
+local lib = {}
+
+local function search(tbl, key, f, low, high)
+	if low == nil then
+		low = 1
+	end
+	if high == nil then
+		high = #tbl
+	end
+	if f == nil then
+		f = function(x)
+			return x
+		end
+	end
+
+	while low <= high do
+		local pivot = math.floor((high - low) / 2) + low
+
+		local pval = f(tbl[pivot])
+		if pval == key then
+			return pivot
+		elseif pval > key then
+			high = pivot - 1
+		else
+			low = pivot + 1
+		end
+	end
+
+	return high + 1
+end
+
+local function sign(x)
+	if x == 0 then
+		return 0
+	elseif x < 0 then
+		return -1
+	else
+		return 1
+	end
+end
+
+local function point_to_circumlength(sidelen, x, y)
+	local len = 0
+	if y > x then
+		-- Handle the first half of the square
+		assert((y < sidelen and x == 0) or (y == sidelen and x < sidelen))
+		len = y + x
+	else
+		-- Handle the other half
+		assert((y <= sidelen and x == sidelen) or (y == 0 and x <= sidelen))
+		len = sidelen * 2 + (sidelen - y) + (sidelen - x)
+	end
+	return len
+end
+
+local function circumlength_to_point(sidelen, len)
+	local x, y = 0, 0
+	y = math.min(len, sidelen)
+	if y >= len then
+		return x, y
+	end
+	len = len - sidelen
+
+	x = math.min(len, sidelen)
+	if x >= len then
+		return x, y
+	end
+	len = len - sidelen
+
+	y = y - math.min(len, sidelen)
+	if sidelen >= len then
+		return x, y
+	end
+	len = len - sidelen
+
+	x = x - math.min(len, sidelen)
+	return x, y
+end
+
+local function circumlength_segment(sidelen, len)
+	return math.floor(len / sidelen)
+end
+
+local function circumlength_cwdistance(sidelen, x1, x2)
+	local span = x1 - x2
+	if span < 0 then
+		span = span + sidelen * 4
+	end
+
+	return span
+end
+
+local function circumlength_cwbetween(sidelen, start, end_, p)
+	local span = circumlength_cwdistance(sidelen, start, end_)
+	return span > circumlength_cwdistance(sidelen, start, p)
+end
+
+local function polygon_intersections(poly, size)
+	local intersects = {}
+
+	local function mk_intersection(comes_after, x, y, gridx, gridy)
+		table.insert(intersects, {x, y, gridx, gridy, comes_after, x=x, y=y, gridx=gridx, gridy=gridy, comes_after=comes_after})
+	end
+
+	for i = 1,#poly do
+		local p = poly[i]
+		local gridx = math.floor(p[1] / size) + 1 -- +1 because lua indexing
+		local gridy = math.floor(p[2] / size) + 1
+
+		-- @SPEED: You could proabably do a fastpath here for when this
+		-- point falls within the same grid square as the last one since
+		-- that would be pretty common in real data
+
+		local nexti = (i%#poly)+1
+		local pend = poly[nexti]
+		do
+			-- Insert all the intersections in the straight line path
+			-- between this point and the next one. This algorithm is
+			-- careful to insert the points in line order, meaning
+			-- intersections closer to the point p will be inserted be
+			-- inserted before those further away
+			-- The whole algorithm works in absolute coords
+			-- and multiplies the sign back on as the last stage
+			local start_x = gridx-1
+			local start_y = gridy-1
+			local end_x = math.floor(pend[1] / size)
+			local end_y = math.floor(pend[2] / size)
+			local x_span = pend[1] - p[1]
+			local y_span = pend[2] - p[2]
+			local slope_x = (y_span) / (x_span) -- Slope x is actually the slope of the y in the x
+			local slope_y = (x_span) / (y_span)
+
+			-- Figure out the direction of the line while also getting the
+			-- gridwise length of it
+			local span_x = end_x-start_x
+			local span_y = end_y-start_y
+			local dir_x = sign(span_x)
+			local dir_y = sign(span_y)
+			span_x = math.abs(span_x)
+			span_y = math.abs(span_y)
+			-- Calculate the offset of the point from the first x/y grid
+			-- line. If the line is in the positive direction this means
+			-- the delta to the next grid start, if negative it's the delta
+			-- to the my own grid start
+			local startoff_x = math.abs((start_x+math.max(dir_x, 0))*size - p[1])
+			local startoff_y = math.abs((start_y+math.max(dir_y, 0))*size - p[2])
+
+			local d_x = startoff_x
+			local d_y = startoff_y
+			local cursor_x = 1
+			local cursor_y = 1
+
+			-- Precompute the first y axis intersection x value for comparison later
+			local cursor_y_isect = 0
+			if span_y > 0 then
+				cursor_y_isect = slope_y * d_y
+			end
+			while cursor_x <= span_x or cursor_y <= span_y do
+				if (math.abs(d_x) < math.abs(cursor_y_isect) and cursor_x <= span_x) or cursor_y > span_y then
+					local y_intersect = slope_x * d_x * dir_x
+					-- Put the intersection right on the grid line, so the
+					-- tiles on both sides of it agree on where it is
+					local enters_x = gridx + cursor_x*dir_x
+					local line_x = (enters_x - 1 + math.max(-dir_x, 0)) * size
+					mk_intersection(i, line_x, p[2] + y_intersect, enters_x, gridy + (cursor_y-1)*dir_y)
+					d_x = (cursor_x*size + startoff_x)
+					cursor_x = cursor_x + 1
+				else
+					local enters_y = gridy + cursor_y*dir_y
+					local line_y = (enters_y - 1 + math.max(-dir_y, 0)) * size
+					mk_intersection(i, p[1] + cursor_y_isect*dir_y, line_y, gridx + (cursor_x-1)*dir_x, enters_y)
+					d_y = (cursor_y*size + startoff_y)
+					cursor_y_isect = slope_y * d_y
+					cursor_y = cursor_y + 1
+				end
+			end
+		end
+	end
+
+	return intersects
+end
+
+local function anno_points_consumed(poly, intersects)
+	-- Calculate how many fall within the grid square the intersection enters
+	for i = 1, #intersects-1 do
+		local me = intersects[i]
+		local nxt = intersects[i+1]
+
+		local consumes = nxt.comes_after - me.comes_after
+
+		me.consumes = consumes
+	end
+
+	do
+		local last = intersects[#intersects]
+		local first = intersects[1]
+
+		local consumes = #poly - last.comes_after + first.comes_after
+		last.consumes = consumes
+	end
+end
+
+local function anno_enter_exit(size, intersects)
+	-- Calculate the enter and exit point for each segment in
+	-- circumlength coords
+	for i = 1, #intersects do
+		local me = intersects[i]
+		local nxt = intersects[(i%#intersects)+1]
+
+		local grid_base_x = (me.gridx-1) * size
+		local grid_base_y = (me.gridy-1) * size
+
+		me.enter_x, me.enter_y = me.x-grid_base_x, me.y-grid_base_y
+		me.exit_x, me.exit_y = nxt.x-grid_base_x, nxt.y-grid_base_y
+
+		me.enter = point_to_circumlength(size, me.enter_x, me.enter_y)
+		me.exit = point_to_circumlength(size, me.exit_x, me.exit_y)
+	end
+end
+
+local function index_intersections_tile_enter(intersects)
+	local gindex = {}
+	local index = {}
+
+	-- Create an index that groups the intersections by the grid cell they
+	-- enter ordered by the circumlength of the entrypoint. This index also
+	-- happens to sort the cells in the reading direction, but that doesn't
+	-- really matter for the algo's
+	for i = 1, #intersects do
+		index[i] = i
+	end
+
+	table.sort(index, function(x, y)
+		if intersects[x].gridy ~= intersects[y].gridy then
+			return intersects[x].gridy < intersects[y].gridy
+		end
+
+		if intersects[x].gridx ~= intersects[y].gridx then
+			return intersects[x].gridx < intersects[y].gridx
+		end
+
+		return intersects[x].enter < intersects[y].enter
+	end)
+
+
+	local cx, cy = nil, nil
+	for k,v in ipairs(index) do
+		local v = intersects[v]
+
+		if v.gridx ~= cx or v.gridy ~= cy then
+			table.insert(gindex, {pos=k, len=0})
+			cx = v.gridx
+			cy = v.gridy
+		end
+
+		local ip = gindex[#gindex]
+		ip.len = ip.len + 1
+	end
+
+	return gindex, index
+end
+
+local function create_polygon_for_grid_tiles(poly, size, gindex, index, intersects)
+	local grid_polys = {}
+	-- Make a grid cell
+	for k,g in ipairs(gindex) do
+		local gpolys = {}
+
+		-- Make an array to keep track of which segments are left
+		local active = {}
+		for i = 1, g.len do
+			active[i] = true
+		end
+
+		local intersect = intersects[index[g.pos]]
+
+		while true do
+			local new_poly = {}
+			-- Pick a random segment that's still active to close
+			local picked
+			for i = 1, g.len do
+				if active[i] then
+					picked = i
+					break
+				end
+			end
+			if picked == nil then
+				break
+			end
+
+
+			local cursor = picked
+			-- Scan from the endpoint of the picked segment to find the
+			-- closest startpoint in the counterclockwise (forward)
+			-- direction.
+			while true do
+				-- We have not picked this segment and it can no longer
+				-- be considered
+				active[cursor] = false
+
+				-- Insert all the points from this segment along with
+				-- the start and end
+				local intersect = intersects[index[cursor+g.pos-1]]
+				-- The ends go in as they are, going through the
+				-- circumlength and back would round them
+				do
+					table.insert(new_poly, intersect.enter_x)
+					table.insert(new_poly, intersect.enter_y)
+				end
+				for i = 1, intersect.consumes do
+					local point_id = ((intersect.comes_after+i-1)%#poly) + 1
+					local point = poly[point_id]
+					table.insert(new_poly, point[1]%size)
+					table.insert(new_poly, point[2]%size)
+				end
+				do
+					table.insert(new_poly, intersect.exit_x)
+					table.insert(new_poly, intersect.exit_y)
+				end
+
+				-- Now we need to find the next segement of this poly
+				-- ring
+
+				-- Binary search for the intersection that enters right
+				-- after this one exits
+				local icursor = intersects[index[cursor+g.pos-1]].exit
+				local nxt = search(index, icursor, function(x)
+					return intersects[x].enter
+				end, g.pos, g.pos+g.len-1)
+				-- Skip any inactive (already used) segments
+				local nxt_offset = (nxt - g.pos)%g.len
+				while not active[nxt_offset+1] and nxt_offset+1 ~= picked do nxt_offset = (nxt_offset+1)%g.len end
+				nxt = nxt_offset + g.pos
+
+				-- Include corners if we cross them
+				local entry = intersects[index[nxt]].enter
+				local outline_span = entry - icursor
+				if outline_span < 0 then
+					-- Remember that icursor is negative here, so the
+					-- plus results in subtraction
+					outline_span = size*4 + outline_span
+				end
+				-- The distance from the exitpoint (start of the span)
+				-- until the first fixed node
+				local exit_offset = size - (icursor%size)
+				while exit_offset <= outline_span do
+					local circumlength = (icursor + exit_offset)%(size*4)
+					local x, y = circumlength_to_point(size, circumlength)
+					table.insert(new_poly, x)
+					table.insert(new_poly, y)
+
+					exit_offset = exit_offset + size
+				end
+
+				-- When we find our start position we are done
+				if nxt_offset+1 == picked then
+					break
+				end
+
+				cursor = nxt_offset+1
+			end
+
+			table.insert(gpolys, new_poly)
+		end
+
+		local intersect = intersects[index[g.pos]]
+		grid_polys[k] = {x = intersect.gridx, y = intersect.gridy, polys=gpolys}
+	end
+	return grid_polys
+end
+
+local function anno_open_states(size, grid_polys, gindex, index, intersects)
+	for k,g in pairs(gindex) do
+		local left_closest_dist = nil
+		local left_closest = nil
+		local right_closest_dist = nil
+		local right_closest = nil
+		local left = nil
+		local right = nil
+		for i = 1, g.len do
+			local id = g.pos + i-1
+			local intersect = intersects[index[id]]
+
+			if left == nil then
+				if circumlength_segment(size, intersect.enter) == 2 then
+					left = false
+				end
+
+				if circumlength_segment(size, intersect.exit) == 2 then
+					left = false
+				end
+			end
+
+			if right == nil then
+				if circumlength_segment(size, intersect.enter) == 0 then
+					right = false
+				end
+
+				if circumlength_segment(size, intersect.exit) == 0 then
+					right = false
+				end
+			end
+
+			local enter_dist = circumlength_cwdistance(size, size*2, intersect.enter)
+			if left_closest_dist == nil or left_closest_dist > enter_dist then
+				left_closest_dist = enter_dist
+				left_closest = id
+			end
+
+			local enter_dist = circumlength_cwdistance(size, size*2, intersect.exit)
+			if left_closest_dist == nil or left_closest_dist > enter_dist then
+				left_closest_dist = enter_dist
+				left_closest = id
+			end
+
+			local enter_dist = circumlength_cwdistance(size, size*4, intersect.enter)
+			if right_closest_dist == nil or right_closest_dist > enter_dist then
+				right_closest_dist = enter_dist
+				right_closest = id
+			end
+
+			local enter_dist = circumlength_cwdistance(size, size*4, intersect.exit)
+			if right_closest_dist == nil or right_closest_dist > enter_dist then
+				right_closest_dist = enter_dist
+				right_closest = id
+			end
+		end
+
+		if left == nil and left_closest ~= nil then
+			local intersect = intersects[index[left_closest]]
+			local internal = circumlength_cwbetween(size, intersect.enter, size*3, intersect.exit)
+			left = not internal
+		end
+
+		if right == nil and right_closest ~= nil then
+			local intersect = intersects[index[right_closest]]
+			local internal = circumlength_cwbetween(size, intersect.enter, size*4, intersect.exit)
+			right = not internal
+		end
+
+		local intersect = intersects[index[g.pos]]
+		-- @CLEANUP: Do we want to store this outside the grid polys?
+		-- @CLEANUP @CORRECTNESS Why is right and left swapped here?
+		grid_polys[k].open_right = left
+		grid_polys[k].open_left = right
+	end
+end
+
+local function is_covered(grid_polys)
+	local covered = {}
+
+	local begin_x = 0
+	local begin_y = 0
+	for k,v in ipairs(grid_polys) do
+		if v.open_left then
+			assert(v.y == begin_y)
+			for i = begin_x+1,v.x-1 do
+				table.insert(covered, {x=i, y=begin_y})
+			end
+		end
+
+		if v.open_right then
+			begin_x =  v.x
+			begin_y =  v.y
+		end
+	end
+
+	return covered
+end
+
+-- Clip the ring poly, a list of {x, y}, to tiles of size by size. Returns the
+-- tiles the ring passes through with their polygons and the points where it
+-- crosses the grid lines, along with the index of those by tile that
+-- open_states takes.
+function lib.clip(poly, size)
+	local intersects = polygon_intersections(poly, size)
+	if #intersects == 0 then
+		return {}, intersects, {}, {}
+	end
+	anno_points_consumed(poly, intersects)
+	anno_enter_exit(size, intersects)
+
+	local gindex, index = index_intersections_tile_enter(intersects)
+
+	local grid_polys = create_polygon_for_grid_tiles(poly, size, gindex, index, intersects)
+	return grid_polys, intersects, gindex, index
+end
+
+-- The tile of a point
+local function tile_of(size, x, y)
+	return math.floor(x / size) + 1, math.floor(y / size) + 1
+end
+
+local function get_tile(grid, size, gx, gy)
+	local row = grid[gy]
+	if row == nil then
+		row = {}
+		grid[gy] = row
+	end
+	local tile = row[gx]
+	if tile == nil then
+		tile = {
+			x = gx,
+			y = gy,
+			x0 = (gx-1) * size,
+			y0 = (gy-1) * size,
+			x1 = gx * size,
+			y1 = gy * size,
+			pieces = {},
+			crossed = {},
+		}
+		row[gx] = tile
+	end
+	return tile
+end
+
+-- Where the ring crosses the horizontal lines through the middle of the tile
+-- rows, by row
+local function row_crossings(ring, size, rows)
+	for i = 1,#ring do
+		local p = ring[i]
+		local q = ring[(i%#ring)+1]
+		local lo, hi = math.min(p[2], q[2]), math.max(p[2], q[2])
+		-- The rows with their middle in [lo, hi)
+		for gy = math.ceil(lo / size + 0.5), math.ceil(hi / size + 0.5) - 1 do
+			local my = (gy - 0.5) * size
+			local x = p[1] + (my - p[2]) / (q[2] - p[2]) * (q[1] - p[1])
+			local row = rows[gy]
+			if row == nil then
+				row = {}
+				rows[gy] = row
+			end
+			table.insert(row, x)
+		end
+	end
+end
+
+-- How many of the sorted xs are left of x
+local function count_below(xs, x)
+	local low, high = 1, #xs
+	while low <= high do
+		local pivot = math.floor((high - low) / 2) + low
+		if xs[pivot] < x then
+			low = pivot + 1
+		else
+			high = pivot - 1
+		end
+	end
+	return low - 1
+end
+
+-- Add the edges of the closed polygon, a list of {x, y}, to the edges of the
+-- tile. Edges along the tile border go on the side they are on, so the same
+-- stretch of border from more than one polygon can cancel out
+local function add_outline(tile, pts)
+	for i = 1,#pts do
+		local a = pts[i]
+		local b = pts[(i%#pts)+1]
+		if a[1] == b[1] and a[2] == b[2] then
+			-- Nothing
+		elseif a[1] == b[1] and (a[1] == tile.x0 or a[1] == tile.x1) then
+			table.insert(tile.sides[a[1] == tile.x0 and 1 or 2], {a[2], b[2]})
+		elseif a[2] == b[2] and (a[2] == tile.y0 or a[2] == tile.y1) then
+			table.insert(tile.sides[a[2] == tile.y0 and 3 or 4], {a[1], b[1]})
+		else
+			table.insert(tile.inner, {a, b})
+		end
+	end
+end
+
+-- Turn the outlines of a tile into a polygon in the {v, e} form triangulate
+-- takes. The stretches of border covered an even number of times are left out
+local function tile_poly(tile)
+	local poly = {v = {}, e = {}, x = tile.x, y = tile.y}
+	local ids = {}
+	local function vert(x, y)
+		local col = ids[x]
+		if col == nil then
+			col = {}
+			ids[x] = col
+		end
+		if col[y] == nil then
+			table.insert(poly.v, {x, y})
+			col[y] = #poly.v
+		end
+		return col[y]
+	end
+
+	for _, e in ipairs(tile.inner) do
+		table.insert(poly.e, {vert(e[1][1], e[1][2]), vert(e[2][1], e[2][2])})
+	end
+	for side = 1,4 do
+		-- Flip the parity at both ends of every stretch, what's left odd
+		-- between two stops is border
+		local flips = {}
+		for _, span in ipairs(tile.sides[side]) do
+			for k = 1,2 do
+				flips[span[k]] = not flips[span[k]]
+			end
+		end
+		local stops = {}
+		for t in pairs(flips) do
+			table.insert(stops, t)
+		end
+		table.sort(stops)
+
+		local odd = false
+		for i = 1,#stops-1 do
+			odd = odd ~= flips[stops[i]]
+			if odd then
+				local a, b = stops[i], stops[i+1]
+				if side <= 2 then
+					local x = side == 1 and tile.x0 or tile.x1
+					table.insert(poly.e, {vert(x, a), vert(x, b)})
+				else
+					local y = side == 3 and tile.y0 or tile.y1
+					table.insert(poly.e, {vert(a, y), vert(b, y)})
+				end
+			end
+		end
+	end
+	return poly
+end
+
+-- Split the area inside rings into tiles of size by size that can be
+-- triangulated on their own, one polygon per tile that has any of it. The
+-- rings are lists of {x, y} that all wind the same way, positive by winding,
+-- so holes are the rings inside an odd number of others.
+--
+-- The polygons come out in the {v, e} form of triangulate, with x and y set
+-- to the tile. Neighbouring tiles have the same vertices on the border
+-- between them, so the meshes can be stitched back together. Keep size an
+-- integer, so the grid lines are exact.
+function lib.jobs(rings, size)
+	local grid = {}
+	local rows = {}
+	-- The crossings of every ring by row, to tell if a tile is in it
+	local ring_rows = {}
+
+	for ri, ring in ipairs(rings) do
+		local grid_polys, intersects = lib.clip(ring, size)
+		if #intersects == 0 then
+			-- The whole ring is in one tile
+			local tile = get_tile(grid, size, tile_of(size, ring[1][1], ring[1][2]))
+			table.insert(tile.pieces, ring)
+			tile.crossed[ri] = true
+		end
+		for _, gp in ipairs(grid_polys) do
+			local tile = get_tile(grid, size, gp.x, gp.y)
+			tile.crossed[ri] = true
+			for _, flat in ipairs(gp.polys) do
+				local pts = {}
+				for i = 1,#flat,2 do
+					-- Keep the points on the border exactly on it
+					local x, y = flat[i], flat[i+1]
+					x = x == 0 and tile.x0 or x == size and tile.x1 or tile.x0 + x
+					y = y == 0 and tile.y0 or y == size and tile.y1 or tile.y0 + y
+					table.insert(pts, {x, y})
+				end
+				table.insert(tile.pieces, pts)
+			end
+		end
+
+		local rr = {}
+		row_crossings(ring, size, rr)
+		for gy, xs in pairs(rr) do
+			table.sort(xs)
+			local row = rows[gy]
+			if row == nil then
+				row = {}
+				rows[gy] = row
+			end
+			for _, x in ipairs(xs) do
+				table.insert(row, x)
+			end
+		end
+		ring_rows[ri] = rr
+	end
+	for _, row in pairs(rows) do
+		table.sort(row)
+	end
+
+	-- The tiles no ring goes through are either all in or all out. Those in
+	-- are between an odd and an even crossing in their row
+	for gy, row in pairs(rows) do
+		for i = 1,#row-1,2 do
+			local lo = math.floor(row[i] / size + 0.5) + 1
+			local hi = math.ceil(row[i+1] / size + 0.5) - 1
+			for gx = lo,hi do
+				get_tile(grid, size, gx, gy)
+			end
+		end
+	end
+
+	local jobs = {}
+	for gy, grow in pairs(grid) do
+		local row = rows[gy] or {}
+		for gx, tile in pairs(grow) do
+			-- The square is in for every ring around it that doesn't go
+			-- through the tile, which is all of them but the ones that
+			-- do
+			local mx = (gx - 0.5) * size
+			local inside = count_below(row, mx)
+			for ri in pairs(tile.crossed) do
+				local xs = ring_rows[ri][gy]
+				if xs ~= nil then
+					inside = inside - count_below(xs, mx)
+				end
+			end
+
+			tile.sides = {{}, {}, {}, {}}
+			tile.inner = {}
+			if inside % 2 == 1 then
+				add_outline(tile, {
+					{tile.x0, tile.y0},
+					{tile.x0, tile.y1},
+					{tile.x1, tile.y1},
+					{tile.x1, tile.y0},
+				})
+			end
+			for _, pts in ipairs(tile.pieces) do
+				add_outline(tile, pts)
+			end
+
+			local poly = tile_poly(tile)
+			if #poly.e > 0 then
+				table.insert(jobs, poly)
+			end
+		end
+	end
+	table.sort(jobs, function(a, b)
+		if a.y ~= b.y then
+			return a.y < b.y
+		end
+		return a.x < b.x
+	end)
+	return jobs
+end
+
+lib.open_states = anno_open_states
+lib.is_covered = is_covered
+lib.point_to_circumlength = point_to_circumlength
+lib.circumlength_to_point = circumlength_to_point
+
+return lib
@@ -3,6 +3,22 @@
 
 local SAFE = false
 local triang = require("triangulation")
+local mesh = require("mesh")
+local predicates = require("predicates")
+local tiles = require("tiles")
+local simplify = require("simplify")
+
+-- How far the rings may stray from the OSM ways, in the units of transform.
+-- About a metre in Denmark. 0 keeps every node
+local SIMPLIFY_TOLERANCE = 0.001
+
+-- Make a pyramid of meshes with less detail for the zooms further out, and
+-- draw the one for the zoom. There's a level for each of LOD_ZOOMS that
+-- would be simplified more than SIMPLIFY_TOLERANCE, and they are off by
+-- about LOD_PIXELS on screen at their zoom
+local LOD_PYRAMID = false
+local LOD_ZOOMS = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512}
+local LOD_PIXELS = 0.5
 
 outer = {
 	v = {
@@ -46,28 +62,21 @@ function drawEdges(verts, edges)
 	end
 end
 
-function drawTris(verts, tris, labels, edge_labels)
-	for i, tri in pairs(tris) do
-		v1 = verts[tri[1]]
-		v2 = verts[tri[2]]
-		v3 = verts[tri[3]]
-		pv = {}
-		for i, v in ipairs(tri) do
-			pv[#pv+1] = verts[v][1] * zoom
-			pv[#pv+1] = verts[v][2] * zoom
-		end
-		-- love.graphics.polygon("fill", pv)
-
-		dline(verts[tri[1]], verts[tri[2]])
-		dline(verts[tri[2]], verts[tri[3]])
-		dline(verts[tri[3]], verts[tri[1]])
-		love.graphics.print(labels[i], (v1[1]+v2[1]+v3[1])/3*zoom, (v1[2]+v2[2]+v3[2])/3*zoom)
-
-		if incircle(v1, v2, v3, {mx, my}) then
-
-		-- love.graphics.print(edge_labels[i][1], (v2[1]+v3[1])/2*zoom, (v2[2]+v3[2])/2*zoom)
-		-- love.graphics.print(edge_labels[i][2], (v1[1]+v3[1])/2*zoom, (v1[2]+v3[2])/2*zoom)
-		-- love.graphics.print(edge_labels[i][3], (v2[1]+v1[1])/2*zoom, (v2[2]+v1[2])/2*zoom)
+function drawTris(face)
+	local x, y, tv = face.x, face.y, face.tv
+	for i = 1,face.nt do
+		local h = i*3
+		v1 = {x[tv[h]], y[tv[h]]}
+		v2 = {x[tv[h+1]], y[tv[h+1]]}
+		v3 = {x[tv[h+2]], y[tv[h+2]]}
+		-- love.graphics.polygon("fill", v1[1]*zoom, v1[2]*zoom, v2[1]*zoom, v2[2]*zoom, v3[1]*zoom, v3[2]*zoom)
+
+		dline(v1, v2)
+		dline(v2, v3)
+		dline(v3, v1)
+		love.graphics.print(tostring(i), (v1[1]+v2[1]+v3[1])/3*zoom, (v1[2]+v2[2]+v3[2])/3*zoom)
+
+		if incircle(v1[1], v1[2], v2[1], v2[2], v3[1], v3[2], mx, my) then
 			cx, cy = circumcenter(v1, v2, v3)
 			cr = circumr(v1, v2, v3)
 			-- love.graphics.points(cx, cy)
@@ -101,60 +110,25 @@ end
 function drawpol(pol)
 	love.graphics.setLineWidth(.1)
 	local verts = pol["v"]
+	local edges = pol["e"]
 
-	if pol.t ~= nil then
-
-		local tris = pol.t
-		local labels = {}
-		for i, _ in pairs(tris) do
-			labels[i] = tostring(i)
-		end
-
-		if true then
-			local edge_labels = {}
-			-- table_print(pol)
-			-- for i, v in pairs(pol.adj) do
-			-- 	edge_labels[i] = {adj_tostr(v[1]), adj_tostr(v[2]), adj_tostr(v[3])}
-			-- end
-
-			drawTris(verts, tris, labels, edge_labels)
-		else
-			local v_tris = {}
-			local i_tris = {}
-			local nv_tris = {}
-			local v_labels = {}
-			local i_labels = {}
-			local nv_labels = {}
-			local offset = 0
-			for i, v in pairs(tris) do
-				if insides[i] == nil then
-					table.insert(nv_tris, v)
-					table.insert(nv_labels, labels[i])
-				elseif insides[i] then
-					table.insert(i_tris, v)
-					table.insert(i_labels, labels[i])
-				else
-					table.insert(v_tris, v)
-					table.insert(v_labels, labels[i])
-				end
-			end
+	if pol.tv ~= nil then
+		drawTris(pol)
 
-			drawTris(verts, nv_tris, nv_labels, {})
-			love.graphics.setColor(0, 0, 255)
-			drawTris(verts, v_tris, v_labels, {})
-			love.graphics.setColor(255, 0, 255)
-			drawTris(verts, i_tris, i_labels, {})
-			love.graphics.setColor(255, 255, 255)
+		verts = {}
+		for i = 1,pol.nv do
+			verts[i] = {pol.x[i], pol.y[i]}
 		end
+		edges = mesh.fixed_edges(pol)
 	end
 
-	if pol.e ~= nil then
-		if pol.t ~= nil then
+	if edges ~= nil then
+		if pol.tv ~= nil then
 			love.graphics.setColor(0, 255, 0)
 			love.graphics.setLineWidth(.1)
 		end
 
-		drawEdges(verts, pol.e)
+		drawEdges(verts, edges)
 
 		love.graphics.setLineWidth(.1)
 		love.graphics.setColor(255, 255, 255)
@@ -204,38 +178,7 @@ function bbox(poly)
 end
 
 function superTri(bbox)
-	verts = bbox["v"]
-	center = {
-		(verts[1][1] + verts[3][1]) / 2.0,
-		(verts[1][2] + verts[3][2]) / 2.0,
-	}
-	size = {
-		verts[3][1] - verts[1][1],
-		verts[3][2] - verts[1][2],
-	}
-	inrad = math.sqrt(math.pow(size[1], 2) + math.pow(size[2], 2)) / 2
-	outrad = inrad * 2
-	stride = outrad * math.sqrt(3/2.0)
-	return {
-		v = {
-			{center[1] - stride, center[2] - inrad},
-			{center[1], center[2] + outrad},
-			{center[1] + stride, center[2] - inrad},
-		},
-		t = {
-			{1, 2, 3},
-		},
-		e={
-		},
-		adj={
-			{{nil, nil}, {nil, nil}, {nil, nil}},
-		},
-		inv_t = {
-			{1, 1},
-			{1, 2},
-			{1, 3},
-		}
-	}
+	return triang.superTri(bbox)
 end
 
 function det(p1, p2)
@@ -695,6 +638,8 @@ local json = require("json")
 local rings = require("rings")
 local testlib = require("testlib")
 local poly = nil
+-- The mesh pyramid, with LOD_PYRAMID
+local lod = nil
 local nextline = nil
 function love.load(args)
 	for i, arg in ipairs(args) do
@@ -834,7 +779,38 @@ function love.load(args)
 		local rings = rings.find(nodes, ways, relation)
 		-- table_print(rings)
 
-		function build_poly(ring, nodes, ways)
+		local function node_point(node)
+			return {transform(node[2]/10000000, node[1]/10000000)}
+		end
+
+		-- The member ways of every relation that was loaded and their nodes,
+		-- for simplify. How a way is simplified depends on the ways around
+		-- it, so they are all simplified in one go. Then a way that two
+		-- relations share is simplified the same in both, and none of them
+		-- cross. Ways with nodes that weren't loaded can't be drawn and are
+		-- left out
+		local lines = {}
+		local points = {}
+		for _, rel in pairs(relations) do
+			for _, id in ipairs(rel.memids) do
+				local way = ways[id]
+				if way ~= nil and lines[id] == nil then
+					local complete = true
+					for _, ref in ipairs(way.refs) do
+						complete = complete and nodes[ref] ~= nil
+					end
+					if complete then
+						lines[id] = way.refs
+						for _, ref in ipairs(way.refs) do
+							points[ref] = points[ref] or node_point(nodes[ref])
+						end
+					end
+				end
+			end
+		end
+
+		-- keep is what simplify.lines gave, nil to keep every node
+		function build_poly(ring, nodes, ways, keep)
 			local poly = {
 				v={},
 				e={},
@@ -857,7 +833,9 @@ function love.load(args)
 				end
 				for k2, v2 in it(ways[v[1]].refs) do
 					print(k, v[1], v[2], k2, v2, nodes[v2][1]/10000000, nodes[v2][2]/10000000)
-					if not skip_vert then
+					if keep ~= nil and not keep[v[1]][k2] then
+						-- Simplified away, ways always keep their ends
+					elseif not skip_vert then
 						if skip == 0 then
 							local x, y = transform(nodes[v2][2]/10000000, nodes[v2][1]/10000000)
 
@@ -902,7 +880,20 @@ function love.load(args)
 			poly.v[k][1] = (v[1]-160) * 160
 			poly.v[k][2] = (v[2]-180) * 160
 		end
-		poly = build_poly(rings[1], nodes, ways)
+		local keep = nil
+		if LOD_PYRAMID then
+			lod = lod_pyramid(lines, points, function(kept)
+				local polys = {}
+				for _, ring in ipairs(rings) do
+					table.insert(polys, build_poly(ring, nodes, ways, kept))
+				end
+				return polys
+			end)
+			keep = lod[1].keep
+		elseif SIMPLIFY_TOLERANCE > 0 then
+			keep = simplify.lines(lines, points, SIMPLIFY_TOLERANCE)
+		end
+		poly = build_poly(rings[1], nodes, ways, keep)
 		pbf = nil
 		ri = nil
 		rv = nil
@@ -1049,7 +1040,7 @@ function love.load(args)
 	end
 
 	if false then
-		face = {
+		face = mesh.from_tables({
 			v = {
 				{100, 300},
 				{200, 200},
@@ -1109,7 +1100,7 @@ function love.load(args)
 				{104, 1},
 				{105, 3},
 			},
-		}
+		})
 		assert(check(face))
 		local res = triang.add_edge(face, 1, 5)
 		table_print(face)
@@ -1147,11 +1138,7 @@ function love.load(args)
 				io.write(string.format("    {%d, %d},\n", vertset[v1i], vertset[v2i]))
 			end
 			io.write(string.format("},\n"))
-			face = {
-				v = {},
-				e = {},
-				t = {},
-			}
+			face = mesh.new()
 		end
 		-- Code block and/or called functions to profile --
 		profiler.stop()
@@ -1237,27 +1224,13 @@ function love.load(args)
 	-- table_print(ring)
 end
 
-function find_closest_vert(face, p)
-	-- If you had some sort of cool R-tree here you could probably make this
-	-- fast
-	local closest = nil
-	local closest_dist = nil
-	for i, v in ipairs(face.v) do
-		local dx, dy = p[1] - v[1], p[2] - v[2]
-		local dist = vec_len_sq(dx, dy)
-		if closest == nil or dist < closest_dist then
-			closest = i
-			closest_dist = dist
-		end
-	end
-
-	return closest
-end
-
 function find_tri_with_vert(face, needle)
 	if true then
-		local tbl = face.inv_t[needle]
-		return tbl[1], tbl[2]
+		local h = face.vt[needle]
+		if h == mesh.NONE then
+			return nil, nil
+		end
+		return mesh.corner(h)
 	else
 		-- for i, tri in pairs(face.t) do
 		-- 	for i2, v in ipairs(tri) do
@@ -1269,25 +1242,22 @@ function find_tri_with_vert(face, needle)
 	end
 end
 
-function unpack_or_nil(tbl)
-	if tbl == nil then
-		return nil, nil
-	end
-
-	return unpack(tbl)
-end
-
 -- based on
 -- https://ntrs.nasa.gov/api/citations/19770025881/downloads/19770025881.pdf
 -- section 2.4, Yeah it feels pretty cool to implement something based on JPL's
 -- work in 1977.
 function find_containing_tri(face, p, start_tri)
 	local tri, triv = start_tri, 1
-	if start_tri == nil or face.t[tri] == nil then
-		local vert = find_closest_vert(face, p)
+	if start_tri == nil or start_tri > face.nt then
+		local vert = mesh.near_vert(face, p[1], p[2])
+		if vert == nil then
+			return nil
+		end
 		tri, triv = find_tri_with_vert(face, vert)
 	end
 
+	local x, y = face.x, face.y
+	local tv = face.tv
 	local containing_tri = nil
 	while true do
 		if tri == nil then
@@ -1296,13 +1266,10 @@ function find_containing_tri(face, p, start_tri)
 
 		local found = true
 		for i=1, 3 do
-			local vo = face.t[tri][triv]
-			local vn = face.t[tri][anticlockwise_vert(triv)]
-			local vpx, vpy = vec_minus(face.v[vo][1], face.v[vo][2], p[1], p[2])
-			local vnx, vny = vec_minus(face.v[vo][1], face.v[vo][2], face.v[vn][1], face.v[vn][2])
+			local vo = tv[mesh.half(tri, triv)]
+			local vn = tv[mesh.half(tri, anticlockwise_vert(triv))]
 
-			local cross = vec_cross(vnx, vny, vpx, vpy)
-			if cross > 0 then
+			if predicates.orient2d(x[vo], y[vo], x[vn], y[vn], p[1], p[2]) > 0 then
 				found = false
 				break
 			end
@@ -1314,7 +1281,7 @@ function find_containing_tri(face, p, start_tri)
 			break
 		end
 
-		tri, triv = unpack_or_nil(opposing_tri(face, tri, clockwise_vert(triv)))
+		tri, triv = opposing_tri(face, tri, clockwise_vert(triv))
 	end
 
 	if false then
@@ -1359,7 +1326,11 @@ function opposing_tri(face, tri, vert)
 	assert(vert <= 3)
 	assert(vert >= 1)
 	-- if true then
-		return face.adj[tri][vert]
+		local h = face.adj[mesh.half(tri, vert)]
+		if h == mesh.NONE then
+			return nil
+		end
+		return mesh.corner(h)
 	-- elseif false then
 	-- 	for i, stri in pairs(face.t) do
 	-- 		local unmatched = nil
@@ -1412,66 +1383,45 @@ function opposing_tri(face, tri, vert)
 	-- end
 end
 
-function incircle(a, b, c, d)
-	local adx = a[1] - d[1]
-	local ady = a[2] - d[2]
-	local bdx = b[1] - d[1]
-	local bdy = b[2] - d[2]
-	local cdx = c[1] - d[1]
-	local cdy = c[2] - d[2]
-
-	local bcdet = bdx * cdy - bdy * cdx
-	local cadet = cdx * ady - cdy * adx
-	local abdet = adx * bdy - ady * bdx
-
-	local alift = adx * adx + ady * ady
-	local blift = bdx * bdx + bdy * bdy
-	local clift = cdx * cdx + cdy * cdy
-
-	local deter = alift * bcdet + blift * cadet + clift * abdet
-	return deter <= 0
+-- Whether d is inside the circle through a, b and c, or on it. The mesh is
+-- clockwise, so that's a negative determinant
+function incircle(ax, ay, bx, by, cx, cy, dx, dy)
+	return predicates.incircle(ax, ay, bx, by, cx, cy, dx, dy) <= 0
 end
 
 function split_tri(face, tri1, p)
-	local tri = face.t[tri1]
-	local v0 = tri[1]
-	local v1 = tri[2]
-	local v2 = tri[3]
+	local v3 = mesh.add_vert(face, p[1], p[2])
+	-- Insert the new tris
+	local tri2i = mesh.add_tri(face)
+	local tri3i = mesh.add_tri(face)
+
+	local tv, vt, fixed = face.tv, face.vt, face.fixed
+	local h1, h2, h3 = tri1*3, tri2i*3, tri3i*3
+	local v0 = tv[h1]
+	local v1 = tv[h1+1]
+	local v2 = tv[h1+2]
 
-	local o0 = opposing_tri(face, tri1, 1)
-	local o1 = opposing_tri(face, tri1, 2)
-	local o2 = opposing_tri(face, tri1, 3)
+	local o0 = face.adj[h1]
+	local o1 = face.adj[h1+1]
+	local o2 = face.adj[h1+2]
 
-	local v3 = #face.v+1
-	face.v[v3] = p
 	-- Original tri becomes v0 v1 v3
-	tri[3] = v3
-	local tri2 = {v1, v2, v3}
-	local tri3 = {v2, v0, v3}
-	-- Insert the new tris
-	local tri2i = #face.t+1
-	face.t[tri2i] = tri2
-	local tri3i = #face.t+1
-	face.t[tri3i] = tri3
+	tv[h1+2] = v3
+	tv[h2], tv[h2+1], tv[h2+2] = v1, v2, v3
+	tv[h3], tv[h3+1], tv[h3+2] = v2, v0, v3
 
-	if o0 ~= nil and o0[1] ~= nil then
-		face.adj[o0[1]][o0[2]] = {tri2i, 3}
-	end
-	if o1 ~= nil and o1[1] ~= nil then
-		face.adj[o1[1]][o1[2]] = {tri3i, 3}
-	end
-	if o2 ~= nil and o2[1] ~= nil then
-		face.adj[o2[1]][o2[2]] = {tri1, 3}
-	end
+	mesh.link(face, h2+2, o0, fixed[h1])
+	mesh.link(face, h3+2, o1, fixed[h1+1])
+	mesh.link(face, h1+2, o2, fixed[h1+2])
 
-	face.adj[tri3i] = {{tri1, 2}, {tri2i, 1}, o1}
-	face.adj[tri2i] = {{tri3i, 2}, {tri1, 1}, o0}
-	face.adj[tri1] = {{tri2i, 2}, {tri3i, 1}, o2}
+	mesh.link(face, h3, h1+1, 0)
+	mesh.link(face, h3+1, h2, 0)
+	mesh.link(face, h2+1, h1, 0)
 
-	face.inv_t[v0] = {tri1, 1}
-	face.inv_t[v1] = {tri1, 2}
-	face.inv_t[v2] = {tri2i, 2}
-	face.inv_t[v3] = {tri1, 3}
+	vt[v0] = mesh.half(tri1, 1)
+	vt[v1] = mesh.half(tri1, 2)
+	vt[v2] = mesh.half(tri2i, 2)
+	vt[v3] = mesh.half(tri1, 3)
 
 	return tri2i, tri3i
 end
@@ -1551,17 +1501,13 @@ function circumcenter(p1, p2, p3)
 end
 
 local vbefore = {}
-insides = {}
 local offx, offy = 0, 0
 local max_cnt = 0
 zoom = 1
 
-local function is_fixed(face, a, b)
-	return face.e[string.format("%d.%d", a, b)] ~= nil or face.e[string.format("%d.%d", b, a)] ~= nil
-end
-
 function is_tri(face, t, vt, v1, v2, v3)
-	if face.t[t][vt] == v1 and face.t[t][anticlockwise_vert(vt)] == v2 and face.t[t][clockwise_vert(vt)] == v3 then
+	local tv = face.tv
+	if tv[mesh.half(t, vt)] == v1 and tv[mesh.half(t, anticlockwise_vert(vt))] == v2 and tv[mesh.half(t, clockwise_vert(vt))] == v3 then
 		return true
 	end
 
@@ -1578,12 +1524,12 @@ function find_tri(face, v1, v2, v3)
 			return cursor, vcursor
 		end
 
-		local opp = opposing_tri(face, cursor, anticlockwise_vert(vcursor))
+		local opp, oppv = opposing_tri(face, cursor, anticlockwise_vert(vcursor))
 		if opp == nil then
 			break
 		end
-		cursor = opp[1]
-		vcursor = anticlockwise_vert(opp[2])
+		cursor = opp
+		vcursor = anticlockwise_vert(oppv)
 		if cursor == start_cursor then
 			-- If we arrive back, we are done and don't need a clockwise scan
 			return nil
@@ -1598,12 +1544,12 @@ function find_tri(face, v1, v2, v3)
 			return cursor, vcursor
 		end
 
-		local opp = opposing_tri(face, cursor, clockwise_vert(vcursor))
+		local opp, oppv = opposing_tri(face, cursor, clockwise_vert(vcursor))
 		if opp == nil then
 			break
 		end
-		cursor = opp[1]
-		vcursor = clockwise_vert(opp[2])
+		cursor = opp
+		vcursor = clockwise_vert(oppv)
 		if cursor == start_cursor then
 			error("How did we return when going clockwise without doing it when going anticlockwise?")
 		end
@@ -1612,91 +1558,111 @@ function find_tri(face, v1, v2, v3)
 	return nil
 end
 
--- Keep vout 1 and 2 in counterclockwise order
+-- Flag bits trim marks the triangles with, next to mesh.DEAD
+local TRIM_SEEN = 2
+local TRIM_INSIDE = 4
+
+-- Drop the triangles outside the polygon and the super triangle vertices, in
+-- place. The triangles that are left are moved down to fill the gaps and the
+-- vertices shift down by 3.
 function trim(face)
-	print("trim", max_cnt)
-	local tri_cursor, tri_vert = find_tri_with_vert(face, 1)
+	local tri_cursor = find_tri_with_vert(face, 1)
 
-	local visited = {}
+	local tv, adj, fixed, flags = face.tv, face.adj, face.fixed, face.flags
 
-	--  This will end up with one value for each tri
-	insides = {
-		[tri_cursor] = false,
-	}
+	-- Flood fill from a triangle on the super triangle, which is outside.
+	-- Every constrained edge crossed goes in or out of the polygon. It
+	-- carries on with the first new neighbour and stacks the others
 	local stack = {tri_cursor}
-
+	local n = 1
 	local tri = nil
-	-- local cnt = 0
 	while true do
-		-- cnt = cnt + 1
-		-- if cnt > max_cnt then
-		-- 	return
-		-- end
 		if tri == nil then
-			tri = table.remove(stack)
-			if tri == nil then
+			if n == 0 then
 				break
 			end
+			tri = stack[n]
+			n = n - 1
 		end
 
-		local start_vert = tri_vert
-
+		local inside = bit.band(flags[tri], TRIM_INSIDE) ~= 0
 		local next_tri = nil
-		for i = 1,3 do
-			local tseg, vseg = unpack_or_nil(opposing_tri(face, tri, i))
-
-			if tseg ~= nil and visited[tseg] == nil then
-				visited[tseg] = true
-				local s1 = face.t[tseg][clockwise_vert(vseg)]
-				local s2 = face.t[tseg][anticlockwise_vert(vseg)]
-				insides[tseg] = insides[tri] ~= is_fixed(face, s1, s2)
-
-				if next_tri == nil then
-					next_tri = tseg
-				else
-					table.insert(stack, tseg)
+		for h = tri*3,tri*3+2 do
+			local o = adj[h]
+			if o ~= mesh.NONE then
+				local otri = math.floor(o/3)
+				if bit.band(flags[otri], TRIM_SEEN) == 0 then
+					local oflags = TRIM_SEEN
+					if inside ~= (fixed[h] ~= 0) then
+						oflags = oflags + TRIM_INSIDE
+					end
+					flags[otri] = bit.bor(flags[otri], oflags)
+					if next_tri == nil then
+						next_tri = otri
+					else
+						n = n + 1
+						stack[n] = otri
+					end
 				end
 			end
 		end
-
 		tri = next_tri
 	end
 
-	local newface = {
-		t = {},
-		v = {},
-		adj = {},
-	}
-
-	-- Copy over the face
-	for i = 4,#face.v do
-		newface.v[i-3] = face.v[i]
+	-- Where every triangle inside ends up. The ones outside, and the free
+	-- ones the flood fill never gets to, are left out
+	local trimap = ffi.new("int32_t[?]", face.nt+1)
+	local nt = 0
+	for tri = 1,face.nt do
+		if bit.band(flags[tri], TRIM_INSIDE) ~= 0 then
+			nt = nt + 1
+			trimap[tri] = nt
+		end
 	end
 
-	local trimap = {}
-	local trii = 1
-	for tri, inside in ipairs(insides) do
-		if inside then
-			trimap[tri] = trii
-			trii = trii + 1
-		end
+	local x, y, vt = face.x, face.y, face.vt
+	for v = 4,face.nv do
+		x[v-3], y[v-3] = x[v], y[v]
+	end
+	face.nv = face.nv - 3
+	for v = 1,face.nv do
+		vt[v] = mesh.NONE
 	end
 
-	for tri, inside in ipairs(insides) do
-		if inside then
-			local newt = trimap[tri]
-			local t = {}
-			local adj = {}
-			for i = 1,3 do
-				t[i] = face.t[tri][i]-3
-				adj[i] = {trimap[face.adj[tri][i][1]], face.adj[tri][i][2]}
+	-- A triangle only ever moves down, into a slot that has already been
+	-- moved out of
+	for tri = 1,face.nt do
+		local newt = trimap[tri]
+		if newt ~= 0 then
+			local h, newh = tri*3, newt*3
+			for i = 0,2 do
+				local o = adj[h+i]
+				local f = fixed[h+i]
+				if o ~= mesh.NONE then
+					o = trimap[math.floor(o/3)]*3 + o%3
+					if o < 3 then
+						o = mesh.NONE
+					end
+				else
+					f = 0
+				end
+				local v = tv[h+i] - 3
+				tv[newh+i], adj[newh+i], fixed[newh+i] = v, o, f
+				-- Triangles that leaked out of the polygon can still use
+				-- the super triangle
+				if v > 0 then
+					vt[v] = newh+i
+				end
 			end
-			newface.t[newt] = t
-			newface.adj[newt] = adj
+			flags[newt] = 0
 		end
 	end
+	face.nt = nt
+	face.free = {}
+	face.nfree = 0
+	face.grid = nil
 
-	return newface
+	return face
 end
 
 local RANGE = {}
@@ -1801,27 +1767,32 @@ function triangulate(polys)
 	local box = bbox(polys[1])
 	local face = superTri(box)
 
+	-- The points of every edge go in first, all at once so the Delaunay
+	-- triangulation of them can be built in one sweep, then the edges
+	local pts = {}
+	local refs = {}
 	for polyi, poly in ipairs(polys) do
 		local points = {}
-		-- for i, v in ipairs(poly.v) do
-		-- 	points[i] = triang.add_point(face, v)
-		-- end
-
 		for i, e in ipairs(poly.e) do
-			-- if i < 1374 or (i > 1375 and i < 1415) or (i > 1415 and i < 1418) or (i > 1418 and i < 1423) then
-			-- else
-				if points[e[1]] == nil then
-					points[e[1]] = triang.add_point(face, poly.v[e[1]])
-				end
-				if points[e[2]] == nil then
-					points[e[2]] = triang.add_point(face, poly.v[e[2]])
+			for k = 1,2 do
+				if points[e[k]] == nil then
+					pts[#pts+1] = poly.v[e[k]]
+					points[e[k]] = #pts
 				end
-				print("Edge", i, e[1], e[2], points[e[1]], points[e[2]])
-				local success, msg = pcall(triang.add_edge, face, points[e[1]], points[e[2]])
-				if not success then
-					error({msg=msg, edge=i})
-				end
-			-- end
+			end
+		end
+		refs[polyi] = points
+	end
+	local ids = triang.add_points_bulk(face, pts)
+
+	for polyi, poly in ipairs(polys) do
+		local points = refs[polyi]
+		for i, e in ipairs(poly.e) do
+			local p1, p2 = ids[points[e[1]]], ids[points[e[2]]]
+			local success, msg = pcall(triang.add_edge, face, p1, p2)
+			if not success then
+				error({msg=msg, edge=i})
+			end
 		end
 	end
 
@@ -1831,6 +1802,260 @@ function triangulate(polys)
 	return face, 0
 end
 
+-- The closed rings a polygon's edges make, as lists of {x, y} that all wind
+-- the way tiles.jobs wants them
+function poly_rings(poly)
+	local nxt = {}
+	for _, e in ipairs(poly.e) do
+		nxt[e[1]] = e[2]
+	end
+
+	local rings = {}
+	local seen = {}
+	for _, e in ipairs(poly.e) do
+		if not seen[e[1]] then
+			local ring = {}
+			local v = e[1]
+			while not seen[v] do
+				seen[v] = true
+				table.insert(ring, poly.v[v])
+				v = nxt[v]
+				if v == nil then
+					error("The edges don't make closed rings")
+				end
+			end
+
+			local sum = 0
+			for i = 1,#ring do
+				local a, b = ring[i], ring[(i%#ring)+1]
+				sum = sum + (b[1] - a[1]) * (b[2] + a[2])
+			end
+			if sum < 0 then
+				for i = 1,math.floor(#ring/2) do
+					ring[i], ring[#ring-i+1] = ring[#ring-i+1], ring[i]
+				end
+			end
+			table.insert(rings, ring)
+		end
+	end
+	return rings
+end
+
+-- A tile from tiles.jobs as a flat list for a channel, and back
+function pack_tile_job(i, job)
+	local out = {i, job.x, job.y, #job.v}
+	for _, v in ipairs(job.v) do
+		table.insert(out, v[1])
+		table.insert(out, v[2])
+	end
+	table.insert(out, #job.e)
+	for _, e in ipairs(job.e) do
+		table.insert(out, e[1])
+		table.insert(out, e[2])
+	end
+	return out
+end
+
+function unpack_tile_job(list)
+	local job = {x = list[2], y = list[3], v = {}, e = {}}
+	local i = 5
+	for k = 1,list[4] do
+		job.v[k] = {list[i], list[i+1]}
+		i = i + 2
+	end
+	local ne = list[i]
+	i = i + 1
+	for k = 1,ne do
+		job.e[k] = {list[i], list[i+1]}
+		i = i + 2
+	end
+	return list[1], job
+end
+
+local function triangulate_tile(job)
+	local success, face = pcall(triangulate, {job})
+	if not success then
+		local msg = type(face) == "table" and face.msg or face
+		error({msg=msg, tile={job.x, job.y}})
+	end
+	return face
+end
+
+-- Triangulate the jobs on every core with love.thread, see tile_worker.lua.
+-- Without threads they run one after the other
+local function run_tile_jobs(jobs)
+	local faces = {}
+	if love == nil or love.thread == nil or love.system == nil or #jobs < 2 then
+		for i, job in ipairs(jobs) do
+			faces[i] = triangulate_tile(job)
+		end
+		return faces
+	end
+
+	local todo = love.thread.newChannel()
+	local done = love.thread.newChannel()
+	for i, job in ipairs(jobs) do
+		todo:push(pack_tile_job(i, job))
+	end
+	local threads = {}
+	for i = 1,math.min(love.system.getProcessorCount(), #jobs) do
+		todo:push("stop")
+		local thread = love.thread.newThread("tile_worker.lua")
+		thread:start(todo, done)
+		table.insert(threads, thread)
+	end
+
+	local received = 0
+	while received < #jobs do
+		local res = done:demand(1)
+		if res ~= nil then
+			received = received + 1
+			local i = res[1]
+			if res[2] == 0 then
+				error({msg=res[3], tile={jobs[i].x, jobs[i].y}})
+			end
+			faces[i] = mesh.unpack(res, 3)
+		else
+			for _, thread in ipairs(threads) do
+				if thread:getError() ~= nil then
+					error(thread:getError())
+				end
+			end
+		end
+	end
+	return faces
+end
+
+-- Join the meshes of the tiles into one. The vertices on the tile borders
+-- are shared and the triangles on either side of a border are linked, the
+-- border itself isn't a constraint
+function stitch_tiles(jobs, faces, size)
+	local face = mesh.new()
+	local border = {}
+	-- The half edges along a border that the tile on the other side hasn't
+	-- linked yet, by their vertices
+	local open = {}
+
+	for k, job in ipairs(jobs) do
+		local part = faces[k]
+		local x0, y0 = (job.x-1) * size, (job.y-1) * size
+		local x1, y1 = job.x * size, job.y * size
+
+		local vmap = {}
+		for v = 1,part.nv do
+			local x, y = part.x[v], part.y[v]
+			if x == x0 or x == x1 or y == y0 or y == y1 then
+				local col = border[x]
+				if col == nil then
+					col = {}
+					border[x] = col
+				end
+				if col[y] == nil then
+					col[y] = mesh.add_vert(face, x, y)
+				end
+				vmap[v] = col[y]
+			else
+				vmap[v] = mesh.add_vert(face, x, y)
+			end
+		end
+
+		local off = face.nt*3
+		for t = 1,part.nt do
+			local h = t*3
+			-- Corners in the super triangle don't map to anything
+			mesh.add_tri(face, vmap[part.tv[h]], vmap[part.tv[h+1]], vmap[part.tv[h+2]])
+		end
+
+		local tv, adj, fixed = face.tv, face.adj, face.fixed
+		for h = 3,part.nt*3+2 do
+			local nh = h + off
+			fixed[nh] = part.fixed[h]
+			if part.adj[h] ~= mesh.NONE then
+				adj[nh] = part.adj[h] + off
+			else
+				local base = math.floor(nh/3)*3
+				local a = tv[base + (nh-base+1)%3]
+				local b = tv[base + (nh-base+2)%3]
+				local twin = open[b] and open[b][a]
+				if twin ~= nil then
+					mesh.link(face, nh, twin, 0)
+					open[b][a] = nil
+				elseif a ~= 0 and b ~= 0 then
+					open[a] = open[a] or {}
+					open[a][b] = nh
+				end
+			end
+		end
+		for v = 1,part.nv do
+			if part.vt[v] ~= mesh.NONE then
+				face.vt[vmap[v]] = part.vt[v] + off
+			end
+		end
+	end
+	return face
+end
+
+-- The levels of a mesh pyramid, from the most detailed. lines and points are
+-- for simplify, make_polys turns the keep table of a level into the polys to
+-- triangulate. Each level has the zoom it's for, the tolerance it was
+-- simplified with, its keep table and its mesh, nil if it couldn't be
+-- triangulated. The most detailed one is for any zoom
+function lod_pyramid(lines, points, make_polys)
+	local zooms, tolerances = {math.huge}, {SIMPLIFY_TOLERANCE}
+	for i = #LOD_ZOOMS,1,-1 do
+		local tolerance = LOD_PIXELS / LOD_ZOOMS[i]
+		if tolerance > SIMPLIFY_TOLERANCE then
+			table.insert(zooms, LOD_ZOOMS[i])
+			table.insert(tolerances, tolerance)
+		end
+	end
+
+	local pyramid = {}
+	for l, keep in ipairs(simplify.levels(lines, points, tolerances)) do
+		local success, face = pcall(triangulate, make_polys(keep))
+		if not success then
+			print("Triangulating the level for zoom", zooms[l], "failed", face.msg or face)
+			face = nil
+		end
+		pyramid[l] = {
+			zoom = zooms[l],
+			tolerance = tolerances[l],
+			keep = keep,
+			face = face,
+		}
+	end
+	return pyramid
+end
+
+-- The level of the pyramid to draw at zoom, the least detailed one that is
+-- still for that zoom or closer
+function lod_pick(pyramid, zoom)
+	local pick = nil
+	for _, level in ipairs(pyramid) do
+		if level.face ~= nil and level.zoom >= zoom then
+			pick = level
+		end
+	end
+	return pick
+end
+
+-- Triangulate polys one square of the grid at a time, in parallel when
+-- there are threads to do it. The edges of the polys have to make closed
+-- rings. Returns the tiles stitched into one mesh and the jobs and meshes of
+-- the tiles on their own
+function triangulate_tiles(polys, size)
+	local rings = {}
+	for _, poly in ipairs(polys) do
+		for _, ring in ipairs(poly_rings(poly)) do
+			table.insert(rings, ring)
+		end
+	end
+
+	local jobs = tiles.jobs(rings, size)
+	local faces = run_tile_jobs(jobs)
+	return stitch_tiles(jobs, faces, size), jobs, faces
+end
+
 function love.draw()
 	love.graphics.translate(offx, offy)
 	-- love.graphics.scale(zoom, zoom)
@@ -1916,7 +2141,12 @@ function love.draw()
 	-- 		dline({lastx, lasty}, {v2x, v2y})
 	-- 	end
 	-- end
-	drawpol(face)
+	local level = lod ~= nil and lod_pick(lod, zoom)
+	if level then
+		drawpol(level.face)
+	else
+		drawpol(face)
+	end
 	if nextline ~= nil then
 		love.graphics.setColor(255, 0, 255)
 		dline(nextline[1], nextline[2])
@@ -1991,24 +2221,28 @@ function check(face)
 		return true
 	end
 
-	if #face.inv_t ~= #face.v then
-		error("Not enough inverse")
-	end
+	local x, y = face.x, face.y
+	local tv = face.tv
 
-	for vi, v in pairs(face.inv_t) do
-		if face.t[v[1]][v[2]] ~= vi then
-			table_print({vi, v, face.t[v[1]]})
+	for vi = 1,face.nv do
+		local h = face.vt[vi]
+		if h == mesh.NONE then
+			error("Not enough inverse")
+		end
+		if tv[h] ~= vi then
+			table_print({vi, mesh.corner(h)})
 			error("inv_t did not point to correct triangle")
 		end
 	end
 
-	for _, e1 in pairs(face.e) do
-		local v1 = face.v[e1[1]]
-		local v2 = face.v[e1[2]]
-		for _, e2 in pairs(face.e) do
+	local edges = mesh.fixed_edges(face)
+	for _, e1 in pairs(edges) do
+		local v1 = {x[e1[1]], y[e1[1]]}
+		local v2 = {x[e1[2]], y[e1[2]]}
+		for _, e2 in pairs(edges) do
 			if e1 ~= e2 then
-				local v3 = face.v[e2[1]]
-				local v4 = face.v[e2[2]]
+				local v3 = {x[e2[1]], y[e2[1]]}
+				local v4 = {x[e2[2]], y[e2[2]]}
 
 				local tu = (v1[1] - v3[1]) * (v3[2] - v4[2]) - (v1[2] - v3[2]) * (v3[1] - v4[1])
 				local tl = (v1[1] - v2[1]) * (v3[2] - v4[2]) - (v1[2] - v2[2]) * (v3[1] - v4[1])
@@ -2026,48 +2260,47 @@ function check(face)
 	end
 
 	local inv_adj = {}
-	for i, v in ipairs(face.adj) do
-		for i2, v2 in ipairs(v) do
-			if inv_adj[v2] ~= nil then
-				table_print({v2})
+	for h = 3,face.nt*3+2 do
+		local o = face.adj[h]
+		if o ~= mesh.NONE then
+			if inv_adj[o] ~= nil then
+				table_print({mesh.corner(o)})
 				error("Adjecency value used multiple timed")
 			end
-			inv_adj[v2] = {i, i2}
+			inv_adj[o] = h
 		end
 	end
 
-	for i, v in ipairs(face.adj) do
-		for i2, v2 in ipairs(v) do
-			if i == v2[1] then
+	for i = 1,face.nt do
+		for i2 = 1,3 do
+			local otri, overt = opposing_tri(face, i, i2)
+			if i == otri then
 				error("Triangle is adjecent to itself", i)
 			end
 
-			local otri, overt = unpack_or_nil(opposing_tri(face, i, i2))
 			if otri ~= nil then
-				local stri, svert = unpack_or_nil(opposing_tri(face, otri, overt))
+				local stri, svert = opposing_tri(face, otri, overt)
 				if stri ~= i or svert ~= i2 then
 					error("Opposing adjecency doesn't match", i, i2, stri, svert)
 				end
+				if face.fixed[mesh.half(i, i2)] ~= face.fixed[mesh.half(otri, overt)] then
+					error("Only one side of the edge is constrained", i, i2)
+				end
 			end
 		end
 	end
 
-	for i, tri in ipairs(face.t) do
-		reverse = {}
-		for i, v in ipairs(tri) do
-			if reverse[v] == true then
-				error("Duplicated vertex in tri ", i, v)
-			end
-			reverse[v] = true
+	for i = 1,face.nt do
+		local h = i*3
+		if tv[h] == tv[h+1] or tv[h+1] == tv[h+2] or tv[h+2] == tv[h] then
+			error("Duplicated vertex in tri ", i)
 		end
-		a = face.v[tri[1]]
-		b = face.v[tri[2]]
-		c = face.v[tri[3]]
-		abx, aby = vec_minus(b[1], b[2], a[1], a[2])
-		acx, acy = vec_minus(c[1], c[2], a[1], a[2])
+		a = {x[tv[h]], y[tv[h]]}
+		b = {x[tv[h+1]], y[tv[h+1]]}
+		c = {x[tv[h+2]], y[tv[h+2]]}
 
 		-- amx, amy = vec_minus(mx, my, a[1], a[2])
-		if vec_cross(abx, aby, acx, acy) > 0 then
+		if predicates.orient2d(a[1], a[2], b[1], b[2], c[1], c[2]) > 0 then
 			table_print({"Bad winding on ", i, a, b, c})
 			error("Bad winding")
 		end
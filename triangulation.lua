@@ -1,3 +1,7 @@
+local ffi = require("ffi")
+local mesh = require("mesh")
+local predicates = require("predicates")
+
 local lib = {}
 
 local function bbox(poly)
@@ -44,82 +48,75 @@ function lib.superTri(bbox)
 	inrad = math.sqrt(math.pow(size[1], 2) + math.pow(size[2], 2)) / 2
 	outrad = inrad * 2
 	stride = outrad * math.sqrt(3/2.0)
-	return {
-		v = {
-			{center[1] - stride, center[2] - inrad},
-			{center[1], center[2] + outrad},
-			{center[1] + stride, center[2] - inrad},
-		},
-		t = {
-			{1, 2, 3},
-		},
-		e={
-		},
-		adj={
-			{{nil, nil}, {nil, nil}, {nil, nil}},
-		},
-		inv_t = {
-			{1, 1},
-			{1, 2},
-			{1, 3},
-		}
-	}
-end
-
-local function is_fixed(face, a, b)
-	return face.e[string.format("%d.%d", a, b)] ~= nil or face.e[string.format("%d.%d", b, a)] ~= nil
-end
 
-local function set_fixed(face, a, b)
-	face.e[string.format("%d.%d", a, b)] = {a, b}
+	local face = mesh.new()
+	mesh.set_bounds(face, verts[1][1], verts[1][2], verts[3][1], verts[3][2])
+	mesh.add_vert(face, center[1] - stride, center[2] - inrad)
+	mesh.add_vert(face, center[1], center[2] + outrad)
+	mesh.add_vert(face, center[1] + stride, center[2] - inrad)
+	local t = mesh.add_tri(face, 1, 2, 3)
+	for i = 1,3 do
+		face.vt[i] = mesh.half(t, i)
+	end
+	return face
 end
 
-local function resolve_with_swaps(sutri, tri1, v3, stack)
-	while #stack ~= 0 do
-		local tri, t_me = unpack(table.remove(stack))
-		local t_opt = opposing_tri(sutri, tri, t_me)
-		if t_opt[1] ~= nil then
-			local t_opi, oppo_vert = unpack(t_opt)
-			local t_op = sutri.t[t_opi]
+-- Scratch space kept between calls, so adding points and edges doesn't
+-- allocate once these have grown to fit.
+--
+-- The half edges that might have to be flipped
+local swaps = {}
+-- The vertices of the cavity add_edge cuts out above the edge, then 0, then
+-- the ones below it. For every edge of the cavity chain_out holds the half
+-- edge outside it, chain_fixed whether it's constrained and chain_in the half
+-- edge of the new triangle inside.
+local chain = {}
+local chain_out = {}
+local chain_fixed = {}
+local chain_in = {}
+-- In chain_out for the cavity edges that are linked to each other instead
+local LINKED = -2
+local lower = {}
+local lower_out = {}
+local lower_fixed = {}
+
+local function resolve_with_swaps(sutri, tri1, v3, n)
+	local x, y = sutri.x, sutri.y
+	local tv, adj, vt, fixed = sutri.tv, sutri.adj, sutri.vt, sutri.fixed
+	while n ~= 0 do
+		local tri, t_me = mesh.corner(swaps[n])
+		n = n - 1
+		local t_opt = adj[mesh.half(tri, t_me)]
+		if t_opt ~= mesh.NONE then
+			local t_opi, oppo_vert = mesh.corner(t_opt)
 			local oppo_clock = clockwise_vert(oppo_vert)
 			local me_clock = clockwise_vert(t_me)
 			local t_op_swap = anticlockwise_vert(oppo_vert)
-			if not is_fixed(sutri, sutri.t[t_opi][oppo_clock], sutri.t[t_opi][t_op_swap])
-				and incircle(sutri.v[t_op[1]], sutri.v[t_op[2]], sutri.v[t_op[3]], sutri.v[v3]) then
+			local a, b, c = tv[t_opi*3], tv[t_opi*3+1], tv[t_opi*3+2]
+			if fixed[t_opt] == 0
+				and incircle(x[a], y[a], x[b], y[b], x[c], y[c], x[v3], y[v3]) then
 				local t_me_swap = anticlockwise_vert(t_me)
 
 				-- Reassign the adjecency information
-				local t3 = opposing_tri(sutri, tri, me_clock)
-				local t2 = opposing_tri(sutri, t_opi, oppo_clock)
-
-				sutri.adj[tri][t_me][1] = t2[1]
-				sutri.adj[tri][t_me][2] = t2[2]
-				if t2[1] ~= nil then
-					sutri.adj[t2[1]][t2[2]][1] = tri
-					sutri.adj[t2[1]][t2[2]][2] = t_me
-				end
-				sutri.adj[t_opi][oppo_vert][1] = t3[1]
-				sutri.adj[t_opi][oppo_vert][2] = t3[2]
-				if t3[1] ~= nil then
-					sutri.adj[t3[1]][t3[2]][1] = t_opi
-					sutri.adj[t3[1]][t3[2]][2] = oppo_vert
-				end
-				sutri.adj[tri][me_clock][1] = t_opi
-				sutri.adj[tri][me_clock][2] = oppo_clock
-				sutri.adj[t_opi][oppo_clock][1] = tri
-				sutri.adj[t_opi][oppo_clock][2] = me_clock
+				local t3 = adj[mesh.half(tri, me_clock)]
+				local t2 = adj[mesh.half(t_opi, oppo_clock)]
+				local f3 = fixed[mesh.half(tri, me_clock)]
+				local f2 = fixed[mesh.half(t_opi, oppo_clock)]
+
+				mesh.link(sutri, mesh.half(tri, t_me), t2, f2)
+				mesh.link(sutri, mesh.half(t_opi, oppo_vert), t3, f3)
+				mesh.link(sutri, mesh.half(tri, me_clock), mesh.half(t_opi, oppo_clock), 0)
 
-				sutri.inv_t[sutri.t[tri][t_me_swap]][1] = t_opi
-				sutri.inv_t[sutri.t[tri][t_me_swap]][2] = oppo_clock
-				sutri.inv_t[sutri.t[t_opi][t_op_swap]][1] = tri
-				sutri.inv_t[sutri.t[t_opi][t_op_swap]][2] = me_clock
+				vt[tv[mesh.half(tri, t_me_swap)]] = mesh.half(t_opi, oppo_clock)
+				vt[tv[mesh.half(t_opi, t_op_swap)]] = mesh.half(tri, me_clock)
 
 				-- Flip edge
-				t_op[t_op_swap] = sutri.t[tri][t_me]
-				sutri.t[tri][t_me_swap] = t_op[oppo_vert]
+				tv[mesh.half(t_opi, t_op_swap)] = tv[mesh.half(tri, t_me)]
+				tv[mesh.half(tri, t_me_swap)] = tv[t_opt]
 
-				table.insert(stack, {tri, t_me})
-				table.insert(stack, {t_opi, t_op_swap})
+				swaps[n+1] = mesh.half(tri, t_me)
+				swaps[n+2] = mesh.half(t_opi, t_op_swap)
+				n = n + 2
 			end
 		end
 	end
@@ -127,114 +124,721 @@ local function resolve_with_swaps(sutri, tri1, v3, stack)
 	return true
 end
 
-local function rebuild_tris(face, dead_tris, verts, verts_adj, v1, v2, swap, start, end_, link)
+local function rebuild_tris(face, v1, v2, swap, start, end_, link)
 	if end_-start+1 == 0 then
 		return
 	end
 
 	local ci = start
-	local c = verts[start]
+	local c = chain[start]
 
-	local v1_t
-	local v2_t
+	local v1_t = mesh.NONE
+	local v2_t = mesh.NONE
+	local v1_f = 0
+	local v2_f = 0
 
-	local newt = table.remove(dead_tris)
+	-- One of the triangles add_edge freed
+	local newt = mesh.add_tri(face)
 
-	local v2_link = {newt, 2}
-	local v1_link = {newt, 1}
+	local v2_link = mesh.half(newt, 2)
+	local v1_link = mesh.half(newt, 1)
 	if swap then
-		v2_link[2] = 1
-		v1_link[2] = 2
+		v2_link = mesh.half(newt, 1)
+		v1_link = mesh.half(newt, 2)
 	end
 
 	if end_-start+1 > 1 then
+		local x, y = face.x, face.y
 		for i = start,end_ do
-			v = verts[i]
-			if incircle(face.v[v1], face.v[v2], face.v[c], face.v[v]) then
+			local v = chain[i]
+			if incircle(x[v1], y[v1], x[v2], y[v2], x[c], y[c], x[v], y[v]) then
 				ci = i
 				c = v
 			end
 		end
 
-		v2_t = {rebuild_tris(face, dead_tris, verts, verts_adj, v1, c, swap, start, ci-1, v2_link), 3}
-		v1_t = {rebuild_tris(face, dead_tris, verts, verts_adj, c, v2, swap,  ci+1, end_, v1_link), 3}
+		local t2 = rebuild_tris(face, v1, c, swap, start, ci-1, v2_link)
+		local t1 = rebuild_tris(face, c, v2, swap,  ci+1, end_, v1_link)
+		if t2 ~= nil then
+			v2_t = mesh.half(t2, 3)
+		end
+		if t1 ~= nil then
+			v1_t = mesh.half(t1, 3)
+		end
 	end
 
 	if ci == end_ then
-		v1_t = verts_adj[ci+1][1]
-		verts_adj[ci+1][2] = v1_link
+		v1_t = chain_out[ci+1]
+		v1_f = chain_fixed[ci+1]
+		chain_in[ci+1] = v1_link
 	end
 	if ci == start then
-		v2_t = verts_adj[ci][1]
-		verts_adj[ci][2] = v2_link
+		v2_t = chain_out[ci]
+		v2_f = chain_fixed[ci]
+		chain_in[ci] = v2_link
 	end
 
-	local tri
-	local adj
+	local tv, adj, fixed = face.tv, face.adj, face.fixed
+	local h = newt*3
 	if swap then
-		tri = {v2, v1, c}
-		adj = {v2_t, v1_t, link}
+		tv[h], tv[h+1], tv[h+2] = v2, v1, c
+		adj[h], adj[h+1], adj[h+2] = v2_t, v1_t, link
+		fixed[h], fixed[h+1], fixed[h+2] = v2_f, v1_f, 0
 	else
-		tri = {v1, v2, c}
-		adj = {v1_t, v2_t, link}
+		tv[h], tv[h+1], tv[h+2] = v1, v2, c
+		adj[h], adj[h+1], adj[h+2] = v1_t, v2_t, link
+		fixed[h], fixed[h+1], fixed[h+2] = v1_f, v2_f, 0
 	end
-	face.t[newt] = tri
-	face.adj[newt] = adj
-	face.inv_t[c] = {newt, 3}
+	face.vt[c] = h+2
 
 	return newt
 end
 
-local lasttri = nil
 function lib.add_point(sutri, p)
-	tri1 = find_containing_tri(sutri, p, lasttri)
+	-- Start from the vertex the grid has closest to p
+	tri1 = find_containing_tri(sutri, p)
 	if tri1 == nil then
 		error("The point is outside the mesh")
 	end
-	lasttri = tri1
 
 	-- tri1 is reused
 	tri2, tri3 = split_tri(sutri, tri1, p)
 	-- @HACK find the new vertex id
-	local v3 = sutri.t[tri1][3]
+	local v3 = sutri.tv[mesh.half(tri1, 3)]
 
-	local stack = {{tri1, 3}, {tri2, 3}, {tri3, 3}}
-	resolve_with_swaps(sutri, tri1, v3, stack)
+	swaps[1] = mesh.half(tri1, 3)
+	swaps[2] = mesh.half(tri2, 3)
+	swaps[3] = mesh.half(tri3, 3)
+	resolve_with_swaps(sutri, tri1, v3, 3)
 
 	return v3
 end
 
+-- Rounds smaller than this aren't split further
+local BRIO_MIN_ROUND = 64
+-- Keys pack the hilbert index above the point index in the 53 bits a double
+-- holds exactly, so they sort without a comparison function
+local KEY_BITS = 53
+local HILBERT_MAX_ORDER = 16
+
+-- Index of (x, y) along the hilbert curve through a 2^order by 2^order grid
+local function hilbert(order, x, y)
+	local n = bit.lshift(1, order)
+	local d = 0
+	local s = bit.rshift(n, 1)
+	while s > 0 do
+		local rx = bit.band(x, s) ~= 0 and 1 or 0
+		local ry = bit.band(y, s) ~= 0 and 1 or 0
+		d = d + s * s * bit.bxor(3 * rx, ry)
+		-- Rotate the quadrant so the curve inside it starts at the origin
+		if ry == 0 then
+			if rx == 1 then
+				x = n-1 - x
+				y = n-1 - y
+			end
+			x, y = y, x
+		end
+		s = bit.rshift(s, 1)
+	end
+	return d
+end
+
+-- The order to insert pts in: a biased randomized insertion order (BRIO).
+-- The points are shuffled and cut into rounds that double in size, the last
+-- one is half of them. Every round is sorted along a hilbert curve. The
+-- shuffle keeps the expected cost O(n log n) whatever order the points come
+-- in, the sorting means every point is close to the one before, so the walk
+-- to it is short.
+--
+-- The shuffle uses its own generator, the same input always gives the same
+-- mesh.
+function lib.insertion_order(pts)
+	local n = #pts
+	local order = {}
+	if n == 0 then
+		return order
+	end
+
+	local seed = 1
+	for i = 1,n do
+		order[i] = i
+	end
+	for i = n,2,-1 do
+		-- Park-Miller, stays exact in a double
+		seed = seed * 16807 % 2147483647
+		local j = seed % i + 1
+		order[i], order[j] = order[j], order[i]
+	end
+
+	local minx, miny = pts[1][1], pts[1][2]
+	local maxx, maxy = minx, miny
+	for i = 2,n do
+		local p = pts[i]
+		minx = math.min(minx, p[1])
+		miny = math.min(miny, p[2])
+		maxx = math.max(maxx, p[1])
+		maxy = math.max(maxy, p[2])
+	end
+
+	local idxbits = 1
+	while bit.lshift(1, idxbits) < n and idxbits < 31 do
+		idxbits = idxbits + 1
+	end
+	local idxsize = 2^idxbits
+	local curve = math.min(HILBERT_MAX_ORDER, math.floor((KEY_BITS - idxbits) / 2))
+	local extent = math.max(maxx - minx, maxy - miny)
+	local scale = 0
+	if extent > 0 then
+		scale = (2^curve - 1) / extent
+	end
+
+	local round_end = n
+	while round_end > 0 do
+		local round_start = 1
+		if round_end > BRIO_MIN_ROUND then
+			round_start = math.floor(round_end / 2) + 1
+		end
+
+		local keys = {}
+		for i = round_start,round_end do
+			local pi = order[i]
+			local p = pts[pi]
+			local hx = math.floor((p[1] - minx) * scale)
+			local hy = math.floor((p[2] - miny) * scale)
+			keys[i - round_start + 1] = hilbert(curve, hx, hy) * idxsize + (pi - 1)
+		end
+		table.sort(keys)
+		for i = round_start,round_end do
+			order[i] = keys[i - round_start + 1] % idxsize + 1
+		end
+
+		round_end = round_start - 1
+	end
+
+	return order
+end
+
+-- Add all of pts, in the order from insertion_order. ids[i] is the vertex
+-- pts[i] became.
+function lib.add_points(face, pts)
+	local ids = {}
+	for _, i in ipairs(lib.insertion_order(pts)) do
+		ids[i] = lib.add_point(face, pts[i])
+	end
+	return ids
+end
+
+-- Sort ids[lo..hi] by dists[id], quicksort on the ffi arrays since
+-- table.sort with a comparison function is slow for millions of points
+local function sort_by_dist(ids, dists, lo, hi)
+	while hi - lo > 16 do
+		local mid = bit.rshift(lo + hi, 1)
+		local pivot = dists[ids[mid]]
+		local i, j = lo, hi
+		while i <= j do
+			while dists[ids[i]] < pivot do
+				i = i + 1
+			end
+			while dists[ids[j]] > pivot do
+				j = j - 1
+			end
+			if i <= j then
+				ids[i], ids[j] = ids[j], ids[i]
+				i = i + 1
+				j = j - 1
+			end
+		end
+		-- Recurse into the smaller side, loop on the bigger one
+		if j - lo < hi - i then
+			sort_by_dist(ids, dists, lo, j)
+			lo = i
+		else
+			sort_by_dist(ids, dists, i, hi)
+			hi = j
+		end
+	end
+	for i = lo+1,hi do
+		local id = ids[i]
+		local d = dists[id]
+		local j = i - 1
+		while j >= lo and dists[ids[j]] > d do
+			ids[j+1] = ids[j]
+			j = j - 1
+		end
+		ids[j+1] = id
+	end
+end
+
+-- The sweep keeps its triangles counterclockwise in its own arrays, 0 based
+-- like the ffi arrays they are in. Triangle t has the half edges 3t to 3t+2,
+-- half edge e runs from sweep_tv[e] to the start of the next one in the
+-- triangle and sweep_adj[e] is the half edge going the other way or -1.
+local sweep_tv, sweep_adj
+local sweep_nt = 0
+-- Flips legalize made
+local sweep_flips = 0
+-- Flips per point so far the sweep may make before giving up. Scattered
+-- points take about 5, points along a smooth curve take more the more of
+-- them are in, as each one lands in the circles of long thin triangles
+-- across the curve. Adding those one at a time is far faster
+local SWEEP_FLIPS_PER_POINT = 32
+-- Flips allowed on top, so the first few points don't decide it
+local SWEEP_FLIPS_SLACK = 10000
+-- The edges legalize still has to check
+local legal_stack = {}
+
+local function sweep_link(a, b)
+	sweep_adj[a] = b
+	if b ~= -1 then
+		sweep_adj[b] = a
+	end
+end
+
+local function sweep_add_tri(a, b, c, ab, bc, ca)
+	local t = sweep_nt * 3
+	sweep_tv[t], sweep_tv[t+1], sweep_tv[t+2] = a, b, c
+	sweep_link(t, ab)
+	sweep_link(t+1, bc)
+	sweep_link(t+2, ca)
+	sweep_nt = sweep_nt + 1
+	return t
+end
+
+local ICC_ERRBOUND = (10 + 96 * 2^-53) * 2^-53
+
+-- predicates.incircle, with the float determinant and its error bound done
+-- here. Almost every test the sweep makes is decided by them, and the call
+-- into the library costs more than they do
+local function incircle(ax, ay, bx, by, cx, cy, dx, dy)
+	local adx, ady = ax - dx, ay - dy
+	local bdx, bdy = bx - dx, by - dy
+	local cdx, cdy = cx - dx, cy - dy
+
+	local bdxcdy, cdxbdy = bdx * cdy, cdx * bdy
+	local cdxady, adxcdy = cdx * ady, adx * cdy
+	local adxbdy, bdxady = adx * bdy, bdx * ady
+	local alift = adx * adx + ady * ady
+	local blift = bdx * bdx + bdy * bdy
+	local clift = cdx * cdx + cdy * cdy
+
+	local det = alift * (bdxcdy - cdxbdy)
+		+ blift * (cdxady - adxcdy)
+		+ clift * (adxbdy - bdxady)
+	local permanent = (math.abs(bdxcdy) + math.abs(cdxbdy)) * alift
+		+ (math.abs(cdxady) + math.abs(adxcdy)) * blift
+		+ (math.abs(adxbdy) + math.abs(bdxady)) * clift
+	local errbound = ICC_ERRBOUND * permanent
+	if det > errbound or -det > errbound then
+		return det
+	end
+	return predicates.incircle(ax, ay, bx, by, cx, cy, dx, dy)
+end
+
+-- Flip the edge a and the ones behind it until they are all Delaunay.
+-- Returns the half edge that ends up on the hull side of the triangle of a
+local function legalize(a, x, y, hull)
+	local n = 0
+	local ar = 0
+	while true do
+		local b = sweep_adj[a]
+		--          pl                    pl
+		--         /||\                  /  \
+		--      al/ || \bl            al/    \a
+		--       /  ||  \              /      \
+		--      /  a||b  \    flip    /___ar___\
+		--    p0\   ||   /p1   =>   p0\---bl---/p1
+		--       \  ||  /              \      /
+		--      ar\ || /br             b\    /br
+		--         \||/                  \  /
+		--          pr                    pr
+		local a0 = a - a % 3
+		ar = a0 + (a + 2) % 3
+		local flip = false
+		if b ~= -1 then
+			local b0 = b - b % 3
+			local al = a0 + (a + 1) % 3
+			local bl = b0 + (b + 2) % 3
+			local p0 = sweep_tv[ar]
+			local pr = sweep_tv[a]
+			local pl = sweep_tv[al]
+			local p1 = sweep_tv[bl]
+			-- Only strictly inside, cocircular points would flip forever
+			if incircle(x[p0], y[p0], x[pr], y[pr], x[pl], y[pl], x[p1], y[p1]) > 0 then
+				flip = true
+				sweep_tv[a] = p1
+				sweep_tv[b] = p0
+
+				local hbl = sweep_adj[bl]
+				if hbl == -1 then
+					-- The flipped edge was on the hull, fix the hull's
+					-- reference to it. That's kept with the vertex the edge
+					-- starts from, which is still p1 after the flip
+					hull.tri[p1] = a
+				end
+				sweep_link(a, hbl)
+				sweep_link(b, sweep_adj[ar])
+				sweep_link(ar, bl)
+
+				sweep_flips = sweep_flips + 1
+				n = n + 1
+				legal_stack[n] = b0 + (b + 1) % 3
+			end
+		end
+		if not flip then
+			if n == 0 then
+				break
+			end
+			a = legal_stack[n]
+			n = n - 1
+		end
+	end
+	return ar
+end
+
+local function circumcenter(ax, ay, bx, by, cx, cy)
+	local dx, dy = bx - ax, by - ay
+	local ex, ey = cx - ax, cy - ay
+	local bl = dx*dx + dy*dy
+	local cl = ex*ex + ey*ey
+	local d = 0.5 / (dx*ey - dy*ex)
+	return ax + (ey*bl - dy*cl) * d, ay + (dx*cl - ex*bl) * d
+end
+
+-- Squared, infinite if a, b, c are on a line
+local function circumradius(ax, ay, bx, by, cx, cy)
+	local ox, oy = circumcenter(ax, ay, bx, by, cx, cy)
+	local r = (ox - ax)^2 + (oy - ay)^2
+	if r ~= r then
+		return math.huge
+	end
+	return r
+end
+
+local function pseudo_angle(dx, dy)
+	local p = dx / (math.abs(dx) + math.abs(dy))
+	if dy > 0 then
+		return (3 - p) / 4
+	end
+	return (1 + p) / 4
+end
+
+-- Replace the super triangle, the only triangle in face, with the Delaunay
+-- triangulation of its corners and pts, built all at once with a sweep
+-- (Delaunator's sweep-hull). It's the mesh add_points would make but a lot
+-- faster, as there's no walking to the points and no flip stacks. ids[i] is
+-- the vertex pts[i] became, points that are the same share one.
+function lib.add_points_bulk(face, pts)
+	assert(face.nv == 3 and face.nt == 1 and face.nfree == 0)
+	if #pts < 3 then
+		return lib.add_points(face, pts)
+	end
+
+	-- The sweep has its own copy of the points numbered from 0, the super
+	-- triangle corners first
+	local n = #pts + 3
+	local x = ffi.new("double[?]", n)
+	local y = ffi.new("double[?]", n)
+	for i = 0,2 do
+		x[i], y[i] = face.x[i+1], face.y[i+1]
+	end
+	for i, p in ipairs(pts) do
+		x[i+2], y[i+2] = p[1], p[2]
+	end
+
+	-- Seed with the point closest to the middle, the one closest to that and
+	-- the one making the smallest circle with them. The super triangle
+	-- corners are the farthest from the seed, so they come last and close
+	-- the hull around everything
+	local mx, my = 0, 0
+	for i = 0,2 do
+		mx, my = mx + x[i] / 3, my + y[i] / 3
+	end
+	local function closest(px, py)
+		local best, bestd = -1, math.huge
+		for i = 0,n-1 do
+			local d = (x[i] - px)^2 + (y[i] - py)^2
+			-- Not the point itself, or the same point again
+			if d > 0 and d < bestd then
+				best, bestd = i, d
+			end
+		end
+		return best
+	end
+	local i0 = closest(mx, my)
+	local i1 = closest(x[i0], y[i0])
+	local i2, minr = -1, math.huge
+	for i = 0,n-1 do
+		local r = circumradius(x[i0], y[i0], x[i1], y[i1], x[i], y[i])
+		if r < minr then
+			i2, minr = i, r
+		end
+	end
+	if predicates.orient2d(x[i0], y[i0], x[i1], y[i1], x[i2], y[i2]) < 0 then
+		i1, i2 = i2, i1
+	end
+	local cx, cy = circumcenter(x[i0], y[i0], x[i1], y[i1], x[i2], y[i2])
+
+	local order = ffi.new("int32_t[?]", n)
+	local dists = ffi.new("double[?]", n)
+	for i = 0,n-1 do
+		order[i] = i
+		local dx, dy = x[i] - cx, y[i] - cy
+		dists[i] = dx*dx + dy*dy
+	end
+	sort_by_dist(order, dists, 0, n-1)
+
+	-- Points that are the same are the same distance away, so they end up
+	-- in a run together. same[i] is the point i is a copy of, or i. The
+	-- super triangle corners and the seed points are never copies, they are
+	-- in the hull already
+	local same = ffi.new("int32_t[?]", n)
+	for i = 0,n-1 do
+		same[i] = i
+	end
+	local run = 0
+	for k = 1,n do
+		if k == n or dists[order[k]] ~= dists[order[run]] then
+			for a = run+1,k-1 do
+				local i = order[a]
+				for b = run,a-1 do
+					local j = order[b]
+					if same[j] == j and x[i] == x[j] and y[i] == y[j] then
+						if i <= 2 or i == i0 or i == i1 or i == i2 then
+							same[j] = i
+						else
+							same[i] = j
+						end
+						break
+					end
+				end
+			end
+			run = k
+		end
+	end
+
+	-- The vertices, in the order of pts
+	local vid = ffi.new("int32_t[?]", n)
+	face.nv = 0
+	for i = 0,n-1 do
+		local j = same[i]
+		while same[j] ~= j do
+			j = same[j]
+		end
+		same[i] = j
+		if j == i then
+			vid[i] = mesh.add_vert(face, x[i], y[i])
+		end
+	end
+	local ids = {}
+	for i = 0,n-1 do
+		vid[i] = vid[same[i]]
+		if i > 2 then
+			ids[i-2] = vid[i]
+		end
+	end
+
+	-- From here on the points are numbered by their place in order, so the
+	-- ones the sweep works on together are next to each other in memory.
+	-- Numbered like pts, nearly every coordinate it looked up missed the
+	-- cache. copy[k] is set for the points that are the same as another
+	local sx = ffi.new("double[?]", n)
+	local sy = ffi.new("double[?]", n)
+	local svid = ffi.new("int32_t[?]", n)
+	local copy = ffi.new("uint8_t[?]", n)
+	local s0, s1, s2
+	for k = 0,n-1 do
+		local i = order[k]
+		sx[k], sy[k] = x[i], y[i]
+		svid[k] = vid[i]
+		copy[k] = same[i] ~= i and 1 or 0
+		if i == i0 then
+			s0 = k
+		elseif i == i1 then
+			s1 = k
+		elseif i == i2 then
+			s2 = k
+		end
+	end
+	x, y, vid = sx, sy, svid
+	i0, i1, i2 = s0, s1, s2
+
+	local maxtris = 2*n - 5
+	sweep_tv = ffi.new("int32_t[?]", maxtris*3)
+	sweep_adj = ffi.new("int32_t[?]", maxtris*3)
+	sweep_nt = 0
+	sweep_flips = 0
+
+	local hull = {
+		prev = ffi.new("int32_t[?]", n),
+		next = ffi.new("int32_t[?]", n),
+		tri = ffi.new("int32_t[?]", n),
+		start = 0,
+	}
+	local hash_size = math.ceil(math.sqrt(n))
+	local hash = ffi.new("int32_t[?]", hash_size)
+
+	local function hash_key(px, py)
+		return math.floor(pseudo_angle(px - cx, py - cy) * hash_size) % hash_size
+	end
+
+	hull.next[i0], hull.prev[i2] = i1, i1
+	hull.next[i1], hull.prev[i0] = i2, i2
+	hull.next[i2], hull.prev[i1] = i0, i0
+	hull.tri[i0], hull.tri[i1], hull.tri[i2] = 0, 1, 2
+	hull.start = i0
+	for i = 0,hash_size-1 do
+		hash[i] = -1
+	end
+	hash[hash_key(x[i0], y[i0])] = i0
+	hash[hash_key(x[i1], y[i1])] = i1
+	hash[hash_key(x[i2], y[i2])] = i2
+
+	sweep_add_tri(i0, i1, i2, -1, -1, -1)
+
+	-- Set if a point isn't outside the hull when its turn comes, which the
+	-- order should rule out, or if the flips go over budget. Then it's all
+	-- done one point at a time instead
+	local missed = false
+	local hprev, hnext, htri = hull.prev, hull.next, hull.tri
+	for i = 0,n-1 do
+		if copy[i] == 0 and i ~= i0 and i ~= i1 and i ~= i2 then
+			local px, py = x[i], y[i]
+
+			-- Find an edge of the hull the point can see, starting
+			-- around the same angle
+			local start = 0
+			local key = hash_key(px, py)
+			for j = 0,hash_size-1 do
+				start = hash[(key + j) % hash_size]
+				if start ~= -1 and start ~= hnext[start] then
+					break
+				end
+			end
+			start = hprev[start]
+			local e = start
+			local q = hnext[e]
+			while predicates.orient2d(x[e], y[e], x[q], y[q], px, py) >= 0 do
+				e = q
+				if e == start then
+					e = -1
+					break
+				end
+				q = hnext[e]
+			end
+
+			if e == -1 then
+				missed = true
+				break
+			else
+				local t = sweep_add_tri(e, i, hnext[e], -1, -1, htri[e])
+				htri[i] = legalize(t + 2, x, y, hull)
+				htri[e] = t
+
+				-- Add triangles to the rest of the hull edges it can see,
+				-- going forward
+				local nx = hnext[e]
+				q = hnext[nx]
+				while predicates.orient2d(x[nx], y[nx], x[q], y[q], px, py) < 0 do
+					t = sweep_add_tri(nx, i, q, htri[i], -1, htri[nx])
+					htri[i] = legalize(t + 2, x, y, hull)
+					-- Off the hull
+					hnext[nx] = nx
+					nx = q
+					q = hnext[nx]
+				end
+
+				-- and backward
+				if e == start then
+					q = hprev[e]
+					while predicates.orient2d(x[q], y[q], x[e], y[e], px, py) < 0 do
+						t = sweep_add_tri(q, i, e, -1, htri[e], htri[q])
+						legalize(t + 2, x, y, hull)
+						htri[q] = t
+						hnext[e] = e
+						e = q
+						q = hprev[e]
+					end
+				end
+
+				hull.start = e
+				hprev[i] = e
+				hnext[e] = i
+				hprev[nx] = i
+				hnext[i] = nx
+				hash[hash_key(px, py)] = i
+				hash[hash_key(x[e], y[e])] = e
+
+				if sweep_flips > SWEEP_FLIPS_PER_POINT * i + SWEEP_FLIPS_SLACK then
+					missed = true
+					break
+				end
+			end
+		end
+	end
+
+	if missed then
+		sweep_tv, sweep_adj = nil, nil
+		face.nv = 3
+		face.grid = nil
+		for i = 1,3 do
+			face.vt[i] = mesh.half(1, i)
+		end
+		return lib.add_points(face, pts)
+	end
+
+	-- Into the mesh, clockwise. The counterclockwise
+	-- a, b, c becomes a, c, b, so the half edges a->b, b->c, c->a are
+	-- across from the corners 2, 1 and 3
+	local corner = {[0] = 2, 1, 3}
+	face.nt = 0
+	for t = 0,sweep_nt-1 do
+		mesh.add_tri(face)
+	end
+	local tv, adj, vt = face.tv, face.adj, face.vt
+	for t = 0,sweep_nt-1 do
+		local h = (t+1)*3
+		local a, b, c = sweep_tv[t*3], sweep_tv[t*3+1], sweep_tv[t*3+2]
+		a, b, c = vid[a], vid[b], vid[c]
+		tv[h], tv[h+1], tv[h+2] = a, c, b
+		vt[a], vt[b], vt[c] = h, h+2, h+1
+		for k = 0,2 do
+			local o = sweep_adj[t*3+k]
+			if o ~= -1 then
+				local ot = o - o % 3
+				adj[h + corner[k] - 1] = ot + 3 + corner[o - ot] - 1
+			end
+		end
+	end
+	sweep_tv, sweep_adj = nil, nil
+
+	return ids
+end
+
 function lib.add_edge(face, v1i, v2i)
 	assert(v1i ~= v2i)
-	if is_fixed(face, v1i, v2i) then
-		return
-	end
 
 	local tri_cursor, tri_vert = find_tri_with_vert(face, v1i)
 	if tri_cursor == nil then
 		error("Vertex is not part of any triangle")
 	end
 
-	local v1 = face.v[v1i]
-	local v2 = face.v[v2i]
-
-	local av2x, av2y = vec_minus(v2[1], v2[2], v1[1], v1[2])
+	local x, y = face.x, face.y
+	local tv, adj, vt, fixed = face.tv, face.adj, face.vt, face.fixed
+	local v1x, v1y = x[v1i], y[v1i]
+	local v2x, v2y = x[v2i], y[v2i]
 
 	local start_tri = tri_cursor
 
 	while true do
-		local tri = face.t[tri_cursor]
-		b = face.v[tri[clockwise_vert(tri_vert)]]
-		c = face.v[tri[anticlockwise_vert(tri_vert)]]
-
-		abx, aby = vec_minus(b[1], b[2], v1[1], v1[2])
-		acx, acy = vec_minus(c[1], c[2], v1[1], v1[2])
+		local b = tv[mesh.half(tri_cursor, clockwise_vert(tri_vert))]
+		local c = tv[mesh.half(tri_cursor, anticlockwise_vert(tri_vert))]
 
-		inside = (vec_cross(abx, aby, acx, acy) * vec_cross(abx, aby, av2x, av2y) >= 0 and
-			vec_cross(acx, acy, abx, aby) * vec_cross(acx, acy, av2x, av2y) >= 0)
+		local bc = predicates.orient2d(v1x, v1y, x[b], y[b], x[c], y[c])
+		local inside = (bc * predicates.orient2d(v1x, v1y, x[b], y[b], v2x, v2y) >= 0 and
+			-bc * predicates.orient2d(v1x, v1y, x[c], y[c], v2x, v2y) >= 0)
 
 		if not inside then
-			local new_tri, oppo_vert = unpack_or_nil(opposing_tri(face, tri_cursor, clockwise_vert(tri_vert)))
+			local new_tri, oppo_vert = opposing_tri(face, tri_cursor, clockwise_vert(tri_vert))
 			if new_tri == nil then
 				deadlock()
 			end
@@ -248,108 +852,118 @@ function lib.add_edge(face, v1i, v2i)
 		end
 	end
 
-	local upper
-	local upper_adj = {}
-	if face.t[tri_cursor][clockwise_vert(tri_vert)] ~= v2i then
-		upper = {face.t[tri_cursor][clockwise_vert(tri_vert)]}
-		upper_adj[#upper_adj+1] = {opposing_tri(face, tri_cursor, anticlockwise_vert(tri_vert))}
+	local nupper, nupper_out = 0, 0
+	local nlower, nlower_out = 0, 0
+
+	if tv[mesh.half(tri_cursor, clockwise_vert(tri_vert))] ~= v2i then
+		nupper, nupper_out = 1, 1
+		chain[1] = tv[mesh.half(tri_cursor, clockwise_vert(tri_vert))]
+		chain_out[1] = adj[mesh.half(tri_cursor, anticlockwise_vert(tri_vert))]
+		chain_fixed[1] = fixed[mesh.half(tri_cursor, anticlockwise_vert(tri_vert))]
 	else
-		set_fixed(face, v1i, v2i)
+		-- The edge is already there
+		mesh.set_fixed(face, mesh.half(tri_cursor, anticlockwise_vert(tri_vert)))
 		return 9
 	end
-	local lower
-	local lower_adj = {}
-	if face.t[tri_cursor][anticlockwise_vert(tri_vert)] ~= v2i then
-		lower = {face.t[tri_cursor][anticlockwise_vert(tri_vert)]}
-		lower_adj[#lower_adj+1] = {opposing_tri(face, tri_cursor, clockwise_vert(tri_vert))}
+	if tv[mesh.half(tri_cursor, anticlockwise_vert(tri_vert))] ~= v2i then
+		nlower, nlower_out = 1, 1
+		lower[1] = tv[mesh.half(tri_cursor, anticlockwise_vert(tri_vert))]
+		lower_out[1] = adj[mesh.half(tri_cursor, clockwise_vert(tri_vert))]
+		lower_fixed[1] = fixed[mesh.half(tri_cursor, clockwise_vert(tri_vert))]
 	else
-		set_fixed(face, v1i, v2i)
+		mesh.set_fixed(face, mesh.half(tri_cursor, clockwise_vert(tri_vert)))
 		return 9
 	end
 
 	local vi = tri_vert
 
-	dead_tris = {}
-
 	while true do
-		for i, v in ipairs(face.t[tri_cursor]) do
-			if v == v2i then
-				upper_adj[#upper_adj+1] = {opposing_tri(face, tri_cursor, clockwise_vert(i))}
-				lower_adj[#lower_adj+1] = {opposing_tri(face, tri_cursor, anticlockwise_vert(i))}
+		for i = 1,3 do
+			if tv[mesh.half(tri_cursor, i)] == v2i then
+				nupper_out = nupper_out + 1
+				chain_out[nupper_out] = adj[mesh.half(tri_cursor, clockwise_vert(i))]
+				chain_fixed[nupper_out] = fixed[mesh.half(tri_cursor, clockwise_vert(i))]
+				nlower_out = nlower_out + 1
+				lower_out[nlower_out] = adj[mesh.half(tri_cursor, anticlockwise_vert(i))]
+				lower_fixed[nlower_out] = fixed[mesh.half(tri_cursor, anticlockwise_vert(i))]
 				goto done
 			end
 		end
 
-		-- local v = face.v[vi]
-		local tseg, vseg = unpack_or_nil(opposing_tri(face, tri_cursor, vi))
-		local vo = face.v[face.t[tseg][vseg]]
+		do
+			local tseg, vseg = opposing_tri(face, tri_cursor, vi)
+			local vo = tv[mesh.half(tseg, vseg)]
+
+			if vo == v2i then
+			elseif predicates.orient2d(v1x, v1y, x[vo], y[vo], v2x, v2y) > 0 then
+				nupper = nupper + 1
+				chain[nupper] = vo
+				nupper_out = nupper_out + 1
+				chain_out[nupper_out] = adj[mesh.half(tseg, clockwise_vert(vseg))]
+				chain_fixed[nupper_out] = fixed[mesh.half(tseg, clockwise_vert(vseg))]
+				vi = anticlockwise_vert(vseg)
+			else
+				nlower = nlower + 1
+				lower[nlower] = vo
+				nlower_out = nlower_out + 1
+				lower_out[nlower_out] = adj[mesh.half(tseg, anticlockwise_vert(vseg))]
+				lower_fixed[nlower_out] = fixed[mesh.half(tseg, anticlockwise_vert(vseg))]
+				vi = clockwise_vert(vseg)
+			end
 
-		v1vox, v1voy = vec_minus(vo[1], vo[2], v1[1], v1[2])
-		if face.t[tseg][vseg] == v2i then
-		elseif vec_cross(v1vox, v1voy, av2x, av2y) > 0 then
-			upper[#upper+1] = face.t[tseg][vseg]
-			upper_adj[#upper_adj+1] = {opposing_tri(face, tseg, clockwise_vert(vseg))}
-			vi = anticlockwise_vert(vseg)
-		else
-			lower[#lower+1] = face.t[tseg][vseg]
-			lower_adj[#lower_adj+1] = {opposing_tri(face, tseg, anticlockwise_vert(vseg))}
-			vi = clockwise_vert(vseg)
+			mesh.free_tri(face, tri_cursor)
+			tri_cursor = tseg
 		end
-
-		dead_tris[#dead_tris+1] = tri_cursor
-		tri_cursor = tseg
 	end
 	::done::
-	dead_tris[#dead_tris+1] = tri_cursor
-
-	upper_end = #upper
-	table.insert(upper, "-- SEP --")
-	for i,v in ipairs(lower) do
-		table.insert(upper, v)
-	end
-	for i,v in ipairs(lower_adj) do
-		table.insert(upper_adj, v)
-	end
+	mesh.free_tri(face, tri_cursor)
 
-	uv = rebuild_tris(face, dead_tris, upper, upper_adj, v1i, v2i, false, 1, upper_end, nil)
-	lv = rebuild_tris(face, dead_tris, upper, upper_adj, v1i, v2i, true, upper_end+2, #upper, nil)
-	-- Set the adjecency of the root triangles
-	-- table_print(uv)
-	if lv ~= nil then
-		face.adj[uv][3] = {lv, 3}
+	local upper_end = nupper
+	chain[upper_end+1] = 0
+	for i = 1,nlower do
+		chain[upper_end+1+i] = lower[i]
 	end
-	if uv ~= nil then
-		face.adj[lv][3] = {uv, 3}
+	local nchain = upper_end+1+nlower
+	for i = 1,nlower_out do
+		chain_out[nupper_out+i] = lower_out[i]
+		chain_fixed[nupper_out+i] = lower_fixed[i]
 	end
-
-	face.inv_t[v1i] = {uv, 1}
-	face.inv_t[v2i] = {uv, 2}
-
-	for i=3,#upper do
-		if type(upper[i]) ~= "string" and type(upper[i-2]) ~= "string" then
-			-- print(upper[i], upper[i-2])
-			if upper[i] == upper[i-2] then
-				-- print("They are the same")
-				local s1 = upper_adj[i-1]
-				local s2 = upper_adj[i]
-				s1.adj = true
-				s2.adj = true
-
-				-- Adjust the adjecencies
-				face.adj[s1[2][1]][s1[2][2]] = s2[2]
-				face.adj[s2[2][1]][s2[2][2]] = s1[2]
+	local nchain_out = nupper_out+nlower_out
+
+	local uv = rebuild_tris(face, v1i, v2i, false, 1, upper_end, mesh.NONE)
+	local lv = rebuild_tris(face, v1i, v2i, true, upper_end+2, nchain, mesh.NONE)
+	-- The root triangles meet at the new edge
+	mesh.link(face, mesh.half(uv, 3), mesh.half(lv, 3), 1)
+
+	vt[v1i] = mesh.half(uv, 1)
+	vt[v2i] = mesh.half(uv, 2)
+
+	for i=3,nchain do
+		if chain[i] ~= 0 and chain[i-2] ~= 0 then
+			if chain[i] == chain[i-2] then
+				-- The new triangles on either side of the vertex between
+				-- are each others neighbours
+				local s1 = chain_in[i-1]
+				local s2 = chain_in[i]
+				chain_out[i-1] = LINKED
+				chain_out[i] = LINKED
+
+				adj[s1] = s2
+				adj[s2] = s1
 			end
 		end
 	end
 
-	for _,v in ipairs(upper_adj) do
-		if not v.adj then
-			face.adj[v[1][1]][v[1][2]] = v[2]
+	for i = 1,nchain_out do
+		if chain_out[i] == mesh.NONE then
+			error("The edge cuts through the hull")
+		end
+		if chain_out[i] ~= LINKED then
+			adj[chain_out[i]] = chain_in[i]
 		end
 	end
 
 	::complete::
-	set_fixed(face, v1i, v2i)
 
 	-- return tri_cursor
 	return 9